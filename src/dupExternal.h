@@ -0,0 +1,299 @@
+#pragma once
+
+#include "dupGridHash.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <vector>
+
+namespace DwgSim
+{
+    /**
+     * @brief fixed radius neighbour pairs of key sets that need not fit in memory, by an external sort and a sweep
+     *
+     * Keys come from fill functions in chunks of 4-aligned rows, only one chunk is held at a time.
+     * Each chunk is sorted on one coordinate, the one of largest spread, and written to a temporary run file;
+     * runs are merged k-way, in several passes if their read buffers would not fit the budget.
+     * The merged stream is swept with a window of the keys close to the current one on the sweep coordinate,
+     * and each window key is tested with DupDistSqr < eps * eps, the test of the in-memory searches,
+     * so the pairs found are the same. Keys with a non-finite sweep coordinate have no neighbours and are dropped.
+     *
+     * Chunks and merge buffers stay within the budget, though a merge reads at least two runs with 64 KiB each;
+     * the window holds the keys of one 4 eps slab and is not bounded by it.
+     */
+    class ExternalDupSweep
+    {
+    public:
+        //* fill(begin, end, rows): keys begin .. end-1, stride values each, into rows
+        using Fill = std::function<void(int64_t, int64_t, double *)>;
+
+    private:
+        int dim;
+        int stride;
+        double eps;
+        size_t budget;
+        int sweepCol = 0;
+
+        struct FileCloser
+        {
+            void operator()(std::FILE *f) const { std::fclose(f); }
+        };
+        using File = std::unique_ptr<std::FILE, FileCloser>;
+
+        //* record: index (tests stored as -1 - i), then the dim key values
+        size_t recordSize() const { return sizeof(int64_t) + sizeof(double) * size_t(dim); }
+
+        static File tempFile()
+        {
+            File f(std::tmpfile());
+            if (!f)
+                throw std::runtime_error("ExternalDupSweep: cannot create a temporary file");
+            return f;
+        }
+
+        static void write(std::FILE *f, const void *p, size_t n)
+        {
+            if (n && std::fwrite(p, 1, n, f) != n)
+                throw std::runtime_error("ExternalDupSweep: cannot write a temporary file");
+        }
+
+        //* buffered sequential reader of one run
+        struct RunReader
+        {
+            std::FILE *f = nullptr;
+            size_t recSize = 0;
+            std::vector<char> buf;
+            size_t pos = 0, end = 0;
+
+            const char *next()
+            {
+                if (pos == end)
+                {
+                    end = std::fread(buf.data(), 1, buf.size(), f);
+                    pos = 0;
+                    if (end == 0)
+                        return nullptr;
+                    if (end % recSize)
+                        throw std::runtime_error("ExternalDupSweep: truncated temporary file");
+                }
+                const char *r = buf.data() + pos;
+                pos += recSize;
+                return r;
+            }
+        };
+
+        double sweepValue(const char *r) const
+        {
+            double v;
+            std::memcpy(&v, r + sizeof(int64_t) + sizeof(double) * size_t(sweepCol), sizeof(double));
+            return v;
+        }
+
+        static int64_t recordIndex(const char *r)
+        {
+            int64_t i;
+            std::memcpy(&i, r, sizeof(int64_t));
+            return i;
+        }
+
+        size_t chunkRows() const
+        {
+            size_t rows = budget / 2 / (sizeof(double) * size_t(stride) + recordSize() + sizeof(int64_t));
+            return std::max<size_t>(64, rows / 4 * 4);
+        }
+
+        size_t blockBytes() const { return std::max<size_t>(recordSize(), (size_t(1) << 16) / recordSize() * recordSize()); }
+
+        //* onRecord(r) for the records of all runs, by sweep value
+        template <class G>
+        void mergeRuns(std::vector<File> &runs, G &&onRecord)
+        {
+            std::vector<RunReader> readers(runs.size());
+            using Head = std::pair<std::pair<double, int64_t>, size_t>;
+            std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+            std::vector<const char *> cur(runs.size());
+            for (size_t k = 0; k < runs.size(); k++)
+            {
+                std::rewind(runs[k].get());
+                readers[k] = RunReader{runs[k].get(), recordSize(), std::vector<char>(blockBytes())};
+                if ((cur[k] = readers[k].next()))
+                    heads.push({{sweepValue(cur[k]), recordIndex(cur[k])}, k});
+            }
+            while (!heads.empty())
+            {
+                size_t k = heads.top().second;
+                heads.pop();
+                onRecord(cur[k]);
+                if ((cur[k] = readers[k].next()))
+                    heads.push({{sweepValue(cur[k]), recordIndex(cur[k])}, k});
+            }
+        }
+
+        void chooseSweepCol(int64_t nPts, const Fill &fillPts, int64_t nTests, const Fill &fillTests)
+        {
+            std::vector<double> lo(dim, std::numeric_limits<double>::infinity()), hi(dim, -std::numeric_limits<double>::infinity());
+            std::vector<double> rows(chunkRows() * size_t(stride));
+            auto scan = [&](int64_t n, const Fill &fill)
+            {
+                for (int64_t b = 0; b < n; b += int64_t(chunkRows()))
+                {
+                    int64_t e = std::min<int64_t>(n, b + int64_t(chunkRows()));
+                    fill(b, e, rows.data());
+                    for (int64_t i = 0; i < e - b; i++)
+                        for (int d = 0; d < dim; d++)
+                        {
+                            double v = rows[size_t(i) * stride + d];
+                            if (std::isfinite(v))
+                                lo[d] = std::min(lo[d], v), hi[d] = std::max(hi[d], v);
+                        }
+                }
+            };
+            scan(nPts, fillPts);
+            scan(nTests, fillTests);
+            double spread = 0;
+            sweepCol = 0;
+            for (int d = 0; d < dim; d++)
+                if (hi[d] - lo[d] > spread)
+                    spread = hi[d] - lo[d], sweepCol = d;
+        }
+
+        //* sorted runs of both sets, merged down to at most fanIn runs
+        std::vector<File> writeRuns(int64_t nPts, const Fill &fillPts, int64_t nTests, const Fill &fillTests)
+        {
+            std::vector<File> runs;
+            std::vector<double> rows(chunkRows() * size_t(stride));
+            std::vector<int64_t> order;
+            std::vector<char> out;
+            auto spill = [&](int64_t n, const Fill &fill, bool isTest)
+            {
+                for (int64_t b = 0; b < n; b += int64_t(chunkRows()))
+                {
+                    int64_t e = std::min<int64_t>(n, b + int64_t(chunkRows()));
+                    fill(b, e, rows.data());
+                    order.clear();
+                    for (int64_t i = 0; i < e - b; i++)
+                        if (std::isfinite(rows[size_t(i) * stride + sweepCol]))
+                            order.push_back(i);
+                    //* the order of equal sweep values does not change the pairs, it is only kept deterministic
+                    std::sort(order.begin(), order.end(),
+                              [&](int64_t x, int64_t y)
+                              {
+                                  double vx = rows[size_t(x) * stride + sweepCol], vy = rows[size_t(y) * stride + sweepCol];
+                                  return vx < vy || (vx == vy && x < y);
+                              });
+                    out.resize(order.size() * recordSize());
+                    char *o = out.data();
+                    for (auto i : order)
+                    {
+                        int64_t idx = isTest ? -1 - (b + i) : b + i;
+                        std::memcpy(o, &idx, sizeof(int64_t));
+                        std::memcpy(o + sizeof(int64_t), rows.data() + size_t(i) * stride, sizeof(double) * size_t(dim));
+                        o += recordSize();
+                    }
+                    runs.push_back(tempFile());
+                    write(runs.back().get(), out.data(), out.size());
+                }
+            };
+            spill(nPts, fillPts, false);
+            spill(nTests, fillTests, true);
+
+            size_t fanIn = std::max<size_t>(2, budget / 2 / blockBytes());
+            while (runs.size() > fanIn)
+            {
+                std::vector<File> merged;
+                for (size_t k = 0; k < runs.size(); k += fanIn)
+                {
+                    std::vector<File> group;
+                    for (size_t kk = k; kk < std::min(runs.size(), k + fanIn); kk++)
+                        group.push_back(std::move(runs[kk]));
+                    File f = tempFile();
+                    std::vector<char> buf;
+                    buf.reserve(blockBytes());
+                    mergeRuns(group, [&](const char *r)
+                              {
+                                  buf.insert(buf.end(), r, r + recordSize());
+                                  if (buf.size() >= blockBytes())
+                                      write(f.get(), buf.data(), buf.size()), buf.clear(); });
+                    write(f.get(), buf.data(), buf.size());
+                    merged.push_back(std::move(f));
+                }
+                runs = std::move(merged);
+            }
+            return runs;
+        }
+
+    public:
+        /**
+         * @param dim number of leading key values compared
+         * @param stride number of values per row the fill functions write, at least dim
+         * @param budgetBytes memory for the chunks and the merge buffers
+         */
+        ExternalDupSweep(int dim, int stride, double eps, size_t budgetBytes)
+            : dim(dim), stride(stride), eps(eps), budget(budgetBytes)
+        {
+        }
+
+        /**
+         * @brief f(i, j, distSqr, keyI, keyJ) for every pair of a test i and a point j within eps,
+         * or with nTests < 0 for every pair of points i != j within eps, once per unordered pair
+         */
+        template <class F>
+        void forPairs(int64_t nPts, const Fill &fillPts, int64_t nTests, const Fill &fillTests, F &&f)
+        {
+            bool self = nTests < 0;
+            nTests = std::max<int64_t>(nTests, 0);
+            chooseSweepCol(nPts, fillPts, nTests, fillTests);
+            auto runs = writeRuns(nPts, fillPts, nTests, fillTests);
+
+            //* window of the records within the slab, oldest first from head
+            std::vector<double> winKeys, winV;
+            std::vector<int64_t> winIdx;
+            size_t head = 0;
+            std::vector<double> key(dim);
+            double radiusSqr = eps * eps;
+            mergeRuns(runs, [&](const char *r)
+                      {
+                          double v = sweepValue(r);
+                          double halo = 2 * eps + 4 * std::numeric_limits<double>::epsilon() * std::abs(v);
+                          while (head < winV.size() && v - winV[head] > halo)
+                              head++;
+                          if (head > winV.size() / 2)
+                          {
+                              winKeys.erase(winKeys.begin(), winKeys.begin() + head * size_t(dim));
+                              winV.erase(winV.begin(), winV.begin() + head);
+                              winIdx.erase(winIdx.begin(), winIdx.begin() + head);
+                              head = 0;
+                          }
+
+                          int64_t idx = recordIndex(r);
+                          std::memcpy(key.data(), r + sizeof(int64_t), sizeof(double) * size_t(dim));
+                          for (size_t w = head; w < winV.size(); w++)
+                          {
+                              int64_t idxW = winIdx[w];
+                              if (!self && (idx < 0) == (idxW < 0))
+                                  continue;
+                              const double *keyW = winKeys.data() + w * size_t(dim);
+                              double distSqr = DupDistSqr(key.data(), keyW, size_t(dim));
+                              if (!(distSqr < radiusSqr))
+                                  continue;
+                              if (self)
+                                  f(idx, idxW, distSqr, key.data(), keyW);
+                              else if (idx < 0)
+                                  f(-1 - idx, idxW, distSqr, key.data(), keyW);
+                              else
+                                  f(-1 - idxW, idx, distSqr, keyW, key.data());
+                          }
+                          winKeys.insert(winKeys.end(), key.begin(), key.end());
+                          winV.push_back(v);
+                          winIdx.push_back(idx); });
+        }
+    };
+}
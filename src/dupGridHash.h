@@ -0,0 +1,212 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace DwgSim
+{
+    /**
+     * @brief squared L2 distance, summed in the order of nanoflann::L2_Adaptor
+     * so that radius tests agree with the KD-tree bit for bit
+     */
+    template <class T>
+    inline T DupDistSqr(const T *a, const T *b, size_t n)
+    {
+        T result = 0;
+        size_t d = 0;
+        for (; d + 3 < n; d += 4)
+        {
+            T diff0 = a[d] - b[d];
+            T diff1 = a[d + 1] - b[d + 1];
+            T diff2 = a[d + 2] - b[d + 2];
+            T diff3 = a[d + 3] - b[d + 3];
+            result += diff0 * diff0 + diff1 * diff1 + diff2 * diff2 + diff3 * diff3;
+        }
+        for (; d < n; d++)
+        {
+            T diff0 = a[d] - b[d];
+            result += diff0 * diff0;
+        }
+        return result;
+    }
+
+    //* value type of the rows of a point set: double, or float for the candidate stage
+    template <class TPts>
+    using PtsScalar = std::remove_cv_t<std::remove_pointer_t<decltype(std::declval<const TPts &>()[0].data())>>;
+
+    /**
+     * @brief uniform grid over up to 3 coordinates of a point set, for fixed radius neighbour queries
+     *
+     * The coordinates with the largest spread are snapped to cells a little larger than the radius,
+     * so every neighbour is in the 3^k cells around the query.
+     * Cells go into a flat open addressing table, and the points of one cell are contiguous in one index array.
+     * Building is O(N); a query is expected O(1 + candidates) when the hashed coordinates spread the points.
+     * Candidates are checked with the full distance.
+     *
+     * @tparam TPts vector of Eigen vectors, fixed or dynamic size, or anything with size() and rows with data() and size()
+     */
+    template <class TPts>
+    class PtsGridHash
+    {
+        using Scalar = PtsScalar<TPts>;
+
+        const TPts &pts;
+        size_t dim = 0;
+        Scalar radiusSqr = 0;
+        double cell = 0;
+        int nKey = 0;
+        std::array<size_t, 3> keyDims{0, 0, 0};
+
+        uint64_t mask = 0;
+        std::vector<uint64_t> slotKey;
+        std::vector<int64_t> slotStart; //* -1 for empty slots
+        std::vector<int64_t> slotCount;
+        std::vector<int64_t> sorted; //* point indices grouped by slot
+
+        static constexpr double cellScale = 1.001; //* margin for the rounding of x / cell
+
+        static uint64_t mixKey(const std::array<int64_t, 3> &c)
+        {
+            uint64_t h = uint64_t(c[0]) * 0x9E3779B97F4A7C15ull ^
+                         uint64_t(c[1]) * 0xC2B2AE3D27D4EB4Full ^
+                         uint64_t(c[2]) * 0x165667B19E3779F9ull;
+            h ^= h >> 31;
+            h *= 0xBF58476D1CE4E5B9ull;
+            h ^= h >> 29;
+            return h;
+        }
+
+        bool cellOf(const Scalar *x, std::array<int64_t, 3> &c) const
+        {
+            c = {0, 0, 0};
+            for (int t = 0; t < nKey; t++)
+            {
+                double v = x[keyDims[t]] / cell;
+                if (!(std::abs(v) < 1e15)) // also rejects NaN
+                    return false;
+                c[t] = int64_t(std::floor(v));
+            }
+            return true;
+        }
+
+        int64_t findSlot(uint64_t key) const
+        {
+            for (uint64_t s = key & mask;; s = (s + 1) & mask)
+            {
+                if (slotStart[s] < 0)
+                    return -1;
+                if (slotKey[s] == key)
+                    return int64_t(s);
+            }
+        }
+
+    public:
+        bool ok = false; //* false if the radius or the coordinates do not suit a grid
+
+        PtsGridHash(const TPts &nPts, double radius) : pts(nPts)
+        {
+            if (pts.empty() || !(radius > 0))
+                return;
+            dim = size_t(pts[0].size());
+            radiusSqr = Scalar(radius * radius);
+            cell = radius * cellScale;
+
+            //* hash the coordinates that spread the points most
+            std::vector<double> lo(dim, INFINITY), hi(dim, -INFINITY);
+            for (size_t i = 0; i < pts.size(); i++)
+            {
+                const Scalar *p = pts[i].data();
+                for (size_t d = 0; d < dim; d++)
+                    if (std::isfinite(p[d]))
+                        lo[d] = std::min(lo[d], double(p[d])), hi[d] = std::max(hi[d], double(p[d]));
+            }
+            std::vector<size_t> byExtent(dim);
+            for (size_t d = 0; d < dim; d++)
+                byExtent[d] = d;
+            auto extent = [&](size_t d)
+            { return hi[d] >= lo[d] ? hi[d] - lo[d] : 0.0; };
+            std::stable_sort(byExtent.begin(), byExtent.end(),
+                             [&](size_t a, size_t b)
+                             { return extent(a) > extent(b); });
+            nKey = int(std::min<size_t>(dim, 3));
+            for (int t = 0; t < nKey; t++)
+            {
+                keyDims[t] = byExtent[t];
+                if (std::max(std::abs(lo[keyDims[t]]), std::abs(hi[keyDims[t]])) / cell >= 1e15)
+                    return;
+            }
+
+            size_t cap = 16;
+            while (cap < pts.size() * 2)
+                cap *= 2;
+            mask = cap - 1;
+            slotKey.assign(cap, 0);
+            slotStart.assign(cap, -1);
+            slotCount.assign(cap, 0);
+
+            std::vector<int64_t> pointSlot(pts.size(), -1);
+            std::array<int64_t, 3> c;
+            for (size_t i = 0; i < pts.size(); i++)
+            {
+                if (!cellOf(pts[i].data(), c))
+                    continue;
+                uint64_t key = mixKey(c);
+                uint64_t s = key & mask;
+                while (slotStart[s] >= 0 && slotKey[s] != key)
+                    s = (s + 1) & mask;
+                slotKey[s] = key;
+                slotStart[s] = 0;
+                slotCount[s]++;
+                pointSlot[i] = int64_t(s);
+            }
+            int64_t start = 0;
+            for (size_t s = 0; s < cap; s++)
+                if (slotStart[s] >= 0)
+                    slotStart[s] = start, start += slotCount[s];
+            sorted.resize(start);
+            std::vector<int64_t> cursor = slotStart;
+            for (size_t i = 0; i < pts.size(); i++)
+                if (pointSlot[i] >= 0)
+                    sorted[cursor[pointSlot[i]]++] = int64_t(i);
+            ok = true;
+        }
+
+        /**
+         * @brief calls f(j, distSqr) for every point j with squared distance to q below radius^2
+         */
+        template <class F>
+        void forNeighbors(const Scalar *q, F &&f) const
+        {
+            std::array<int64_t, 3> c0;
+            if (!cellOf(q, c0))
+                return;
+            int nProbe = 1;
+            for (int t = 0; t < nKey; t++)
+                nProbe *= 3;
+            std::array<int64_t, 27> visited;
+            int nVisited = 0;
+            for (int iProbe = 0; iProbe < nProbe; iProbe++)
+            {
+                std::array<int64_t, 3> c = c0;
+                for (int t = 0, r = iProbe; t < nKey; t++, r /= 3)
+                    c[t] += r % 3 - 1;
+                int64_t s = findSlot(mixKey(c));
+                if (s < 0 || std::find(visited.begin(), visited.begin() + nVisited, s) != visited.begin() + nVisited)
+                    continue; // distinct cells sharing a key share the slot
+                visited[nVisited++] = s;
+                for (int64_t k = slotStart[s]; k < slotStart[s] + slotCount[s]; k++)
+                {
+                    int64_t j = sorted[k];
+                    Scalar distSqr = DupDistSqr(q, pts[j].data(), dim);
+                    if (distSqr < radiusSqr)
+                        f(j, distSqr);
+                }
+            }
+        }
+    };
+}
@@ -0,0 +1,498 @@
+#pragma once
+
+#include "dwgsimDefs.h"
+#include "dupGridHash.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define DWGSIM_DUP_KERNELS_AVX2
+#endif
+
+namespace DwgSim
+{
+    /**
+     * @brief batch kernels for the duplicate search keys, over rows of doubles stored back to back
+     *
+     * Each kernel does the arithmetic of the per-row Eigen code it replaces, operation by operation
+     * (sums of squares as (x * x + y * y) + z * z, divisions rather than reciprocals, std::max on NaN),
+     * so the keys are bit for bit the same. With AVX2, four rows go through the SIMD path at a time
+     * and the remainder through the scalar one; the two agree unless the compiler contracts the scalar path into FMAs.
+     * The output may alias the input.
+     *
+     * The Planar variants take lines with z = 0 and arcs with extrusion (0 0 1) and cz = 0, and leave those
+     * constant columns out of the keys; the remaining values are those of the 3-D kernels.
+     */
+    namespace detail
+    {
+        inline double DupMax(double a, double b) { return std::max(a, b); }
+
+        //* (x0 y0 z0 x1 y1 z1) -> (dir base) as linesToInfLine documents it, returns |base|
+        inline double InfLineRow(const double *l, double *o)
+        {
+            double p0x = l[0], p0y = l[1], p0z = l[2];
+            double p1x = l[3], p1y = l[4], p1z = l[5];
+            double LRef = std::max(std::sqrt((p0x * p0x + p0y * p0y) + p0z * p0z),
+                                   std::sqrt((p1x * p1x + p1y * p1y) + p1z * p1z));
+            double dx = p1x - p0x, dy = p1y - p0y, dz = p1z - p0z;
+            double dirNormSqr = (dx * dx + dy * dy) + dz * dz;
+            double bx, by, bz;
+            if (std::sqrt(dirNormSqr) < LRef * 1e-10 || LRef == 0)
+            {
+                dx = 1, dy = 0, dz = 0;
+                dirNormSqr = 1;
+                bx = p0x, by = p0y, bz = p0z;
+            }
+            else
+            {
+                double alphaB = -((p0x * dx + p0y * dy) + p0z * dz) / (dirNormSqr + 1e-300);
+                bx = (1 - alphaB) * p0x + alphaB * p1x;
+                by = (1 - alphaB) * p0y + alphaB * p1y;
+                bz = (1 - alphaB) * p0z + alphaB * p1z;
+            }
+            if (dirNormSqr > 0)
+            {
+                double n = std::sqrt(dirNormSqr);
+                dx /= n, dy /= n, dz /= n;
+            }
+            bool flip;
+            if (std::abs(dz) > 1e-13) //! discard dir diff
+                flip = dz < 0;
+            else if (std::abs(dx) > 1e-13)
+                flip = dx < 0;
+            else
+                flip = dy < 0;
+            if (flip)
+                dx *= -1, dy *= -1, dz *= -1;
+            o[0] = dx, o[1] = dy, o[2] = dz;
+            o[3] = bx, o[4] = by, o[5] = bz;
+            return std::sqrt((bx * bx + by * by) + bz * bz);
+        }
+
+        //* angle range and extrusion of one arc as arcsRegulate documents it, center and radius not yet scaled
+        inline void ArcRow(const double *a, double *o, double eps)
+        {
+            double ex = a[0], ey = a[1], ez = a[2];
+            double t0 = a[7], t1 = a[8];
+            if (t1 < t0)
+                t1 += 2 * pi;
+            if (t0 >= 2 * pi - eps)
+                t1 -= 2 * pi, t0 -= 2 * pi;
+            assert(t1 >= t0);
+            double n = (ex * ex + ey * ey) + ez * ez;
+            if (n > 0)
+            {
+                n = std::sqrt(n);
+                ex /= n, ey /= n, ez /= n;
+            }
+            o[0] = ex, o[1] = ey, o[2] = ez;
+            for (int k = 3; k < 7; k++)
+                o[k] = a[k];
+            o[7] = t0, o[8] = t1;
+        }
+
+        //* InfLineRow of a line with z0 = z1 = 0: (x0 y0 z0 x1 y1 z1) -> (xd yd xb yb), returns |base|
+        inline double InfLineRowPlanar(const double *l, double *o)
+        {
+            double p0x = l[0], p0y = l[1];
+            double p1x = l[3], p1y = l[4];
+            double LRef = std::max(std::sqrt(p0x * p0x + p0y * p0y), std::sqrt(p1x * p1x + p1y * p1y));
+            double dx = p1x - p0x, dy = p1y - p0y;
+            double dirNormSqr = dx * dx + dy * dy;
+            double bx, by;
+            if (std::sqrt(dirNormSqr) < LRef * 1e-10 || LRef == 0)
+            {
+                dx = 1, dy = 0;
+                dirNormSqr = 1;
+                bx = p0x, by = p0y;
+            }
+            else
+            {
+                double alphaB = -(p0x * dx + p0y * dy) / (dirNormSqr + 1e-300);
+                bx = (1 - alphaB) * p0x + alphaB * p1x;
+                by = (1 - alphaB) * p0y + alphaB * p1y;
+            }
+            if (dirNormSqr > 0)
+            {
+                double n = std::sqrt(dirNormSqr);
+                dx /= n, dy /= n;
+            }
+            bool flip = std::abs(dx) > 1e-13 ? dx < 0 : dy < 0;
+            if (flip)
+                dx *= -1, dy *= -1;
+            o[0] = dx, o[1] = dy;
+            o[2] = bx, o[3] = by;
+            return std::sqrt(bx * bx + by * by);
+        }
+
+        //* ArcRow of an arc with extrusion (0 0 1) and cz = 0: -> (cx cy r t0 t1), center and radius not yet scaled
+        inline void ArcRowPlanar(const double *a, double *o, double eps)
+        {
+            double t0 = a[7], t1 = a[8];
+            if (t1 < t0)
+                t1 += 2 * pi;
+            if (t0 >= 2 * pi - eps)
+                t1 -= 2 * pi, t0 -= 2 * pi;
+            assert(t1 >= t0);
+            o[0] = a[3], o[1] = a[4], o[2] = a[6];
+            o[3] = t0, o[4] = t1;
+        }
+
+#ifdef DWGSIM_DUP_KERNELS_AVX2
+        struct Avx2
+        {
+            //* rows r0 .. r0 + 3 of a row-major array, one register per column
+            static __m256d column(const double *rows, int64_t stride, int col)
+            {
+                const __m256i idx = _mm256_set_epi64x(3 * stride, 2 * stride, stride, 0);
+                return _mm256_i64gather_pd(rows + col, idx, 8);
+            }
+
+            static void storeColumns(double *rows, int64_t stride, const __m256d *cols, int nCol)
+            {
+                alignas(32) double buf[4];
+                for (int c = 0; c < nCol; c++)
+                {
+                    _mm256_store_pd(buf, cols[c]);
+                    for (int r = 0; r < 4; r++)
+                        rows[r * stride + c] = buf[r];
+                }
+            }
+
+            static __m256d norm3(__m256d x, __m256d y, __m256d z)
+            {
+                return _mm256_sqrt_pd(sqr3(x, y, z));
+            }
+
+            static __m256d sqr3(__m256d x, __m256d y, __m256d z)
+            {
+                return _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(x, x), _mm256_mul_pd(y, y)), _mm256_mul_pd(z, z));
+            }
+
+            static __m256d norm2(__m256d x, __m256d y)
+            {
+                return _mm256_sqrt_pd(sqr2(x, y));
+            }
+
+            static __m256d sqr2(__m256d x, __m256d y)
+            {
+                return _mm256_add_pd(_mm256_mul_pd(x, x), _mm256_mul_pd(y, y));
+            }
+
+            //* std::max(a, b) lane by lane: b where a < b
+            static __m256d max(__m256d a, __m256d b)
+            {
+                return _mm256_blendv_pd(a, b, _mm256_cmp_pd(a, b, _CMP_LT_OQ));
+            }
+
+            static double hmax(__m256d v, double init)
+            {
+                alignas(32) double buf[4];
+                _mm256_store_pd(buf, v);
+                for (int r = 0; r < 4; r++)
+                    init = DupMax(init, buf[r]);
+                return init;
+            }
+
+            static __m256d abs(__m256d v)
+            {
+                return _mm256_andnot_pd(_mm256_set1_pd(-0.0), v);
+            }
+        };
+
+        inline __m256d InfLineRows4(const double *l, double *o)
+        {
+            using V = Avx2;
+            __m256d p0x = V::column(l, 6, 0), p0y = V::column(l, 6, 1), p0z = V::column(l, 6, 2);
+            __m256d p1x = V::column(l, 6, 3), p1y = V::column(l, 6, 4), p1z = V::column(l, 6, 5);
+            const __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.0);
+
+            __m256d LRef = V::max(V::norm3(p0x, p0y, p0z), V::norm3(p1x, p1y, p1z));
+            __m256d dx = _mm256_sub_pd(p1x, p0x), dy = _mm256_sub_pd(p1y, p0y), dz = _mm256_sub_pd(p1z, p0z);
+            __m256d dirNormSqr = V::sqr3(dx, dy, dz);
+            __m256d degenerate = _mm256_or_pd(
+                _mm256_cmp_pd(_mm256_sqrt_pd(dirNormSqr), _mm256_mul_pd(LRef, _mm256_set1_pd(1e-10)), _CMP_LT_OQ),
+                _mm256_cmp_pd(LRef, zero, _CMP_EQ_OQ));
+
+            __m256d dot = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(p0x, dx), _mm256_mul_pd(p0y, dy)), _mm256_mul_pd(p0z, dz));
+            __m256d alphaB = _mm256_div_pd(_mm256_xor_pd(dot, _mm256_set1_pd(-0.0)),
+                                           _mm256_add_pd(dirNormSqr, _mm256_set1_pd(1e-300)));
+            __m256d beta = _mm256_sub_pd(one, alphaB);
+            __m256d bx = _mm256_add_pd(_mm256_mul_pd(beta, p0x), _mm256_mul_pd(alphaB, p1x));
+            __m256d by = _mm256_add_pd(_mm256_mul_pd(beta, p0y), _mm256_mul_pd(alphaB, p1y));
+            __m256d bz = _mm256_add_pd(_mm256_mul_pd(beta, p0z), _mm256_mul_pd(alphaB, p1z));
+            bx = _mm256_blendv_pd(bx, p0x, degenerate);
+            by = _mm256_blendv_pd(by, p0y, degenerate);
+            bz = _mm256_blendv_pd(bz, p0z, degenerate);
+            dx = _mm256_blendv_pd(dx, one, degenerate);
+            dy = _mm256_blendv_pd(dy, zero, degenerate);
+            dz = _mm256_blendv_pd(dz, zero, degenerate);
+            dirNormSqr = _mm256_blendv_pd(dirNormSqr, one, degenerate);
+
+            __m256d positive = _mm256_cmp_pd(dirNormSqr, zero, _CMP_GT_OQ);
+            __m256d n = _mm256_sqrt_pd(dirNormSqr);
+            dx = _mm256_blendv_pd(dx, _mm256_div_pd(dx, n), positive);
+            dy = _mm256_blendv_pd(dy, _mm256_div_pd(dy, n), positive);
+            dz = _mm256_blendv_pd(dz, _mm256_div_pd(dz, n), positive);
+
+            const __m256d tiny = _mm256_set1_pd(1e-13);
+            __m256d useZ = _mm256_cmp_pd(V::abs(dz), tiny, _CMP_GT_OQ);
+            __m256d useX = _mm256_cmp_pd(V::abs(dx), tiny, _CMP_GT_OQ);
+            __m256d flip = _mm256_blendv_pd(
+                _mm256_blendv_pd(_mm256_cmp_pd(dy, zero, _CMP_LT_OQ), _mm256_cmp_pd(dx, zero, _CMP_LT_OQ), useX),
+                _mm256_cmp_pd(dz, zero, _CMP_LT_OQ), useZ);
+            const __m256d minusOne = _mm256_set1_pd(-1.0);
+            dx = _mm256_blendv_pd(dx, _mm256_mul_pd(dx, minusOne), flip);
+            dy = _mm256_blendv_pd(dy, _mm256_mul_pd(dy, minusOne), flip);
+            dz = _mm256_blendv_pd(dz, _mm256_mul_pd(dz, minusOne), flip);
+
+            __m256d cols[6] = {dx, dy, dz, bx, by, bz};
+            V::storeColumns(o, 6, cols, 6);
+            return V::norm3(bx, by, bz);
+        }
+
+        inline void ArcRows4(const double *a, double *o, double eps, __m256d &maxPos, __m256d &maxR)
+        {
+            using V = Avx2;
+            const __m256d zero = _mm256_setzero_pd(), twoPi = _mm256_set1_pd(2 * pi);
+            __m256d ex = V::column(a, 9, 0), ey = V::column(a, 9, 1), ez = V::column(a, 9, 2);
+            __m256d t0 = V::column(a, 9, 7), t1 = V::column(a, 9, 8);
+            t1 = _mm256_blendv_pd(t1, _mm256_add_pd(t1, twoPi), _mm256_cmp_pd(t1, t0, _CMP_LT_OQ));
+            __m256d wrap = _mm256_cmp_pd(t0, _mm256_set1_pd(2 * pi - eps), _CMP_GE_OQ);
+            t1 = _mm256_blendv_pd(t1, _mm256_sub_pd(t1, twoPi), wrap);
+            t0 = _mm256_blendv_pd(t0, _mm256_sub_pd(t0, twoPi), wrap);
+            assert(_mm256_movemask_pd(_mm256_cmp_pd(t1, t0, _CMP_GE_OQ)) == 0xF);
+
+            __m256d n = V::sqr3(ex, ey, ez);
+            __m256d positive = _mm256_cmp_pd(n, zero, _CMP_GT_OQ);
+            n = _mm256_sqrt_pd(n);
+            ex = _mm256_blendv_pd(ex, _mm256_div_pd(ex, n), positive);
+            ey = _mm256_blendv_pd(ey, _mm256_div_pd(ey, n), positive);
+            ez = _mm256_blendv_pd(ez, _mm256_div_pd(ez, n), positive);
+
+            __m256d cx = V::column(a, 9, 3), cy = V::column(a, 9, 4), cz = V::column(a, 9, 5), r = V::column(a, 9, 6);
+            maxPos = V::max(maxPos, V::norm3(cx, cy, cz));
+            maxR = V::max(maxR, r);
+            __m256d cols[9] = {ex, ey, ez, cx, cy, cz, r, t0, t1};
+            V::storeColumns(o, 9, cols, 9);
+        }
+
+        inline __m256d InfLineRowsPlanar4(const double *l, double *o)
+        {
+            using V = Avx2;
+            __m256d p0x = V::column(l, 6, 0), p0y = V::column(l, 6, 1);
+            __m256d p1x = V::column(l, 6, 3), p1y = V::column(l, 6, 4);
+            const __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.0);
+
+            __m256d LRef = V::max(V::norm2(p0x, p0y), V::norm2(p1x, p1y));
+            __m256d dx = _mm256_sub_pd(p1x, p0x), dy = _mm256_sub_pd(p1y, p0y);
+            __m256d dirNormSqr = V::sqr2(dx, dy);
+            __m256d degenerate = _mm256_or_pd(
+                _mm256_cmp_pd(_mm256_sqrt_pd(dirNormSqr), _mm256_mul_pd(LRef, _mm256_set1_pd(1e-10)), _CMP_LT_OQ),
+                _mm256_cmp_pd(LRef, zero, _CMP_EQ_OQ));
+
+            __m256d dot = _mm256_add_pd(_mm256_mul_pd(p0x, dx), _mm256_mul_pd(p0y, dy));
+            __m256d alphaB = _mm256_div_pd(_mm256_xor_pd(dot, _mm256_set1_pd(-0.0)),
+                                           _mm256_add_pd(dirNormSqr, _mm256_set1_pd(1e-300)));
+            __m256d beta = _mm256_sub_pd(one, alphaB);
+            __m256d bx = _mm256_add_pd(_mm256_mul_pd(beta, p0x), _mm256_mul_pd(alphaB, p1x));
+            __m256d by = _mm256_add_pd(_mm256_mul_pd(beta, p0y), _mm256_mul_pd(alphaB, p1y));
+            bx = _mm256_blendv_pd(bx, p0x, degenerate);
+            by = _mm256_blendv_pd(by, p0y, degenerate);
+            dx = _mm256_blendv_pd(dx, one, degenerate);
+            dy = _mm256_blendv_pd(dy, zero, degenerate);
+            dirNormSqr = _mm256_blendv_pd(dirNormSqr, one, degenerate);
+
+            __m256d positive = _mm256_cmp_pd(dirNormSqr, zero, _CMP_GT_OQ);
+            __m256d n = _mm256_sqrt_pd(dirNormSqr);
+            dx = _mm256_blendv_pd(dx, _mm256_div_pd(dx, n), positive);
+            dy = _mm256_blendv_pd(dy, _mm256_div_pd(dy, n), positive);
+
+            __m256d useX = _mm256_cmp_pd(V::abs(dx), _mm256_set1_pd(1e-13), _CMP_GT_OQ);
+            __m256d flip = _mm256_blendv_pd(_mm256_cmp_pd(dy, zero, _CMP_LT_OQ), _mm256_cmp_pd(dx, zero, _CMP_LT_OQ), useX);
+            const __m256d minusOne = _mm256_set1_pd(-1.0);
+            dx = _mm256_blendv_pd(dx, _mm256_mul_pd(dx, minusOne), flip);
+            dy = _mm256_blendv_pd(dy, _mm256_mul_pd(dy, minusOne), flip);
+
+            __m256d cols[4] = {dx, dy, bx, by};
+            V::storeColumns(o, 4, cols, 4);
+            return V::norm2(bx, by);
+        }
+
+        inline void ArcRowsPlanar4(const double *a, double *o, double eps, __m256d &maxPos, __m256d &maxR)
+        {
+            using V = Avx2;
+            const __m256d twoPi = _mm256_set1_pd(2 * pi);
+            __m256d t0 = V::column(a, 9, 7), t1 = V::column(a, 9, 8);
+            t1 = _mm256_blendv_pd(t1, _mm256_add_pd(t1, twoPi), _mm256_cmp_pd(t1, t0, _CMP_LT_OQ));
+            __m256d wrap = _mm256_cmp_pd(t0, _mm256_set1_pd(2 * pi - eps), _CMP_GE_OQ);
+            t1 = _mm256_blendv_pd(t1, _mm256_sub_pd(t1, twoPi), wrap);
+            t0 = _mm256_blendv_pd(t0, _mm256_sub_pd(t0, twoPi), wrap);
+            assert(_mm256_movemask_pd(_mm256_cmp_pd(t1, t0, _CMP_GE_OQ)) == 0xF);
+
+            __m256d cx = V::column(a, 9, 3), cy = V::column(a, 9, 4), r = V::column(a, 9, 6);
+            maxPos = V::max(maxPos, V::norm2(cx, cy));
+            maxR = V::max(maxR, r);
+            __m256d cols[5] = {cx, cy, r, t0, t1};
+            V::storeColumns(o, 5, cols, 5);
+        }
+
+        //* DupDistSqr from q to the points p[0 .. 3], one point per lane
+        inline void DupDistSqr4(const double *q, const double *const *p, int64_t n, double *out)
+        {
+            auto diff = [&](int64_t d)
+            { return _mm256_sub_pd(_mm256_set1_pd(q[d]), _mm256_set_pd(p[3][d], p[2][d], p[1][d], p[0][d])); };
+            __m256d result = _mm256_setzero_pd();
+            int64_t d = 0;
+            for (; d + 3 < n; d += 4)
+            {
+                __m256d diff0 = diff(d), diff1 = diff(d + 1), diff2 = diff(d + 2), diff3 = diff(d + 3);
+                __m256d sum = _mm256_add_pd(_mm256_mul_pd(diff0, diff0), _mm256_mul_pd(diff1, diff1));
+                sum = _mm256_add_pd(sum, _mm256_mul_pd(diff2, diff2));
+                sum = _mm256_add_pd(sum, _mm256_mul_pd(diff3, diff3));
+                result = _mm256_add_pd(result, sum);
+            }
+            for (; d < n; d++)
+            {
+                __m256d diff0 = diff(d);
+                result = _mm256_add_pd(result, _mm256_mul_pd(diff0, diff0));
+            }
+            _mm256_storeu_pd(out, result);
+        }
+#endif
+
+        /**
+         * @brief linesToInfLine over n rows of 6, into rows of 2 * nd: InfLineRow for nd = 3,
+         * InfLineRowPlanar for nd = 2
+         * @return the largest base point norm, at least lowest
+         */
+        template <int nd>
+        double InfLineRows(const double *lines, double *inf, int64_t n, double lowest)
+        {
+            static_assert(nd == 2 || nd == 3, "lines are 2-D or 3-D");
+            constexpr int m = 2 * nd;
+            int64_t i = 0;
+#ifdef DWGSIM_DUP_KERNELS_AVX2
+            __m256d maxV = _mm256_set1_pd(lowest);
+            for (; i + 4 <= n; i += 4)
+                if constexpr (nd == 3)
+                    maxV = Avx2::max(maxV, InfLineRows4(lines + i * 6, inf + i * m));
+                else
+                    maxV = Avx2::max(maxV, InfLineRowsPlanar4(lines + i * 6, inf + i * m));
+            lowest = Avx2::hmax(maxV, lowest);
+#endif
+            for (; i < n; i++)
+                if constexpr (nd == 3)
+                    lowest = DupMax(lowest, InfLineRow(lines + i * 6, inf + i * m));
+                else
+                    lowest = DupMax(lowest, InfLineRowPlanar(lines + i * 6, inf + i * m));
+            return lowest;
+        }
+
+        /**
+         * @brief the largest norm of the 3 values at offset in each of n rows of stride, at least lowest
+         */
+        inline double MaxNorm3Rows(const double *rows, int64_t n, int64_t stride, int offset, double lowest)
+        {
+            int64_t i = 0;
+#ifdef DWGSIM_DUP_KERNELS_AVX2
+            __m256d maxV = _mm256_set1_pd(lowest);
+            for (; i + 4 <= n; i += 4)
+            {
+                const double *r = rows + i * stride + offset;
+                maxV = Avx2::max(maxV, Avx2::norm3(Avx2::column(r, stride, 0), Avx2::column(r, stride, 1), Avx2::column(r, stride, 2)));
+            }
+            lowest = Avx2::hmax(maxV, lowest);
+#endif
+            for (; i < n; i++)
+            {
+                const double *r = rows + i * stride + offset;
+                lowest = DupMax(lowest, std::sqrt((r[0] * r[0] + r[1] * r[1]) + r[2] * r[2]));
+            }
+            return lowest;
+        }
+
+        /**
+         * @brief out = in, except the nDiv values at offset of each row divided by div;
+         * a plain loop, a gather and scatter of 3 values per row would cost more than the divisions
+         */
+        inline void DivideRows(const double *in, double *out, int64_t n, int64_t stride, int offset, int nDiv, double div)
+        {
+            if (in != out && n > 0)
+                std::copy(in, in + n * stride, out);
+            for (int64_t i = 0; i < n; i++)
+            {
+                double *r = out + i * stride + offset;
+                for (int k = 0; k < nDiv; k++)
+                    r[k] /= div;
+            }
+        }
+
+        /**
+         * @brief f(j, DupDistSqr(q, pts[j], dim)) for the nPts points pts[j], in order of j;
+         * float rows take the scalar path
+         */
+        template <class T, class F>
+        void DupDistSqrRows(const T *q, const T *const *pts, int64_t nPts, int64_t dim, F &&f)
+        {
+            int64_t j = 0;
+#ifdef DWGSIM_DUP_KERNELS_AVX2
+            if constexpr (std::is_same_v<T, double>)
+            {
+                double buf[4];
+                for (; j + 4 <= nPts; j += 4)
+                {
+                    DupDistSqr4(q, pts + j, dim, buf);
+                    for (int r = 0; r < 4; r++)
+                        f(j + r, buf[r]);
+                }
+            }
+#endif
+            for (; j < nPts; j++)
+                f(j, DupDistSqr(q, pts[j], size_t(dim)));
+        }
+
+        /**
+         * @brief first pass of arcsRegulate over n rows of 9: angle range and unit extrusion,
+         * maxPos and maxR updated with the center norms and radii;
+         * for nd = 2 the rows out are the 5 values of ArcRowPlanar
+         */
+        template <int nd>
+        void ArcRows(const double *arcs, double *reg, int64_t n, double eps, double &maxPos, double &maxR)
+        {
+            static_assert(nd == 2 || nd == 3, "arcs are 2-D or 3-D");
+            constexpr int m = nd == 3 ? 9 : 5;
+            int64_t i = 0;
+#ifdef DWGSIM_DUP_KERNELS_AVX2
+            __m256d maxPosV = _mm256_set1_pd(maxPos), maxRV = _mm256_set1_pd(maxR);
+            for (; i + 4 <= n; i += 4)
+                if constexpr (nd == 3)
+                    ArcRows4(arcs + i * 9, reg + i * m, eps, maxPosV, maxRV);
+                else
+                    ArcRowsPlanar4(arcs + i * 9, reg + i * m, eps, maxPosV, maxRV);
+            maxPos = Avx2::hmax(maxPosV, maxPos);
+            maxR = Avx2::hmax(maxRV, maxR);
+#endif
+            for (; i < n; i++)
+            {
+                const double *a = arcs + i * 9;
+                if constexpr (nd == 3)
+                {
+                    ArcRow(a, reg + i * m, eps);
+                    maxPos = DupMax(maxPos, std::sqrt((a[3] * a[3] + a[4] * a[4]) + a[5] * a[5]));
+                }
+                else
+                {
+                    ArcRowPlanar(a, reg + i * m, eps);
+                    maxPos = DupMax(maxPos, std::sqrt(a[3] * a[3] + a[4] * a[4]));
+                }
+                maxR = DupMax(maxR, a[6]);
+            }
+        }
+    }
+}
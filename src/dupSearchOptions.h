@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace DwgSim
+{
+    /**
+     * @brief how getPtsDuplications / getPtsDuplicationsInPts find the points within eps
+     */
+    enum class DupSearchBackend
+    {
+        KDTree,   //* nanoflann radius search
+        GridHash, //* PtsGridHash, expected O(N), falls back to KDTree where a grid does not fit
+    };
+
+    /**
+     * @brief settings of the duplicate searches, passed down to every one of them
+     */
+    struct DupSearchOptions
+    {
+        DupSearchBackend backend = DupSearchBackend::KDTree;
+
+        //* point sets of at most this many points are searched pair by pair, without building an index
+        int64_t bruteForceMax = 32;
+
+        //* searches over more points than this are split into spatial tiles of at most this many queries, 0 for no tiles
+        int64_t tileMax = 65536;
+
+        //* bytes the line and arc searches may hold in chunks and merge buffers of an ExternalDupSweep, 0 to search in memory
+        size_t externalBudget = 0;
+
+        //* indexed searches first find candidates among float copies of the keys, then check them in double
+        bool floatCandidates = false;
+    };
+
+    /**
+     * @brief how many duplicate searches took each path, KD-tree includes the grid hash fallbacks;
+     * a tiled search counts once as tiled and once per tile for the path the tile took,
+     * a search with float candidates counts for that and for the path of its float search
+     */
+    struct DupSearchCounters
+    {
+        int64_t bruteForce{0};
+        int64_t kdTree{0};
+        int64_t gridHash{0};
+        int64_t tiled{0};
+        int64_t floatCandidates{0};
+
+        DupSearchCounters &operator+=(const DupSearchCounters &o)
+        {
+            bruteForce += o.bruteForce;
+            kdTree += o.kdTree;
+            gridHash += o.gridHash;
+            tiled += o.tiled;
+            floatCandidates += o.floatCandidates;
+            return *this;
+        }
+    };
+}
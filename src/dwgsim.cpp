@@ -2,6 +2,7 @@
 #include "dwgsimDefs.h"
 #include "dwgsimReader.h"
 #include "splineUtil.h"
+#include "lineDetect.h"
 #include <fstream>
 
 int main(int argc, char *argv[])
@@ -10,6 +11,11 @@ int main(int argc, char *argv[])
 
     int dupWarn = 0;
     int dupDel = 0;
+    int nThreads = 1;
+    int streamBatch = 65536;
+    int dupBruteMax = 32;
+    int dupTile = 65536;
+    int dupExternal = 0;
 
     argparse::ArgumentParser argparser("dwgsim", DNDS_MACRO_TO_STRING(DWGSIM_CURRENT_COMMIT_HASH));
     argparser.add_argument("input").help("path to the dwg input");
@@ -17,7 +23,18 @@ int main(int argc, char *argv[])
     argparser.add_argument("-O").default_value("JSON").help("output format");
     argparser.add_argument("--dupWarn").default_value(0).store_into(dupWarn);
     argparser.add_argument("--dupDel").default_value(0).store_into(dupDel);
+    argparser.add_argument("--dupOnline").flag().help("drop exact duplicate lines, arcs, circles and polylines while reading, as --dupDel 1 would; "
+                                                            "--dupWarn then only gives their number, not the entities");
+    argparser.add_argument("--dupBackend").default_value("kdtree").choices("kdtree", "grid").help("duplicate search: KD-tree radius search or grid hash");
+    argparser.add_argument("--dupBruteMax").default_value(32).store_into(dupBruteMax).help("duplicate search: sets up to this size are compared pair by pair");
+    argparser.add_argument("--dupTile").default_value(65536).store_into(dupTile).help("duplicate search: split larger sets into spatial tiles of this many entities, 0 for none");
+    argparser.add_argument("--dupExternal").default_value(0).store_into(dupExternal).help("duplicate search: sort line and arc keys on disk within this many MiB, 0 to search in memory");
+    argparser.add_argument("--dupFloat").flag().help("duplicate search: find candidates among float copies of the keys, then check them in double");
     argparser.add_argument("--clear").flag().help("clear stdout");
+    argparser.add_argument("--threads").default_value(1).store_into(nThreads).help("worker threads, 0 for all hardware threads");
+    argparser.add_argument("--splineCache").help("file of spline fits, loaded if present and saved after the run");
+    argparser.add_argument("--stream").flag().help("JSON: process and write a batch of blocks at a time, \"layers\" comes last");
+    argparser.add_argument("--streamBatch").default_value(65536).store_into(streamBatch).help("entities per batch of blocks in DXF and --stream output, 1 for one block at a time");
 
     try
     {
@@ -39,40 +56,88 @@ int main(int argc, char *argv[])
             std::cout << "writing to stdout" << std::endl;
     }
     std::string filename_in = argparser.get("input");
+    DwgSim::DupSearchOptions dupOptions;
+    if (argparser.get("--dupBackend") == "grid")
+        dupOptions.backend = DwgSim::DupSearchBackend::GridHash;
+    dupOptions.bruteForceMax = dupBruteMax;
+    dupOptions.tileMax = dupTile;
+    dupOptions.externalBudget = size_t(std::max(dupExternal, 0)) << 20;
+    dupOptions.floatCandidates = argparser["--dupFloat"] == true;
 
     try
     {
         DwgSim::Reader reader(filename_in);
+        reader.SetThreads(nThreads);
+        reader.SetStreamBatch(streamBatch);
+        reader.SetDupSearchOptions(dupOptions);
+        reader.SetOnlineDedup(argparser["--dupOnline"] == true);
+        if (argparser.is_used("--splineCache"))
+            reader.LoadSplineFitCache(argparser.get("--splineCache"));
         // reader.DebugPrint();
         // reader.DebugPrint1();
 
-        reader.CollectModelSpaceEntities();
-        reader.CollectBlockSpaceEntities();
-        reader.ReformSplines();
-        reader.CleanLineEntityDuplication(1e-8, 1e-5, dupWarn, dupDel);
+        auto processWindows = [&](const DwgSim::WindowBatch &windows)
+        {
+            std::vector<DwgSim::EntityList *> lists;
+            for (auto &w : windows)
+                lists.push_back(w.first);
+            reader.ReformSplines(lists);
+            reader.CleanLineEntityDuplication(windows, 1e-8, 1e-5, dupWarn, dupDel);
+        };
 
-        if (argparser.get("-O") == "JSON")
+        auto outputTo = [&](auto &&print)
         {
             if (argparser.is_used("-o"))
             {
                 auto o = std::ofstream(argparser.get("-o"));
-                reader.PrintDoc(o, 2);
+                print(o);
             }
             else
-                reader.PrintDoc(std::cout, 2);
+                print(std::cout);
+        };
+
+        if (argparser.get("-O") != "JSON" && argparser.get("-O") != "DXF")
+            throw std::runtime_error("no such -O format choice");
+
+        if (argparser.get("-O") == "DXF") // DXF is always written block by block
+        {
+            outputTo([&](std::ostream &o)
+                     { reader.PrintDocDXFStream(o, processWindows); });
         }
-        else if (argparser.get("-O") == "DXF")
+        else if (argparser["--stream"] == true)
         {
-            if (argparser.is_used("-o"))
-            {
-                auto o = std::ofstream(argparser.get("-o"));
-                reader.PrintDocDXF(o);
-            }
-            else
-                reader.PrintDocDXF(std::cout);
+            outputTo([&](std::ostream &o)
+                     { reader.PrintDocStream(o, 2, processWindows); });
         }
         else
-            throw std::runtime_error("no such -O format choice");
+        {
+            reader.CollectModelSpaceEntities();
+            reader.CollectBlockSpaceEntities();
+            reader.ReformSplines();
+            reader.CleanLineEntityDuplication(1e-8, 1e-5, dupWarn, dupDel);
+
+            outputTo([&](std::ostream &o)
+                     { reader.PrintDoc(o, 2); });
+        }
+
+        if (argparser.is_used("--splineCache"))
+            reader.SaveSplineFitCache(argparser.get("--splineCache"));
+        if (argparser["--clear"] == false && argparser["--dupOnline"] == true)
+            std::cout << "exact duplicates dropped while reading: " << reader.GetOnlineDedupRejected() << std::endl;
+        if (dupWarn >= 1 && argparser["--dupOnline"] == true && reader.GetOnlineDedupRejected())
+            std::cerr << "Exact duplicates dropped while reading, not listed above: " << reader.GetOnlineDedupRejected() << "\n";
+        if (argparser["--clear"] == false)
+        {
+            auto &counters = reader.GetDupSearchCounters();
+            std::cout << "duplicate searches: " << counters.bruteForce << " brute force, "
+                      << counters.kdTree << " KD-tree, "
+                      << counters.gridHash << " grid hash, "
+                      << counters.tiled << " split into tiles, "
+                      << counters.floatCandidates << " with float candidates" << std::endl;
+        }
+        if (argparser["--clear"] == false)
+            std::cout << "spline fit cache: " << reader.GetSplineFitCache().nHit << " hits, "
+                      << reader.GetSplineFitCache().nMiss << " misses" << std::endl;
     }
     catch (const std::exception &err)
     {
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <exception>
 
 #include <dwg.h>
@@ -45,6 +47,23 @@ namespace DwgSim
             ret = 2 * pi - ret;
         return ret;
     }
+
+    /**
+     * @brief FNV-1a over the bits of n doubles, with a shift to mix the high bits down;
+     * the hash of the bit-for-bit keys of SplineFitCache and OnlineDupFilter
+     */
+    inline uint64_t HashDoubleBits(const double *v, size_t n)
+    {
+        uint64_t h = 0xcbf29ce484222325ull;
+        for (size_t i = 0; i < n; i++)
+        {
+            uint64_t bits;
+            std::memcpy(&bits, v + i, sizeof(bits));
+            h = (h ^ bits) * 0x100000001b3ull;
+            h ^= h >> 29;
+        }
+        return h;
+    }
 }
 
 #pragma once
@@ -1,6 +1,15 @@
 #include "dwgsimReader.h"
 #include "splineUtil.h"
 #include "lineDetect.h"
+#include "parallelUtil.h"
+
+#include <sstream>
+
+#include <rapidjson/rapidjson.h>
+#include <rapidjson/ostreamwrapper.h>
+#include <rapidjson/writer.h>
+#include <rapidjson/prettywriter.h>
+
 
 namespace DwgSim
 {
@@ -28,975 +37,1557 @@ namespace DwgSim
             process_BLOCK_HEADER(block_control->entries[i], BlockSpace);
     }
 
-    void Reader::TraverseEntitiesInSpace(
-        std::function<void(Dwg_Object *, Dwg_Object *, const ObjectName &, Dwg_Object_Type)> process_object,
-        EntitySpaceType space)
+    void Reader::StreamModelSpace(const std::function<void(EntityList &)> &consume)
+    {
+        EntityList list;
+        OnlineDupFilter dupFilter;
+        TraverseEntitiesInBlockHeader(
+            dwg_model_space_ref(&dwg),
+            [&](Dwg_Object *blk_obj, Dwg_Object *obj, EntityType type)
+            {
+                fillEntity(obj, type, list, dupOnline ? &dupFilter : nullptr);
+            });
+        consume(list);
+    }
+
+    void Reader::StreamBlocks(const std::function<void(BlockRecord &)> &consume)
     {
-        auto process_object_type = [&](Dwg_Object *blk_obj, Dwg_Object *obj, EntitySpaceType space)
+        //* entries listing the same BLOCK_HEADER are merged into one block, as findOrAddBlock does,
+        //* at the position of the first one
+        Dwg_Object_BLOCK_CONTROL *block_control = dwg_block_control(&dwg);
+        std::unordered_map<uint64_t, size_t> groupOf;
+        std::vector<std::vector<int>> groups;
+        for (int i = 0; i < block_control->num_entries; i++)
         {
-            if (!obj || !obj->parent)
-                throw std::runtime_error("obj not valid");
-            uint32_t type = obj->fixedtype;
-            if (objNameMapping.map.count((Dwg_Object_Type)type))
+            auto ref = block_control->entries[i];
+            if (!ref || !ref->obj)
+                continue;
+            auto [it, inserted] = groupOf.try_emplace(ref->obj->handle.value, groups.size());
+            if (inserted)
+                groups.emplace_back();
+            groups[it->second].push_back(i);
+        }
+
+        for (auto &group : groups)
+        {
+            BlockRecord block;
+            bool hasEntity = false;
+            for (int i : group)
             {
-                process_object(blk_obj, obj, objNameMapping.map.at((Dwg_Object_Type)type), (Dwg_Object_Type)type);
+                OnlineDupFilter dupFilter;
+                TraverseEntitiesInBlockHeader(
+                    block_control->entries[i],
+                    [&](Dwg_Object *blk_obj, Dwg_Object *obj, EntityType type)
+                    {
+                        if (!hasEntity)
+                            fillBlockRecord(blk_obj, block);
+                        hasEntity = true;
+                        fillEntity(obj, type, block.entities, dupOnline ? &dupFilter : nullptr);
+                    });
             }
-            else
+            if (hasEntity) // blocks without entities are not output, as in CollectBlockSpaceEntities
+                consume(block);
+        }
+    }
+
+    void Reader::StreamBlockBatches(const std::function<void(std::vector<BlockRecord> &)> &consume)
+    {
+        std::vector<BlockRecord> batch;
+        int64_t nEntity = 0;
+        StreamBlocks(
+            [&](BlockRecord &block)
             {
-                if (type >= DWG_TYPE_ACDSRECORD)
-                    return;
-                throw unhandled_class_error("DWG Class: " + std::to_string(type));
-            }
-        };
-        auto process_BLOCK_HEADER = [&](Dwg_Object_Ref *ref, EntitySpaceType space)
+                nEntity += block.entities.size();
+                batch.push_back(std::move(block));
+                if (nEntity >= streamBatchEntities)
+                {
+                    consume(batch);
+                    batch.clear();
+                    nEntity = 0;
+                }
+            });
+        if (!batch.empty())
+            consume(batch);
+    }
+
+    //* the entity lists of a batch of blocks, with their names
+    static WindowBatch windowsOf(std::vector<BlockRecord> &batch)
+    {
+        WindowBatch ret;
+        for (auto &block : batch)
+            ret.emplace_back(&block.entities, block.name);
+        return ret;
+    }
+
+    void Reader::TraverseEntityLists(std::function<void(EntityList &, const std::string &, EntitySpaceType)> processList)
+    {
+        processList(modelSpace, "modelSpace", ModelSpace);
+        for (auto &block : blocks)
+            processList(block.entities, block.name, BlockSpace);
+    }
+
+    /**
+     * @brief result of refitting one spline, computed independently and written back in entity order
+     */
+    struct SplineReform
+    {
+        SplineRecord spline;
+        bool newCtrl = false; //* fit points or periodic control points converted to a clamped B-Spline
+        VecX b_knots;
+        Mat3X b_pts;
+        VecX b_weights; //* empty for the 0 weights of a non-rational B-Spline
+    };
+
+    /**
+     * @brief periodic control point splines to their exact clamped form, any degree
+     * @return false if the spline is not periodic
+     */
+    static bool reformPeriodicSpline(const EntityList &list, SplineReform &r)
+    {
+        auto &spline = r.spline;
+        if (!(spline.scenario == 1 && spline.periodic && spline.nKnot == spline.nCtrl + 1))
+            return false;
+        MatX ctrl_pts(4, spline.nCtrl);
+        for (int64_t i = 0; i < spline.nCtrl; i++)
+            ctrl_pts.col(i) = Eigen::Map<const Eigen::Vector4d>(list.splineCtrl.data() + (spline.ctrlStart + i) * 4);
+        auto knots = BufferGetVecX(list.splineKnots.data() + spline.knotStart, spline.nKnot);
+        bool rational = ctrl_pts.row(3).squaredNorm();
+        if (rational) // homogeneous
+            ctrl_pts.topRows(3).array().rowwise() *= ctrl_pts.row(3).array();
+
+        MatX b_pts;
+        PeriodicSplineToOpenSpline(spline.degree, knots, ctrl_pts, r.b_knots, b_pts);
+        if (rational)
+            b_pts.topRows(3).array().rowwise() /= b_pts.row(3).array();
+        r.b_pts = b_pts.topRows(3);
+        r.b_weights = b_pts.row(3).transpose(); // non-rational: the stored weights, all the same
+        r.newCtrl = true;
+
+        spline.periodic = 0;
+        spline.flag = spline.flag & ~0x03; // not closed, not periodic
+        return true;
+    }
+
+    /**
+     * @brief gathers what the fit of a fit point spline depends on
+     * @return false if the spline has control points already
+     */
+    static bool splineFitInput(const EntityList &list, const SplineRecord &spline, SplineFitInput &in)
+    {
+        if (spline.nFit == 0)
+            return false;
+        if (spline.nCtrl != 0)
+            return false;
+        if (spline.degree != 3)
+            throw std::runtime_error("spline should be degree 3 using fit_pts");
+        if (spline.nFit < 2)
+            throw std::runtime_error("spline should have at least 2 fit pts");
+
+        auto &fit_pts = in.fit_pts;
+        fit_pts = BufferGetMat3X(list.splineFit.data() + spline.fitStart * 3, spline.nFit);
+        in.origin = fit_pts(Eigen::all, 0);
+        fit_pts.colwise() -= in.origin;
+        auto &knots = in.knots;
+        knots = BufferGetVecX(list.splineKnots.data() + spline.knotStart, spline.nKnot);
+        if (knots.size() == 0) // knots from the parametrization, they are part of the cache key
         {
-            if (!ref || !ref->obj)
-                return;
-            Dwg_Object *obj = get_first_owned_entity(ref->obj);
-            while (obj)
+            //* knotparam 1: square root of chord length, 2: uniform, otherwise chord length
+            knots.resize(fit_pts.cols());
+            knots[0] = 0;
+            for (int64_t i = 1; i < knots.size(); i++)
             {
-                process_object_type(ref->obj, obj, space);
-                obj = get_next_owned_entity(ref->obj, obj);
+                double chord = (fit_pts(Eigen::all, i) - fit_pts(Eigen::all, i - 1)).norm();
+                knots[i] = knots[i - 1] + (spline.knotparam == 1 ? std::sqrt(chord) : spline.knotparam == 2 ? 1.0 : chord);
             }
-        };
-
-        if (space == ModelSpace)
-            process_BLOCK_HEADER(dwg_model_space_ref(&dwg), ModelSpace);
-        if (space == PaperSpace)
-            process_BLOCK_HEADER(dwg_paper_space_ref(&dwg), PaperSpace);
-        if (space == BlockSpace)
+        }
+        else if (knots.size() == fit_pts.cols())
         {
-            Dwg_Object_BLOCK_CONTROL *block_control = dwg_block_control(&dwg);
-            for (int i = 0; i < block_control->num_entries; i++)
-                process_BLOCK_HEADER(block_control->entries[i], BlockSpace);
+            // do nothing
         }
+        else if (knots.size() == fit_pts.cols() + 6) // guessed situation
+        {
+            VecX knotsA = knots(Eigen::seq(3, 3 + fit_pts.cols() - 1));
+            knots = knotsA;
+        }
+
+        in.start_tan = Vec3{spline.beg_tan_vec[0], spline.beg_tan_vec[1], spline.beg_tan_vec[2]};
+        in.end_tan = Vec3{spline.end_tan_vec[0], spline.end_tan_vec[1], spline.end_tan_vec[2]};
+        in.closed = spline.splineflags & 0x04;
+        return true;
+    }
+
+    static void fitSpline(const SplineFitInput &in, SplineFitResult &res)
+    {
+        DwgSim::CubicSplineToBSpline(
+            in.knots, in.fit_pts,
+            in.start_tan, in.end_tan,
+            res.b_knots, res.b_pts, in.closed);
     }
 
-    void Reader::TraverseDocEntities(std::function<void(rapidjson::Value &, EntitySpaceType)> processEntityJSON)
+    static void writeBackSplineReform(EntityList &list, SplineRecord &spline, SplineReform &r)
     {
-        if (doc.HasMember("modelSpaceEntities"))
+        spline = r.spline;
+        if (r.newCtrl)
         {
-            for (int64_t i = 0; i < doc["modelSpaceEntities"].Size(); i++)
-                processEntityJSON(doc["modelSpaceEntities"][i], ModelSpace);
+            spline.knotStart = int64_t(list.splineKnots.size());
+            spline.nKnot = r.b_knots.size();
+            list.splineKnots.insert(list.splineKnots.end(), r.b_knots.data(), r.b_knots.data() + r.b_knots.size());
+            spline.ctrlStart = int64_t(list.splineCtrl.size() / 4);
+            spline.nCtrl = r.b_pts.cols();
+            for (int64_t i = 0; i < r.b_pts.cols(); i++)
+                list.splineCtrl.insert(list.splineCtrl.end(),
+                                       {r.b_pts(0, i), r.b_pts(1, i), r.b_pts(2, i),
+                                        r.b_weights.size() ? r.b_weights[i] : 0.0}); // 0 weights for non-rational B-Spline
         }
-        if (doc.HasMember("blocks"))
-            for (auto it = doc["blocks"].MemberBegin(); it != doc["blocks"].MemberEnd(); ++it)
-                if (it->value.HasMember("entities"))
-                    for (int64_t i = 0; i < it->value["entities"].Size(); i++)
-                        processEntityJSON(it->value["entities"][i], BlockSpace);
     }
 
     void Reader::ReformSplines()
     {
-        TraverseDocEntities(
-            [&](rapidjson::Value &entJson, EntitySpaceType space)
+        std::vector<EntityList *> lists;
+        TraverseEntityLists(
+            [&](EntityList &list, const std::string &blkName, EntitySpaceType space)
             {
-                if (entJson["type"].GetString() != std::string("SPLINE"))
-                    return;
-                if (entJson["scenario"].GetInt() == 1)
-                {
-                    if (entJson["periodic"].GetInt() && entJson["degree"].GetInt() == 3)
-                    { //! not considering degrees other than 3
-                        auto ctrl_pts = RapidJsonGetMat3X(entJson["ctrl_pts"]);
-                        auto knots = RapidJsonGetVecX(entJson["knots"]);
-                        auto weights = RapidJsonGetVecX4th(entJson["ctrl_pts"]);
-                        assert(ctrl_pts.cols() == knots.size() - 1);
-                        MatX bases, dBases, ddBases;
-                        BSplineBasesPeriodic(
-                            3,
-                            knots, knots,
-                            bases, dBases, ddBases);
-                        auto fit_pts = ctrl_pts * bases;
-                        if (weights.squaredNorm()) // rational
-                        {
-                            bases = bases.array().colwise() * weights.array();
-                            bases = bases.array().rowwise() / bases.array().colwise().sum();
-                        }
-
-                        entJson["fit_pts"] = Mat3XGetRapidJson(fit_pts, doc.GetAllocator());
-                        entJson["ctrl_pts"] = rapidjson::Value(rapidjson::kArrayType);
-                        entJson["scenario"] = 2;
-                        entJson["periodic"] = 0;
-                        entJson["flag"] = 1064; // experience
-                        entJson["splineflags"] = entJson["splineflags"].GetInt() | 0x04;
-                        // std::cout << fit_pts << std::endl;
-                        // std::cout << bases << std::endl;
-                    }
-                }
-                if (entJson["fit_pts"].Size() == 0)
-                    return;
-                if (entJson["ctrl_pts"].Size() != 0)
-                    return;
-                if (entJson["degree"].GetInt() != 3)
-                    throw std::runtime_error("spline should be degree 3 using fit_pts");
-                if (entJson["fit_pts"].Size() < 2)
-                    throw std::runtime_error("spline should have at least 2 fit pts");
-
-                auto fit_pts = RapidJsonGetMat3X(entJson["fit_pts"]);
-                auto knots = RapidJsonGetVecX(entJson["knots"]);
-                if (knots.size() == 0) // use default chord length parameter space knots
-                {
-                    knots.resize(fit_pts.cols());
-                    if (entJson["knotparam"].GetInt() == 0)
-                    { // use default chord length parameter space knots
-                        knots[0] = 0;
-                        for (int64_t i = 1; i < knots.size(); i++)
-                            knots[i] = knots[i - 1] +
-                                       (fit_pts(Eigen::all, i) - fit_pts(Eigen::all, i - 1)).norm();
-                    }
-                    // TODO: square root case
-                }
-                else if (knots.size() == fit_pts.cols())
-                {
-                    // do nothing
-                }
-                else if (knots.size() == fit_pts.cols() + 6) // guessed situation
-                {
-                    VecX knotsA = knots(Eigen::seq(3, 3 + fit_pts.cols() - 1));
-                    knots = knotsA;
-                }
+                lists.push_back(&list);
+            });
+        ReformSplines(lists);
+    }
 
-                auto start_tan = RapidJsonGetVec3(entJson["beg_tan_vec"]);
-                auto end_tan = RapidJsonGetVec3(entJson["end_tan_vec"]);
+    void Reader::ReformSplines(EntityList &list)
+    {
+        ReformSplines(std::vector<EntityList *>{&list});
+    }
 
-                VecX b_knots;
-                Mat3X b_pts;
+    void Reader::ReformSplines(const std::vector<EntityList *> &lists)
+    {
+        struct Task
+        {
+            EntityList *list;
+            SplineRecord *spline;
+            SplineFitInput fitIn;
+            std::vector<double> fitKey;    //* empty if not a fit point spline
+            SplineFitResult *fit = nullptr; //* the cache entry
+            bool fitOwner = false;          //* computes the entry
+        };
+        std::vector<Task> tasks;
+        for (auto list : lists)
+            for (auto &ent : list->ents)
+                if (ent.type == EntityType::Spline)
+                    tasks.push_back(Task{list, &list->splines[ent.rec]});
 
-                bool fitClosed = entJson["splineflags"].GetUint() & 0x04;
+        //* keys in entity order, the first spline of each new key computes it
+        for (auto &task : tasks)
+        {
+            if (!splineFitInput(*task.list, *task.spline, task.fitIn))
+                continue;
+            task.fitKey = task.fitIn.key(task.spline->knotparam);
+            if (auto found = splineFitCache.find(task.fitKey))
+            {
+                task.fit = found;
+                splineFitCache.nHit++;
+                continue;
+            }
+            task.fit = &splineFitCache[task.fitKey];
+            task.fitOwner = true;
+            splineFitCache.nMiss++;
+        }
 
-                DwgSim::CubicSplineToBSpline(
-                    knots, fit_pts,
-                    start_tan, end_tan,
-                    b_knots, b_pts, fitClosed);
+        //* the fits are dense in the number of points, largest first
+        std::vector<int64_t> order;
+        std::vector<int64_t> cost(tasks.size());
+        for (size_t i = 0; i < tasks.size(); i++)
+        {
+            if (!tasks[i].fitKey.empty() && !tasks[i].fitOwner)
+                continue;
+            order.push_back(int64_t(i));
+            cost[i] = std::max(tasks[i].spline->nFit, tasks[i].spline->nCtrl);
+        }
+        std::stable_sort(order.begin(), order.end(),
+                         [&](int64_t a, int64_t b)
+                         { return cost[a] > cost[b]; });
 
-                entJson["knots"] = VecXGetRapidJson(b_knots, doc.GetAllocator());
-                entJson["ctrl_pts"] = Mat3XGetRapidJson(b_pts, doc.GetAllocator());
-                for (int64_t i = 0; i < entJson["ctrl_pts"].Size(); i++)
-                    entJson["ctrl_pts"][i].PushBack(0.0, doc.GetAllocator()); // 0 weights for non-rational B-Spline
+        std::vector<SplineReform> results(tasks.size());
+        ParallelForOrdered(
+            order, nThreads,
+            [&](int64_t i)
+            {
+                results[i].spline = *tasks[i].spline;
+                if (tasks[i].fitOwner)
+                    fitSpline(tasks[i].fitIn, *tasks[i].fit);
+                else
+                    reformPeriodicSpline(*tasks[i].list, results[i]);
             });
+
+        //* buffers only grow here, in entity order, as in a serial run
+        for (size_t i = 0; i < tasks.size(); i++)
+        {
+            auto &task = tasks[i];
+            auto &r = results[i];
+            if (task.fit)
+            {
+                r.spline = *task.spline;
+                r.b_knots = task.fit->b_knots;
+                r.b_pts = task.fit->b_pts.colwise() + task.fitIn.origin;
+                r.newCtrl = true;
+            }
+            if (task.fit || r.newCtrl)
+                writeBackSplineReform(*task.list, *task.spline, r);
+            r = SplineReform();
+        }
     }
 
-#define __OUTPUT_SUBCLASS_NAME(name) \
-    o << "  100\n"                   \
-      << #name << "\n";
-#define __OUTPUT_ENTITY_VECTOR3(name, code0, codeJ) \
-    for (int i = 0; i < 3; i++)                     \
-        o << "  " << ##codeJ * i + ##code0 << "\n"  \
-          << entJson[#name][i].GetDouble() << "\n";
-#define __OUTPUT_ENTITY_STRING(name, code) \
-    o << "  " << ##code << "\n"            \
-      << entJson[#name].GetString() << "\n";
-#define __OUTPUT_ENTITY_DOUBLE(name, code) \
-    o << "  " << ##code << "\n"            \
-      << entJson[#name].GetDouble() << "\n";
-#define __OUTPUT_ENTITY_INT(name, code) \
-    o << "  " << ##code << "\n"         \
-      << entJson[#name].GetInt() << "\n";
-#define __EXTRUSION_IS_FINITE()                           \
-    (std::abs(entJson["extrusion"][0].GetDouble()) > 0 && \
-     std::abs(entJson["extrusion"][1].GetDouble()) > 0 && \
-     std::abs(entJson["extrusion"][2].GetDouble()) > 0)
+    void Reader::LoadSplineFitCache(const std::string &path)
+    {
+        if (!std::ifstream(path)) // not saved yet, e.g. the first run
+            return;
+        if (!splineFitCache.Load(path))
+            std::cerr << "not a spline fit cache, starting empty: " << path << std::endl;
+    }
 
-    void Reader::PrintDocDXF(std::ostream &o)
+    void Reader::SaveSplineFitCache(const std::string &path) const
     {
-        using std::dec;
-        using std::hex;
-        using std::nouppercase;
-        using std::uppercase;
-        using namespace std::string_literals;
-        const auto secStart = "  0\nSECTION\n";
-        const auto secEnd = "  0\nENDSEC\n";
-        o << "999\n";
-        o << "dwgSim\n";
-        o << std::setprecision(16);
-
-        o << secStart;
-        o << "  2\nHEADER\n";
-        o << "  9\n$ACADVER\n";
-        o << "  1\nAC1027\n";
-        o << "  9\n$HANDSEED\n";
-        o << "  5\n";
-        o << hex << uppercase << dwg.header_vars.HANDSEED->handleref.value << dec << nouppercase << "\n";
-        o << secEnd;
-
-        o << secStart;
-        o << "  2\nBLOCKS\n";
-        for (auto it = doc["blocks"].MemberBegin(); it != doc["blocks"].MemberEnd(); ++it)
-        {
-            o << "  0\nBLOCK\n";
-            o << "  5\n"
-              << hex << uppercase << it->value["id"].GetUint64() << dec << nouppercase << "\n";
-            __OUTPUT_SUBCLASS_NAME(AcDbEntity)
-            auto &entJson = it->value;
-            o << "  8\n0\n";
-            __OUTPUT_SUBCLASS_NAME(AcDbBlockBegin)
-            __OUTPUT_ENTITY_STRING(name, 2)
-            __OUTPUT_ENTITY_INT(flag, 70)
-            __OUTPUT_ENTITY_VECTOR3(base_pt, 10, 10)
-            __OUTPUT_ENTITY_STRING(name, 3)
-            if (entJson["blkisxref"].GetInt())
-                throw std::runtime_error("external ref not considered");
-            o << "  1\n\n";
-
-            for (int64_t i = 0; i < (int64_t)entJson["entities"].Size(); i++)
-            {
-                auto &entJsonEnt = entJson["entities"][i];
-                outEntityDXF(o, entJsonEnt);
-            }
-
-            o << "  0\nENDBLK\n";
-            o << "  5\n"
-              << hex << uppercase << it->value["endBlkId"].GetUint64() << dec << nouppercase << "\n";
-            __OUTPUT_SUBCLASS_NAME(AcDbEntity)
-            o << "  8\n0\n";
-            __OUTPUT_SUBCLASS_NAME(AcDbBlockEnd)
-        }
-        o << secEnd;
+        splineFitCache.Save(path);
+    }
 
-        o << secStart;
-        o << "  2\nENTITIES\n";
-        for (int64_t i = 0; i < (int64_t)doc["modelSpaceEntities"].Size(); i++)
-        {
-            auto &entJson = doc["modelSpaceEntities"][i];
-            outEntityDXF(o, entJson);
-        }
-        o << secEnd;
+#define __OUTPUT_SUBCLASS_NAME(name) \
+    w.str("  100\n" #name "\n");
 
-        o << "  0\nEOF\n";
+    static bool extrusionIsFinite(const double *ext)
+    {
+        return std::abs(ext[0]) > 0 &&
+               std::abs(ext[1]) > 0 &&
+               std::abs(ext[2]) > 0;
     }
 
-#define __CREATE_RAPIDJSON_FIELD_VECTOR3(name)    \
-                                                  \
-    rapidjson::Value name(rapidjson::kArrayType); \
-    name.Reserve(3, alloc);                       \
-    name.PushBack(ent->name.x, alloc);            \
-    name.PushBack(ent->name.y, alloc);            \
-    name.PushBack(ent->name.z, alloc);
+    void Reader::outHeaderDXF(DxfWriter &w)
+    {
+        w.str("999\ndwgSim\n");
 
-#define __FILL_RAPIDJSON_FIELD_VECTOR3(name)          \
-    {                                                 \
-        rapidjson::Value name(rapidjson::kArrayType); \
-        name.Reserve(3, alloc);                       \
-        name.PushBack(ent->name.x, alloc);            \
-        name.PushBack(ent->name.y, alloc);            \
-        name.PushBack(ent->name.z, alloc);            \
-        entJson.AddMember(#name, name, alloc);        \
+        w.str("  0\nSECTION\n");
+        w.str("  2\nHEADER\n");
+        w.str("  9\n$ACADVER\n");
+        w.str("  1\nAC1027\n");
+        w.str("  9\n$HANDSEED\n");
+        w.groupHandle(5, dwg.header_vars.HANDSEED->handleref.value);
+        w.str("  0\nENDSEC\n");
     }
 
-#define __FILL_RAPIDJSON_FIELD_DOUBLE(name)         \
-    {                                               \
-        entJson.AddMember(#name, ent->name, alloc); \
+    void Reader::outBlockDXF(DxfWriter &w, const BlockRecord &block)
+    {
+        w.str("  0\nBLOCK\n");
+        w.groupHandle(5, block.id);
+        __OUTPUT_SUBCLASS_NAME(AcDbEntity)
+        w.str("  8\n0\n");
+        __OUTPUT_SUBCLASS_NAME(AcDbBlockBegin)
+        w.groupStr(2, block.name);
+        w.groupInt(70, int(block.flag));
+        w.groupVector3(block.base_pt.data(), 10, 10);
+        w.groupStr(3, block.name);
+        if (block.blkisxref)
+            throw std::runtime_error("external ref not considered");
+        w.str("  1\n\n");
+
+        for (int64_t i = 0; i < block.entities.size(); i++)
+            outEntityDXF(w, block.entities, i);
+
+        w.str("  0\nENDBLK\n");
+        w.groupHandle(5, block.endBlkId);
+        __OUTPUT_SUBCLASS_NAME(AcDbEntity)
+        w.str("  8\n0\n");
+        __OUTPUT_SUBCLASS_NAME(AcDbBlockEnd)
     }
-#define __FILL_RAPIDJSON_FIELD_INT(name)                     \
-    {                                                        \
-        entJson.AddMember(#name, int32_t(ent->name), alloc); \
+
+    void Reader::PrintDocDXF(std::ostream &o)
+    {
+        DxfWriter w(o);
+        outHeaderDXF(w);
+
+        w.str("  0\nSECTION\n");
+        w.str("  2\nBLOCKS\n");
+        for (auto &block : blocks)
+            outBlockDXF(w, block);
+        w.str("  0\nENDSEC\n");
+
+        w.str("  0\nSECTION\n");
+        w.str("  2\nENTITIES\n");
+        for (int64_t i = 0; i < modelSpace.size(); i++)
+            outEntityDXF(w, modelSpace, i);
+        w.str("  0\nENDSEC\n");
+
+        w.str("  0\nEOF\n");
     }
-#define __FILL_RAPIDJSON_FIELD_STRING(str, len)     \
-    {                                               \
-        rapidjson::Value strJson;                   \
-        strJson.SetString((##str), (##len), alloc); \
-        entJson.AddMember(#str, strJson, alloc);    \
+
+    void Reader::PrintDocDXFStream(std::ostream &o, const std::function<void(const WindowBatch &)> &processWindows)
+    {
+        DxfWriter w(o);
+        outHeaderDXF(w);
+
+        //* model space is processed first to keep the order of dedup warnings,
+        //* and held until the ENTITIES section, which comes after BLOCKS
+        EntityList modelSpaceWindow;
+        StreamModelSpace(
+            [&](EntityList &list)
+            {
+                processWindows({{&list, "modelSpace"}});
+                modelSpaceWindow = std::move(list);
+            });
+
+        w.str("  0\nSECTION\n");
+        w.str("  2\nBLOCKS\n");
+        StreamBlockBatches(
+            [&](std::vector<BlockRecord> &batch)
+            {
+                processWindows(windowsOf(batch));
+                for (auto &block : batch)
+                    outBlockDXF(w, block);
+            });
+        w.str("  0\nENDSEC\n");
+
+        w.str("  0\nSECTION\n");
+        w.str("  2\nENTITIES\n");
+        for (int64_t i = 0; i < modelSpaceWindow.size(); i++)
+            outEntityDXF(w, modelSpaceWindow, i);
+        w.str("  0\nENDSEC\n");
+
+        w.str("  0\nEOF\n");
     }
 
-    void Reader::fillEntityJson(Dwg_Object *obj, const ObjectName &name, Dwg_Object_Type type, rapidjson::Value &entJson)
+    void Reader::fillEntity(Dwg_Object *obj, EntityType type, EntityList &list, OnlineDupFilter *dupFilter)
     {
-        rapidjson::Document::AllocatorType &alloc = doc.GetAllocator();
         int err{0};
         auto entGen = dwg_object_to_entity(obj, &err);
         if (err)
             throw field_query_error("dwg_object_to_entity failed");
 
-        recordLayerName(entGen);
+        auto &entRef = list.push(type, obj->handle.value, recordLayer(entGen));
 
-        entJson.AddMember("type", rapidjson::GenericStringRef<char>(name.c_str()), alloc);
-        entJson.AddMember("handle", (size_t)(obj->handle.value), alloc);
-        entJson.AddMember("layerId", (size_t)(entGen->layer->absolute_ref), alloc);
-
-        if (type == DWG_TYPE_LINE)
+        if (type == EntityType::Line)
         {
             auto ent = dwg_object_to_LINE(obj);
-            __FILL_RAPIDJSON_FIELD_VECTOR3(start)
-            __FILL_RAPIDJSON_FIELD_VECTOR3(end)
-            __FILL_RAPIDJSON_FIELD_VECTOR3(extrusion)
+            entRef.rec = int64_t(list.lines.size() / EntityList::lineRecSize);
+            list.lines.insert(list.lines.end(), {ent->start.x, ent->start.y, ent->start.z,
+                                                 ent->end.x, ent->end.y, ent->end.z});
+            list.lineExtrusions.insert(list.lineExtrusions.end(), {ent->extrusion.x, ent->extrusion.y, ent->extrusion.z});
         }
-        if (type == DWG_TYPE_ARC)
+        if (type == EntityType::Arc)
         {
             auto ent = dwg_object_to_ARC(obj);
-            __FILL_RAPIDJSON_FIELD_VECTOR3(center)
-            __FILL_RAPIDJSON_FIELD_DOUBLE(radius)
-            __FILL_RAPIDJSON_FIELD_DOUBLE(start_angle)
-            __FILL_RAPIDJSON_FIELD_DOUBLE(end_angle)
-            __FILL_RAPIDJSON_FIELD_VECTOR3(extrusion)
+            entRef.rec = int64_t(list.arcs.size() / EntityList::arcRecSize);
+            list.arcs.insert(list.arcs.end(), {ent->extrusion.x, ent->extrusion.y, ent->extrusion.z,
+                                               ent->center.x, ent->center.y, ent->center.z,
+                                               ent->radius, ent->start_angle, ent->end_angle});
         }
-        if (type == DWG_TYPE_CIRCLE)
+        if (type == EntityType::Circle)
         {
             auto ent = dwg_object_to_CIRCLE(obj);
-            __FILL_RAPIDJSON_FIELD_VECTOR3(center)
-            __FILL_RAPIDJSON_FIELD_DOUBLE(radius)
-            __FILL_RAPIDJSON_FIELD_VECTOR3(extrusion)
+            entRef.rec = int64_t(list.arcs.size() / EntityList::arcRecSize);
+            list.arcs.insert(list.arcs.end(), {ent->extrusion.x, ent->extrusion.y, ent->extrusion.z,
+                                               ent->center.x, ent->center.y, ent->center.z,
+                                               ent->radius, 0., 2 * pi});
         }
-        if (type == DWG_TYPE_ELLIPSE)
+        if (type == EntityType::Ellipse)
         {
             auto ent = dwg_object_to_ELLIPSE(obj);
-            __FILL_RAPIDJSON_FIELD_VECTOR3(center)
-            __FILL_RAPIDJSON_FIELD_VECTOR3(sm_axis)
-            __FILL_RAPIDJSON_FIELD_DOUBLE(axis_ratio)
-            __FILL_RAPIDJSON_FIELD_DOUBLE(start_angle)
-            __FILL_RAPIDJSON_FIELD_DOUBLE(end_angle)
-            __FILL_RAPIDJSON_FIELD_VECTOR3(extrusion)
+            entRef.rec = int64_t(list.ellipses.size() / EntityList::ellipseRecSize);
+            list.ellipses.insert(list.ellipses.end(), {ent->center.x, ent->center.y, ent->center.z,
+                                                       ent->sm_axis.x, ent->sm_axis.y, ent->sm_axis.z,
+                                                       ent->extrusion.x, ent->extrusion.y, ent->extrusion.z,
+                                                       ent->axis_ratio, ent->start_angle, ent->end_angle});
         }
-        if (type == DWG_TYPE_POLYLINE_3D)
+        if (type == EntityType::Polyline3D)
         {
             auto ent = dwg_object_to_POLYLINE_3D(obj);
-            auto entP = ent;
-            __FILL_RAPIDJSON_FIELD_INT(flag)
-
-            rapidjson::Value vertsJson(rapidjson::kArrayType);
-            rapidjson::Value bulgesJson(rapidjson::kArrayType);
-            rapidjson::Value vertHandlesJson(rapidjson::kArrayType);
-            vertsJson.Reserve(ent->num_owned, alloc);
-            bulgesJson.Reserve(ent->num_owned, alloc);
-            vertHandlesJson.Reserve(ent->num_owned, alloc);
+            entRef.rec = int64_t(list.polylines.size());
+            PolylineRecord poly;
+            poly.flag = int32_t(ent->flag);
+            poly.vertStart = int64_t(list.polyVerts.size() / 3);
+            poly.bulgeStart = int64_t(list.polyBulges.size());
             if (ent->has_vertex)
             {
                 for (uint32_t i = 0; i < ent->num_owned; i++)
                 {
-                    auto ent = dwg_object_to_VERTEX_3D(entP->vertex[i]->obj);
-                    __CREATE_RAPIDJSON_FIELD_VECTOR3(point)
-                    vertsJson.PushBack(point, alloc);
-                    bulgesJson.PushBack(0, alloc);
-                    vertHandlesJson.PushBack(entP->vertex[i]->obj->handle.value, alloc);
+                    auto vert = dwg_object_to_VERTEX_3D(ent->vertex[i]->obj);
+                    list.polyVerts.insert(list.polyVerts.end(), {vert->point.x, vert->point.y, vert->point.z});
+                    list.polyBulges.push_back(0);
+                    list.polyVertHandles.push_back(ent->vertex[i]->obj->handle.value);
                 }
+                poly.nVert = poly.nBulge = ent->num_owned;
             }
-            entJson.AddMember("vertex", vertsJson, alloc);
-            entJson.AddMember("bulge", bulgesJson, alloc);
-            entJson.AddMember("vertexHandles", vertHandlesJson, alloc);
-            entJson.AddMember("seqendHandle", ent->seqend->absolute_ref, alloc);
-
-            __FILL_RAPIDJSON_FIELD_VECTOR3(extrusion)
+            poly.seqendHandle = ent->seqend->absolute_ref;
+            poly.extrusion = {ent->extrusion.x, ent->extrusion.y, ent->extrusion.z};
+            list.polylines.push_back(poly);
         }
-        if (type == DWG_TYPE_POLYLINE_2D) // all 3D terms to 2D and adding bulges
+        if (type == EntityType::Polyline2D) // all 3D terms to 2D and adding bulges
         {
             auto ent = dwg_object_to_POLYLINE_2D(obj);
-            auto entP = ent;
-            __FILL_RAPIDJSON_FIELD_INT(flag)
-
-            rapidjson::Value vertsJson(rapidjson::kArrayType);
-            rapidjson::Value bulgesJson(rapidjson::kArrayType);
-            rapidjson::Value vertHandlesJson(rapidjson::kArrayType);
-            vertsJson.Reserve(ent->num_owned, alloc);
-            bulgesJson.Reserve(ent->num_owned, alloc);
-            vertHandlesJson.Reserve(ent->num_owned, alloc);
+            entRef.rec = int64_t(list.polylines.size());
+            PolylineRecord poly;
+            poly.flag = int32_t(ent->flag);
+            poly.vertStart = int64_t(list.polyVerts.size() / 3);
+            poly.bulgeStart = int64_t(list.polyBulges.size());
             if (ent->has_vertex)
             {
                 for (uint32_t i = 0; i < ent->num_owned; i++)
                 {
-                    auto ent = dwg_object_to_VERTEX_2D(entP->vertex[i]->obj);
-                    __CREATE_RAPIDJSON_FIELD_VECTOR3(point)
-                    vertsJson.PushBack(point, alloc);
-                    bulgesJson.PushBack(ent->bulge, alloc);
-                    vertHandlesJson.PushBack(entP->vertex[i]->obj->handle.value, alloc);
+                    auto vert = dwg_object_to_VERTEX_2D(ent->vertex[i]->obj);
+                    list.polyVerts.insert(list.polyVerts.end(), {vert->point.x, vert->point.y, vert->point.z});
+                    list.polyBulges.push_back(vert->bulge);
+                    list.polyVertHandles.push_back(ent->vertex[i]->obj->handle.value);
                 }
+                poly.nVert = poly.nBulge = ent->num_owned;
             }
-            entJson.AddMember("vertex", vertsJson, alloc);
-            entJson.AddMember("bulge", bulgesJson, alloc);
-            entJson.AddMember("vertexHandles", vertHandlesJson, alloc);
-            entJson.AddMember("seqendHandle", ent->seqend->absolute_ref, alloc);
-
-            __FILL_RAPIDJSON_FIELD_VECTOR3(extrusion)
+            poly.seqendHandle = ent->seqend->absolute_ref;
+            poly.extrusion = {ent->extrusion.x, ent->extrusion.y, ent->extrusion.z};
+            list.polylines.push_back(poly);
         }
-        if (type == DWG_TYPE_LWPOLYLINE)
+        if (type == EntityType::LwPolyline)
         {
             auto ent = dwg_object_to_LWPOLYLINE(obj);
-            auto entP = ent;
-            __FILL_RAPIDJSON_FIELD_INT(flag)
-
-            rapidjson::Value vertsJson(rapidjson::kArrayType);
-            rapidjson::Value bulgesJson(rapidjson::kArrayType);
-            vertsJson.Reserve(ent->num_points, alloc);
-            bulgesJson.Reserve(ent->num_bulges, alloc);
+            entRef.rec = int64_t(list.polylines.size());
+            PolylineRecord poly;
+            poly.flag = int32_t(ent->flag);
+            poly.vertStart = int64_t(list.polyVerts.size() / 3);
+            poly.nVert = ent->num_points;
+            poly.bulgeStart = int64_t(list.polyBulges.size());
+            poly.nBulge = ent->num_bulges;
             for (uint32_t i = 0; i < ent->num_points; i++)
             {
-                rapidjson::Value point(rapidjson::kArrayType);
-                point.Reserve(3, alloc);
-                point.PushBack(ent->points[i].x, alloc);
-                point.PushBack(ent->points[i].y, alloc);
-                vertsJson.PushBack(point, alloc);
+                list.polyVerts.insert(list.polyVerts.end(), {ent->points[i].x, ent->points[i].y, ent->elevation});
+                list.polyVertHandles.push_back(0);
             }
             for (uint32_t i = 0; i < ent->num_bulges; i++)
-            {
-                bulgesJson.PushBack(ent->bulges[i], alloc);
-            }
-
-            entJson.AddMember("vertex", vertsJson, alloc);
-            entJson.AddMember("bulge", bulgesJson, alloc);
-
-            __FILL_RAPIDJSON_FIELD_VECTOR3(extrusion)
+                list.polyBulges.push_back(ent->bulges[i]);
+            poly.extrusion = {ent->extrusion.x, ent->extrusion.y, ent->extrusion.z};
+            list.polylines.push_back(poly);
         }
-        if (type == DWG_TYPE_SPLINE)
+        if (type == EntityType::Spline)
         {
             auto ent = dwg_object_to_SPLINE(obj);
-            auto entP = ent;
-            __FILL_RAPIDJSON_FIELD_INT(flag)
-            __FILL_RAPIDJSON_FIELD_INT(splineflags)
-            __FILL_RAPIDJSON_FIELD_INT(periodic)
-            __FILL_RAPIDJSON_FIELD_INT(rational)
-            __FILL_RAPIDJSON_FIELD_INT(weighted)
-            __FILL_RAPIDJSON_FIELD_INT(knotparam)
-            __FILL_RAPIDJSON_FIELD_INT(scenario)
-            __FILL_RAPIDJSON_FIELD_DOUBLE(ctrl_tol)
-            __FILL_RAPIDJSON_FIELD_DOUBLE(fit_tol)
-            __FILL_RAPIDJSON_FIELD_DOUBLE(knot_tol)
-            __FILL_RAPIDJSON_FIELD_INT(degree)
-            __FILL_RAPIDJSON_FIELD_VECTOR3(beg_tan_vec)
-            __FILL_RAPIDJSON_FIELD_VECTOR3(end_tan_vec)
-
-            rapidjson::Value ctrlPtsJson(rapidjson::kArrayType);
-            rapidjson::Value fitPtsJson(rapidjson::kArrayType);
-            rapidjson::Value knotsJson(rapidjson::kArrayType);
-            ctrlPtsJson.Reserve(ent->num_ctrl_pts, alloc);
-            fitPtsJson.Reserve(ent->num_fit_pts, alloc);
-            knotsJson.Reserve(ent->num_knots, alloc);
+            entRef.rec = int64_t(list.splines.size());
+            SplineRecord spline;
+            spline.flag = int32_t(ent->flag);
+            spline.splineflags = int32_t(ent->splineflags);
+            spline.periodic = int32_t(ent->periodic);
+            spline.rational = int32_t(ent->rational);
+            spline.weighted = int32_t(ent->weighted);
+            spline.knotparam = int32_t(ent->knotparam);
+            spline.scenario = int32_t(ent->scenario);
+            spline.ctrl_tol = ent->ctrl_tol;
+            spline.fit_tol = ent->fit_tol;
+            spline.knot_tol = ent->knot_tol;
+            spline.degree = int32_t(ent->degree);
+            spline.beg_tan_vec = {ent->beg_tan_vec.x, ent->beg_tan_vec.y, ent->beg_tan_vec.z};
+            spline.end_tan_vec = {ent->end_tan_vec.x, ent->end_tan_vec.y, ent->end_tan_vec.z};
 
+            spline.ctrlStart = int64_t(list.splineCtrl.size() / 4);
+            spline.nCtrl = ent->num_ctrl_pts;
             for (uint32_t i = 0; i < ent->num_ctrl_pts; i++)
-            {
-                rapidjson::Value point(rapidjson::kArrayType);
-                point.Reserve(4, alloc);
-                point.PushBack(ent->ctrl_pts[i].x, alloc);
-                point.PushBack(ent->ctrl_pts[i].y, alloc);
-                point.PushBack(ent->ctrl_pts[i].z, alloc);
-                point.PushBack(ent->ctrl_pts[i].w, alloc); // weights here
-                ctrlPtsJson.PushBack(point, alloc);
-            }
+                list.splineCtrl.insert(list.splineCtrl.end(), {ent->ctrl_pts[i].x, ent->ctrl_pts[i].y, ent->ctrl_pts[i].z,
+                                                               ent->ctrl_pts[i].w}); // weights here
+            spline.fitStart = int64_t(list.splineFit.size() / 3);
+            spline.nFit = ent->num_fit_pts;
             for (uint32_t i = 0; i < ent->num_fit_pts; i++)
-            {
-                rapidjson::Value point(rapidjson::kArrayType);
-                point.Reserve(3, alloc);
-                point.PushBack(ent->fit_pts[i].x, alloc);
-                point.PushBack(ent->fit_pts[i].y, alloc);
-                point.PushBack(ent->fit_pts[i].z, alloc);
-                fitPtsJson.PushBack(point, alloc);
-            }
-            for (uint32_t i = 0; i < ent->num_knots; i++)
-            {
-                knotsJson.PushBack(ent->knots[i], alloc);
-            }
-
-            entJson.AddMember("ctrl_pts", ctrlPtsJson, alloc);
-            entJson.AddMember("fit_pts", fitPtsJson, alloc);
-            entJson.AddMember("knots", knotsJson, alloc);
-            entJson.AddMember("extrusion", Vec3GetRapidJson({0, 0, 1}, alloc), alloc);
+                list.splineFit.insert(list.splineFit.end(), {ent->fit_pts[i].x, ent->fit_pts[i].y, ent->fit_pts[i].z});
+            spline.knotStart = int64_t(list.splineKnots.size());
+            spline.nKnot = ent->num_knots;
+            list.splineKnots.insert(list.splineKnots.end(), ent->knots, ent->knots + ent->num_knots);
+            list.splines.push_back(spline);
         }
-        if (type == DWG_TYPE_INSERT)
+        if (type == EntityType::Insert)
         {
             auto ent = dwg_object_to_INSERT(obj);
-            entJson.AddMember("blockId", (size_t)(ent->block_header->absolute_ref), alloc);
+            entRef.rec = int64_t(list.inserts.size());
+            InsertRecord insert;
+            insert.blockId = ent->block_header->absolute_ref;
             char *blockName = dwg_obj_block_header_get_name(dwg_object_to_BLOCK_HEADER(ent->block_header->obj), &err);
-            __FILL_RAPIDJSON_FIELD_STRING(blockName, (int)std::strlen(blockName))
+            insert.blockName = blockName;
             if (IS_FROM_TU_DWG((&dwg)))
                 free(blockName);
-            __FILL_RAPIDJSON_FIELD_VECTOR3(ins_pt)
-            __FILL_RAPIDJSON_FIELD_VECTOR3(scale)
-            __FILL_RAPIDJSON_FIELD_DOUBLE(rotation)
-            entJson.AddMember("num_cols", std::max(int(ent->num_cols), 1), alloc); //! libredwg sets this to 0! could be its bug
-            entJson.AddMember("num_rows", std::max(int(ent->num_rows), 1), alloc);
-            __FILL_RAPIDJSON_FIELD_DOUBLE(col_spacing)
-            __FILL_RAPIDJSON_FIELD_DOUBLE(row_spacing)
-            __FILL_RAPIDJSON_FIELD_VECTOR3(extrusion)
+            insert.ins_pt = {ent->ins_pt.x, ent->ins_pt.y, ent->ins_pt.z};
+            insert.scale = {ent->scale.x, ent->scale.y, ent->scale.z};
+            insert.rotation = ent->rotation;
+            insert.num_cols = std::max(int(ent->num_cols), 1); //! libredwg sets this to 0! could be its bug
+            insert.num_rows = std::max(int(ent->num_rows), 1);
+            insert.col_spacing = ent->col_spacing;
+            insert.row_spacing = ent->row_spacing;
+            insert.extrusion = {ent->extrusion.x, ent->extrusion.y, ent->extrusion.z};
+            list.inserts.push_back(insert);
+        }
+
+        //* the layer stays recorded as used, as when --dupDel removes the entity later
+        if (dupFilter && !dupFilter->keepLast(list))
+        {
+            list.popBack();
+            nDupOnlineRejected++;
         }
     }
 
-    void Reader::outEntityDXF(std::ostream &o, rapidjson::Value &entJson)
+    template <class TWriter>
+    static void writeDoublesJSON(TWriter &w, const double *v, int64_t n)
+    {
+        w.StartArray();
+        for (int64_t i = 0; i < n; i++)
+            w.Double(v[i]);
+        w.EndArray();
+    }
+
+    template <class TWriter>
+    void Reader::writeEntityJSON(TWriter &w, const EntityList &list, int64_t i)
     {
-        using std::dec;
-        using std::hex;
-        using std::nouppercase;
-        using std::uppercase;
-        using namespace std::string_literals;
-        auto &layersJson = doc["layers"];
+        auto &ent = list.ents[i];
+        w.StartObject();
+        w.Key("type");
+        w.String(entityTypeName(ent.type));
+        w.Key("handle");
+        w.Uint64(ent.handle);
+        w.Key("layerId");
+        w.Uint64(layers[ent.layerId].handle);
 
-        if (!objName2DxfNameMapping.map.count(entJson["type"].GetString()))
+        switch (ent.type)
+        {
+        case EntityType::Line:
+        {
+            auto line = list.line(ent.rec);
+            w.Key("start");
+            writeDoublesJSON(w, line, 3);
+            w.Key("end");
+            writeDoublesJSON(w, line + 3, 3);
+            w.Key("extrusion");
+            writeDoublesJSON(w, list.lineExtrusion(ent.rec), 3);
+        }
+        break;
+        case EntityType::Arc:
+        case EntityType::Circle:
+        {
+            auto arc = list.arc(ent.rec);
+            w.Key("center");
+            writeDoublesJSON(w, arc + 3, 3);
+            w.Key("radius");
+            w.Double(arc[6]);
+            if (ent.type == EntityType::Arc)
+            {
+                w.Key("start_angle");
+                w.Double(arc[7]);
+                w.Key("end_angle");
+                w.Double(arc[8]);
+            }
+            w.Key("extrusion");
+            writeDoublesJSON(w, arc, 3);
+        }
+        break;
+        case EntityType::Ellipse:
+        {
+            auto ellipse = list.ellipse(ent.rec);
+            w.Key("center");
+            writeDoublesJSON(w, ellipse, 3);
+            w.Key("sm_axis");
+            writeDoublesJSON(w, ellipse + 3, 3);
+            w.Key("axis_ratio");
+            w.Double(ellipse[9]);
+            w.Key("start_angle");
+            w.Double(ellipse[10]);
+            w.Key("end_angle");
+            w.Double(ellipse[11]);
+            w.Key("extrusion");
+            writeDoublesJSON(w, ellipse + 6, 3);
+        }
+        break;
+        case EntityType::Polyline2D:
+        case EntityType::Polyline3D:
+        {
+            auto &poly = list.polylines[ent.rec];
+            w.Key("flag");
+            w.Int(poly.flag);
+            w.Key("vertex");
+            w.StartArray();
+            for (int64_t iv = 0; iv < poly.nVert; iv++)
+                writeDoublesJSON(w, list.polyVert(poly, iv), 3);
+            w.EndArray();
+            w.Key("bulge");
+            w.StartArray();
+            for (int64_t ib = 0; ib < poly.nBulge; ib++)
+                if (ent.type == EntityType::Polyline3D)
+                    w.Int(0);
+                else
+                    w.Double(list.polyBulge(poly, ib));
+            w.EndArray();
+            w.Key("vertexHandles");
+            w.StartArray();
+            for (int64_t iv = 0; iv < poly.nVert; iv++)
+                w.Uint64(list.polyVertHandle(poly, iv));
+            w.EndArray();
+            w.Key("seqendHandle");
+            w.Uint64(poly.seqendHandle);
+            w.Key("extrusion");
+            writeDoublesJSON(w, poly.extrusion.data(), 3);
+        }
+        break;
+        case EntityType::LwPolyline:
+        {
+            auto &poly = list.polylines[ent.rec];
+            w.Key("flag");
+            w.Int(poly.flag);
+            w.Key("vertex");
+            w.StartArray();
+            for (int64_t iv = 0; iv < poly.nVert; iv++)
+                writeDoublesJSON(w, list.polyVert(poly, iv), 2);
+            w.EndArray();
+            w.Key("bulge");
+            writeDoublesJSON(w, list.polyBulges.data() + poly.bulgeStart, poly.nBulge);
+            w.Key("extrusion");
+            writeDoublesJSON(w, poly.extrusion.data(), 3);
+        }
+        break;
+        case EntityType::Spline:
+        {
+            auto &spline = list.splines[ent.rec];
+            w.Key("flag");
+            w.Int(spline.flag);
+            w.Key("splineflags");
+            w.Int(spline.splineflags);
+            w.Key("periodic");
+            w.Int(spline.periodic);
+            w.Key("rational");
+            w.Int(spline.rational);
+            w.Key("weighted");
+            w.Int(spline.weighted);
+            w.Key("knotparam");
+            w.Int(spline.knotparam);
+            w.Key("scenario");
+            w.Int(spline.scenario);
+            w.Key("ctrl_tol");
+            w.Double(spline.ctrl_tol);
+            w.Key("fit_tol");
+            w.Double(spline.fit_tol);
+            w.Key("knot_tol");
+            w.Double(spline.knot_tol);
+            w.Key("degree");
+            w.Int(spline.degree);
+            w.Key("beg_tan_vec");
+            writeDoublesJSON(w, spline.beg_tan_vec.data(), 3);
+            w.Key("end_tan_vec");
+            writeDoublesJSON(w, spline.end_tan_vec.data(), 3);
+            w.Key("ctrl_pts");
+            w.StartArray();
+            for (int64_t ip = 0; ip < spline.nCtrl; ip++)
+                writeDoublesJSON(w, list.splineCtrlPt(spline, ip), 4);
+            w.EndArray();
+            w.Key("fit_pts");
+            w.StartArray();
+            for (int64_t ip = 0; ip < spline.nFit; ip++)
+                writeDoublesJSON(w, list.splineFitPt(spline, ip), 3);
+            w.EndArray();
+            w.Key("knots");
+            writeDoublesJSON(w, list.splineKnots.data() + spline.knotStart, spline.nKnot);
+            const double splineExtrusion[3] = {0, 0, 1};
+            w.Key("extrusion");
+            writeDoublesJSON(w, splineExtrusion, 3);
+        }
+        break;
+        case EntityType::Insert:
+        {
+            auto &insert = list.inserts[ent.rec];
+            w.Key("blockId");
+            w.Uint64(insert.blockId);
+            w.Key("blockName");
+            w.String(insert.blockName.c_str(), rapidjson::SizeType(insert.blockName.size()));
+            w.Key("ins_pt");
+            writeDoublesJSON(w, insert.ins_pt.data(), 3);
+            w.Key("scale");
+            writeDoublesJSON(w, insert.scale.data(), 3);
+            w.Key("rotation");
+            w.Double(insert.rotation);
+            w.Key("num_cols");
+            w.Int(insert.num_cols);
+            w.Key("num_rows");
+            w.Int(insert.num_rows);
+            w.Key("col_spacing");
+            w.Double(insert.col_spacing);
+            w.Key("row_spacing");
+            w.Double(insert.row_spacing);
+            w.Key("extrusion");
+            writeDoublesJSON(w, insert.extrusion.data(), 3);
+        }
+        break;
+        default:
+            break;
+        }
+        w.EndObject();
+    }
+
+    template <class TWriter>
+    void Reader::writeLayersJSON(TWriter &w)
+    {
+        if (layerOrder.empty())
             return;
+        w.Key("layers");
+        w.StartObject();
+        for (auto layerId : layerOrder)
+        {
+            auto &layer = layers[layerId];
+            auto layerIdStr = std::to_string(layer.handle);
+            w.Key(layerIdStr.c_str(), rapidjson::SizeType(layerIdStr.size()), true);
+            w.StartObject();
+            w.Key("name");
+            w.String(layer.name.c_str(), rapidjson::SizeType(layer.name.size()), true);
+            w.Key("flag");
+            w.Int(layer.flag);
+            w.Key("plotflag");
+            w.Int(layer.plotflag);
+            w.Key("linewt");
+            w.Int(layer.linewt);
+            w.Key("ltype");
+            w.StartObject();
+            w.Key("name");
+            w.String(layer.ltypeName.c_str(), rapidjson::SizeType(layer.ltypeName.size()), true);
+            w.EndObject();
+            w.Key("color");
+            w.StartObject();
+            w.Key("index");
+            w.Int(layer.colorIndex);
+            w.EndObject();
+            w.EndObject();
+        }
+        w.EndObject();
+    }
+
+    template <class TWriter>
+    void Reader::writeBlockJSON(TWriter &w, const BlockRecord &block)
+    {
+        auto blockIdStr = std::to_string(block.id);
+        w.Key(blockIdStr.c_str(), rapidjson::SizeType(blockIdStr.size()), true);
+        w.StartObject();
+        w.Key("blkisxref");
+        w.Int(block.blkisxref);
+        w.Key("id");
+        w.Uint64(block.id);
+        w.Key("endBlkId");
+        w.Uint64(block.endBlkId);
+        w.Key("flag");
+        w.Uint(block.flag);
+        w.Key("name");
+        w.String(block.name.c_str(), rapidjson::SizeType(block.name.size()), true);
+        w.Key("base_pt");
+        writeDoublesJSON(w, block.base_pt.data(), 3);
+        w.Key("entities");
+        w.StartArray();
+        for (int64_t i = 0; i < block.entities.size(); i++)
+            writeEntityJSON(w, block.entities, i);
+        w.EndArray();
+        w.EndObject();
+    }
+
+    template <class TWriter>
+    void Reader::writeDocJSON(TWriter &w)
+    {
+        w.StartObject();
+
+        w.Key("modelSpaceEntities");
+        w.StartArray();
+        for (int64_t i = 0; i < modelSpace.size(); i++)
+            writeEntityJSON(w, modelSpace, i);
+        w.EndArray();
+
+        writeLayersJSON(w);
+
+        w.Key("blocks");
+        w.StartObject();
+        for (auto &block : blocks)
+            writeBlockJSON(w, block);
+        w.EndObject();
+
+        w.EndObject();
+    }
+
+    template <class TWriter>
+    void Reader::streamDocJSON(TWriter &w, const std::function<void(const WindowBatch &)> &processWindows)
+    {
+        w.StartObject();
 
-        o << "  0\n"
-          << objName2DxfNameMapping.map.at(entJson["type"].GetString()) << "\n";
-        o << "  5\n"
-          << hex << uppercase << entJson["handle"].GetUint64() << dec << nouppercase << "\n";
+        w.Key("modelSpaceEntities");
+        w.StartArray();
+        StreamModelSpace(
+            [&](EntityList &list)
+            {
+                processWindows({{&list, "modelSpace"}});
+                for (int64_t i = 0; i < list.size(); i++)
+                    writeEntityJSON(w, list, i);
+            });
+        w.EndArray();
+
+        w.Key("blocks");
+        w.StartObject();
+        StreamBlockBatches(
+            [&](std::vector<BlockRecord> &batch)
+            {
+                processWindows(windowsOf(batch));
+                for (auto &block : batch)
+                    writeBlockJSON(w, block);
+            });
+        w.EndObject();
+
+        writeLayersJSON(w);
+
+        w.EndObject();
+    }
+
+    void Reader::PrintDoc(std::ostream &o, int nIndent)
+    {
+        rapidjson::OStreamWrapper osw(o);
+        if (nIndent)
+        {
+            rapidjson::PrettyWriter<rapidjson::OStreamWrapper> writer(osw);
+            writer.SetIndent(' ', nIndent);
+            writeDocJSON(writer);
+        }
+        else
+        {
+            rapidjson::Writer<rapidjson::OStreamWrapper> writer(osw);
+            writeDocJSON(writer);
+        }
+    }
+
+    void Reader::PrintDocStream(std::ostream &o, int nIndent, const std::function<void(const WindowBatch &)> &processWindows)
+    {
+        rapidjson::OStreamWrapper osw(o);
+        if (nIndent)
+        {
+            rapidjson::PrettyWriter<rapidjson::OStreamWrapper> writer(osw);
+            writer.SetIndent(' ', nIndent);
+            streamDocJSON(writer, processWindows);
+        }
+        else
+        {
+            rapidjson::Writer<rapidjson::OStreamWrapper> writer(osw);
+            streamDocJSON(writer, processWindows);
+        }
+    }
+
+    void Reader::outEntityDXF(DxfWriter &w, const EntityList &list, int64_t i)
+    {
+        auto &ent = list.ents[i];
+        auto dxfName = entityTypeDxfName(ent.type);
+        if (!dxfName)
+            return;
+
+        w.groupStr(0, dxfName);
+        w.groupHandle(5, ent.handle);
         __OUTPUT_SUBCLASS_NAME(AcDbEntity)
-        auto &layerJson = layersJson[std::to_string(entJson["layerId"].GetUint64()).c_str()];
-        o << "  8\n"
-          << layerJson["name"].GetString() << "\n";
+        auto &layerName = layers[ent.layerId].name;
+        w.groupStr(8, layerName);
 
-        auto type = entJson["type"].GetString();
-        if (type == "LINE"s)
+        switch (ent.type)
+        {
+        case EntityType::Line:
         {
+            auto line = list.line(ent.rec);
+            auto extrusion = list.lineExtrusion(ent.rec);
             __OUTPUT_SUBCLASS_NAME(AcDbLine)
-            __OUTPUT_ENTITY_VECTOR3(start, 10, 10)
-            __OUTPUT_ENTITY_VECTOR3(end, 11, 10)
-            if (__EXTRUSION_IS_FINITE())
-                __OUTPUT_ENTITY_VECTOR3(extrusion, 210, 10)
+            w.groupVector3(line, 10, 10);
+            w.groupVector3(line + 3, 11, 10);
+            if (extrusionIsFinite(extrusion))
+                w.groupVector3(extrusion, 210, 10);
         }
-        else if (type == "ARC"s)
+        break;
+        case EntityType::Arc:
         {
+            auto arc = list.arc(ent.rec);
             __OUTPUT_SUBCLASS_NAME(AcDbArc)
-            __OUTPUT_ENTITY_VECTOR3(center, 10, 10)
-            __OUTPUT_ENTITY_DOUBLE(radius, 40)
-            o << "  " << 50 << "\n"
-              << entJson["start_angle"].GetDouble() * 180. / pi << "\n";
-            o << "  " << 51 << "\n"
-              << entJson["end_angle"].GetDouble() * 180. / pi << "\n"; //! in degree
-            if (__EXTRUSION_IS_FINITE())
-                __OUTPUT_ENTITY_VECTOR3(extrusion, 210, 10)
+            w.groupVector3(arc + 3, 10, 10);
+            w.groupReal(40, arc[6]);
+            w.groupReal(50, arc[7] * 180. / pi);
+            w.groupReal(51, arc[8] * 180. / pi); //! in degree
+            if (extrusionIsFinite(arc))
+                w.groupVector3(arc, 210, 10);
         }
-        else if (type == "CIRCLE"s)
+        break;
+        case EntityType::Circle:
         {
+            auto arc = list.arc(ent.rec);
             __OUTPUT_SUBCLASS_NAME(AcDbCircle)
-            __OUTPUT_ENTITY_VECTOR3(center, 10, 10)
-            __OUTPUT_ENTITY_DOUBLE(radius, 40)
-            if (__EXTRUSION_IS_FINITE())
-                __OUTPUT_ENTITY_VECTOR3(extrusion, 210, 10)
+            w.groupVector3(arc + 3, 10, 10);
+            w.groupReal(40, arc[6]);
+            if (extrusionIsFinite(arc))
+                w.groupVector3(arc, 210, 10);
         }
-        else if (type == "ELLIPSE"s)
+        break;
+        case EntityType::Ellipse:
         {
+            auto ellipse = list.ellipse(ent.rec);
             __OUTPUT_SUBCLASS_NAME(AcDbEllipse)
-            __OUTPUT_ENTITY_VECTOR3(center, 10, 10)
-            __OUTPUT_ENTITY_VECTOR3(sm_axis, 11, 10)
-            __OUTPUT_ENTITY_DOUBLE(axis_ratio, 40)
-            __OUTPUT_ENTITY_DOUBLE(start_angle, 41)
-            __OUTPUT_ENTITY_DOUBLE(end_angle, 42) //! in radius
-            if (__EXTRUSION_IS_FINITE())
-                __OUTPUT_ENTITY_VECTOR3(extrusion, 210, 10)
+            w.groupVector3(ellipse, 10, 10);
+            w.groupVector3(ellipse + 3, 11, 10);
+            w.groupReal(40, ellipse[9]);
+            w.groupReal(41, ellipse[10]);
+            w.groupReal(42, ellipse[11]); //! in radius
+            if (extrusionIsFinite(ellipse + 6))
+                w.groupVector3(ellipse + 6, 210, 10);
         }
-        else if (type == "POLYLINE_3D"s || type == "POLYLINE_2D"s)
+        break;
+        case EntityType::Polyline3D:
+        case EntityType::Polyline2D:
         {
-            if (type == "POLYLINE_3D"s)
+            auto &poly = list.polylines[ent.rec];
+            bool is3D = ent.type == EntityType::Polyline3D;
+            if (is3D)
                 __OUTPUT_SUBCLASS_NAME(AcDb3dPolyline)
             else
                 __OUTPUT_SUBCLASS_NAME(AcDb2dPolyline)
-            o << "  10\n0\n  20\n0\n";
-            o << "  30\n"
-              << 0 << "\n"; //? elevation is what
-            __OUTPUT_ENTITY_INT(flag, 70)
-            for (int64_t i = 0; i < (int64_t)entJson["vertex"].Size(); i++)
-            {
-                o << "  0\n"
-                  << "VERTEX" << "\n";
-                o << "  5 \n"
-                  << hex << uppercase << entJson["vertexHandles"][i].GetUint64() << dec << nouppercase << "\n";
+            w.str("  10\n0\n  20\n0\n");
+            w.str("  30\n0\n"); //? elevation is what
+            w.groupInt(70, poly.flag);
+            for (int64_t iv = 0; iv < poly.nVert; iv++)
+            {
+                w.str("  0\nVERTEX\n");
+                w.str("  5 \n").handle(list.polyVertHandle(poly, iv));
                 __OUTPUT_SUBCLASS_NAME(AcDbEntity)
-                o << "  8\n"
-                  << layerJson["name"].GetString() << "\n"; // forcing to use polyline's layer
+                w.groupStr(8, layerName); // forcing to use polyline's layer
                 __OUTPUT_SUBCLASS_NAME(AcDbVertex)
-                if (type == "POLYLINE_3D"s)
+                if (is3D)
                     __OUTPUT_SUBCLASS_NAME(AcDb3dPolylineVertex)
                 else
                     __OUTPUT_SUBCLASS_NAME(AcDb2dVertex)
-                for (int j = 0; j < 3; j++)
-                    o << "  " << 10 * j + 10 << "\n"
-                      << entJson["vertex"][i][j].GetDouble() << "\n";
-                if (type == "POLYLINE_2D"s)
-                    o << "  42\n"
-                      << entJson["bulge"][i].GetDouble() << "\n";
-                if (type == "POLYLINE_3D"s)
-                    o << "  70\n32\n";
+                w.groupVector3(list.polyVert(poly, iv), 10, 10);
+                if (!is3D)
+                    w.groupReal(42, list.polyBulge(poly, iv));
+                if (is3D)
+                    w.str("  70\n32\n");
                 else
-                    o << "  70\n0\n"; //! not verified
+                    w.str("  70\n0\n"); //! not verified
             }
-            o << "  0\n"
-              << "SEQEND" << "\n";
-            o << "  5 \n"
-              << hex << uppercase << entJson["seqendHandle"].GetUint64() << dec << nouppercase << "\n";
+            w.str("  0\nSEQEND\n");
+            w.str("  5 \n").handle(poly.seqendHandle);
             __OUTPUT_SUBCLASS_NAME(AcDbEntity)
-            o << "  8\n"
-              << layerJson["name"].GetString() << "\n"; // forcing to use polyline's layer
+            w.groupStr(8, layerName); // forcing to use polyline's layer
         }
-        else if (type == "LWPOLYLINE"s)
+        break;
+        case EntityType::LwPolyline:
         {
+            auto &poly = list.polylines[ent.rec];
             __OUTPUT_SUBCLASS_NAME(AcDbPolyline)
-            o << "  90\n"
-              << entJson["vertex"].Size() << "\n";
-            __OUTPUT_ENTITY_INT(flag, 70)
-            for (int64_t i = 0; i < (int64_t)entJson["vertex"].Size(); i++)
-                o << "  10\n"
-                  << entJson["vertex"][i][0].GetDouble() << "\n"
-                  << "  20\n"
-                  << entJson["vertex"][i][1].GetDouble() << "\n";
-            for (int64_t i = 0; i < (int64_t)entJson["bulge"].Size(); i++)
-                o << "  42\n"
-                  << entJson["bulge"][i].GetDouble() << "\n";
-            if (__EXTRUSION_IS_FINITE())
-                __OUTPUT_ENTITY_VECTOR3(extrusion, 210, 10)
-        }
-        else if (type == "SPLINE"s)
+            w.groupInt(90, poly.nVert);
+            w.groupInt(70, poly.flag);
+            for (int64_t iv = 0; iv < poly.nVert; iv++)
+                w.groupReal(10, list.polyVert(poly, iv)[0])
+                    .groupReal(20, list.polyVert(poly, iv)[1]);
+            for (int64_t ib = 0; ib < poly.nBulge; ib++)
+                w.groupReal(42, list.polyBulge(poly, ib));
+            if (extrusionIsFinite(poly.extrusion.data()))
+                w.groupVector3(poly.extrusion.data(), 210, 10);
+        }
+        break;
+        case EntityType::Spline:
         {
+            auto &spline = list.splines[ent.rec];
             __OUTPUT_SUBCLASS_NAME(AcDbSpline)
-            o << "  210\n0\n  220\n0\n  230\n1\n"; // cant read extrusion, where?
-            o << "  2\nANSI31\n";
-            __OUTPUT_ENTITY_INT(flag, 70) // no using splineflags
-            __OUTPUT_ENTITY_INT(degree, 71)
-            o << "  72\n"
-              << entJson["knots"].Size() << "\n";
-            o << "  73\n"
-              << entJson["ctrl_pts"].Size() << "\n";
-            o << "  74\n"
-              << entJson["fit_pts"].Size() << "\n";
-            __OUTPUT_ENTITY_DOUBLE(knot_tol, 42)
-            __OUTPUT_ENTITY_DOUBLE(ctrl_tol, 43)
-            __OUTPUT_ENTITY_DOUBLE(fit_tol, 44)
-            __OUTPUT_ENTITY_VECTOR3(beg_tan_vec, 12, 10)
-            __OUTPUT_ENTITY_VECTOR3(end_tan_vec, 13, 10)
-
-            for (int64_t i = 0; i < (int64_t)entJson["knots"].Size(); i++)
-                o << "  40\n"
-                  << entJson["knots"][i].GetDouble() << "\n";
-            for (int64_t i = 0; i < (int64_t)entJson["ctrl_pts"].Size(); i++)
-                for (int j = 0; j < 3; j++)
-                    o << "  " << 10 * j + 10 << "\n"
-                      << entJson["ctrl_pts"][i][j].GetDouble() << "\n";
-            for (int64_t i = 0; i < (int64_t)entJson["fit_pts"].Size(); i++)
-                for (int j = 0; j < 3; j++)
-                    o << "  " << 10 * j + 11 << "\n"
-                      << entJson["fit_pts"][i][j].GetDouble() << "\n";
-
-            for (int64_t i = 0; i < (int64_t)entJson["ctrl_pts"].Size(); i++)
-                o << "  " << 41 << "\n" // for weights
-                  << entJson["ctrl_pts"][i][3].GetDouble() << "\n";
-            if (__EXTRUSION_IS_FINITE())
-                __OUTPUT_ENTITY_VECTOR3(extrusion, 210, 10)
-        }
-        else if (type == "INSERT"s)
+            w.str("  210\n0\n  220\n0\n  230\n1\n"); // cant read extrusion, where?
+            w.str("  2\nANSI31\n");
+            w.groupInt(70, spline.flag); // no using splineflags
+            w.groupInt(71, spline.degree);
+            w.groupInt(72, spline.nKnot);
+            w.groupInt(73, spline.nCtrl);
+            w.groupInt(74, spline.nFit);
+            w.groupReal(42, spline.knot_tol);
+            w.groupReal(43, spline.ctrl_tol);
+            w.groupReal(44, spline.fit_tol);
+            w.groupVector3(spline.beg_tan_vec.data(), 12, 10);
+            w.groupVector3(spline.end_tan_vec.data(), 13, 10);
+
+            for (int64_t ip = 0; ip < spline.nKnot; ip++)
+                w.groupReal(40, list.splineKnot(spline, ip));
+            for (int64_t ip = 0; ip < spline.nCtrl; ip++)
+                w.groupVector3(list.splineCtrlPt(spline, ip), 10, 10);
+            for (int64_t ip = 0; ip < spline.nFit; ip++)
+                w.groupVector3(list.splineFitPt(spline, ip), 11, 10);
+
+            for (int64_t ip = 0; ip < spline.nCtrl; ip++)
+                w.groupReal(41, list.splineCtrlPt(spline, ip)[3]); // for weights
+            // extrusion is always (0 0 1), not finite
+        }
+        break;
+        case EntityType::Insert:
         {
+            auto &insert = list.inserts[ent.rec];
             __OUTPUT_SUBCLASS_NAME(AcDbBlockReference)
-            __OUTPUT_ENTITY_STRING(blockName, 2)
-            __OUTPUT_ENTITY_VECTOR3(ins_pt, 10, 10)
-            __OUTPUT_ENTITY_VECTOR3(scale, 41, 1)
-            o << "  " << 50 << "\n"
-              << entJson["rotation"].GetDouble() * 180. / pi << "\n"; //! in degree
-            __OUTPUT_ENTITY_INT(num_cols, 70)
-            __OUTPUT_ENTITY_INT(num_rows, 71)
-            __OUTPUT_ENTITY_DOUBLE(col_spacing, 44)
-            __OUTPUT_ENTITY_DOUBLE(row_spacing, 45)
-            if (__EXTRUSION_IS_FINITE())
-                __OUTPUT_ENTITY_VECTOR3(extrusion, 210, 10)
+            w.groupStr(2, insert.blockName);
+            w.groupVector3(insert.ins_pt.data(), 10, 10);
+            w.groupVector3(insert.scale.data(), 41, 1);
+            w.groupReal(50, insert.rotation * 180. / pi); //! in degree
+            w.groupInt(70, insert.num_cols);
+            w.groupInt(71, insert.num_rows);
+            w.groupReal(44, insert.col_spacing);
+            w.groupReal(45, insert.row_spacing);
+            if (extrusionIsFinite(insert.extrusion.data()))
+                w.groupVector3(insert.extrusion.data(), 210, 10);
         }
-        else
+        break;
+        default:
             throw std::out_of_range("type not implemented for dxf out");
+        }
     }
 
-    void Reader::CleanLineEntityDuplication(double eps, double lEps, int warningLevel, int deleteLevel)
+    /**
+     * @brief duplicate cleaning of one entity list, in stages so that lists and their detectors can run in parallel
+     *
+     * gather() builds the keys, detect(k) runs one of the nDetect independent detectors,
+     * report() writes the warnings to a string and apply() removes the duplicates.
+     */
+    struct LineDupClean
     {
+        static constexpr int nDetect = 7;
 
-        auto reportLine = [&](rapidjson::Value &v)
-        {
-            std::cerr << "  ";
-            std::cerr << v["handle"].GetInt64();
-            std::cerr << " LINE ";
-            std::cerr << "Start,End: ";
-            std::cerr << v["start"][0].GetDouble() << " ";
-            std::cerr << v["start"][1].GetDouble() << " ";
-            std::cerr << v["start"][2].GetDouble() << " ";
-            std::cerr << v["end"][0].GetDouble() << " ";
-            std::cerr << v["end"][1].GetDouble() << " ";
-            std::cerr << v["end"][2].GetDouble() << " ";
-            std::cerr << "\n";
-        };
-        auto reportArcOrCirc = [&](rapidjson::Value &v)
-        {
-            using namespace std::literals;
-            std::cerr << "  ";
-            std::cerr << v["handle"].GetInt64() << " ";
-            std::cerr << v["type"].GetString() << " ";
-            std::cerr << "Extrusion,Center: ";
-            std::cerr << v["extrusion"][0].GetDouble() << " ";
-            std::cerr << v["extrusion"][1].GetDouble() << " ";
-            std::cerr << v["extrusion"][2].GetDouble() << " ";
-            std::cerr << v["center"][0].GetDouble() << " ";
-            std::cerr << v["center"][1].GetDouble() << " ";
-            std::cerr << v["center"][2].GetDouble() << " ";
-            std::cerr << v["radius"].GetDouble() << " ";
-            if (v["type"].GetString() == "ARC"s)
-            {
-                std::cerr << v["start_angle"].GetDouble() << " ";
-                std::cerr << v["end_angle"].GetDouble() << " ";
-            }
-            std::cerr << "\n";
-        };
-        auto reportPoly = [&](rapidjson::Value &v)
-        {
-            using namespace std::literals;
-            std::cerr << "  ";
-            std::cerr << v["handle"].GetInt64() << " ";
-            std::cerr << v["type"].GetString() << " ";
-            std::cerr << "Start,End: ";
-            int size = v["vertex"].Size();
-            if (size)
-            {
-                std::cerr << v["vertex"][0][0].GetDouble() << " ";
-                std::cerr << v["vertex"][0][1].GetDouble() << " ";
-                std::cerr << v["vertex"][0][2].GetDouble() << " ";
-                std::cerr << v["vertex"][size - 1][0].GetDouble() << " ";
-                std::cerr << v["vertex"][size - 1][1].GetDouble() << " ";
-                std::cerr << v["vertex"][size - 1][2].GetDouble() << " ";
-            }
-            std::cerr << "\n";
-        };
-        auto cleanEntityListLines = [&](rapidjson::Value &elist, const std::string &blkName)
-        {
-            using namespace std::literals;
-            assert(elist.IsArray());
-            std::vector<int64_t> line2ListIdx;
-            t_eigenPts<6> lines;
-            std::vector<int64_t> arc2ListIdx;
-            t_eigenPts<9> arcs;
+        EntityList *elist = nullptr;
+        std::string blkName;
+        const DupSearchOptions *opts = nullptr;
+        std::array<DupSearchCounters, nDetect> counters; //* per detector, as they may run at the same time
+
+        std::vector<int64_t> line2ListIdx;
+        t_eigenPts<6> lines;
+        std::vector<int64_t> arc2ListIdx;
+        t_eigenPts<9> arcs;
+
+        std::vector<int64_t> linePoly2ListIdx;
+        t_eigenPts<6> linesPoly;
+        std::vector<int64_t> arcPoly2ListIdx;
+        t_eigenPts<9> arcsPoly;
+
+        PolylineGeomSet polySet;
+        int64_t nPoly = 0;
 
-            std::vector<int64_t> linePoly2ListIdx;
-            t_eigenPts<6> linesPoly;
-            std::vector<int64_t> arcPoly2ListIdx;
-            t_eigenPts<9> arcsPoly;
+        std::vector<int64_t> ellipse2ListIdx;
+        t_eigenPts<12> ellipses;
+        SplineGeomSet splineSet;
 
-            PolylineGeomSet polySet;
+        std::vector<std::set<int64_t>> dupPrecise;
+        std::vector<std::pair<int64_t, int64_t>> dupInclude;
+        std::vector<std::set<int64_t>> dupPreciseArc;
+        std::vector<std::pair<int64_t, int64_t>> dupIncludeArc;
+        std::vector<std::pair<int64_t, int64_t>> dupPrecisePoly;
+        std::vector<std::pair<int64_t, int64_t>> dupIncludePoly;
+        std::vector<std::pair<int64_t, int64_t>> dupPreciseArcPoly;
+        std::vector<std::pair<int64_t, int64_t>> dupIncludeArcPoly;
+        std::vector<std::set<int64_t>> dupPolyPoly;
+        std::vector<std::set<int64_t>> dupEllipse;
+        std::vector<std::set<int64_t>> dupSpline;
 
-            for (int64_t i = 0; i < elist.Size(); i++)
+        std::string warnings;
+
+        void gather();
+        void detect(int k, int nThreads = 1);
+        int64_t detectCost(int k) const;
+        void report(int warningLevel);
+        void apply(int deleteLevel);
+    };
+
+    void LineDupClean::gather()
+    {
+        for (int64_t i = 0; i < elist->size(); i++)
+        {
+            auto &ent = elist->ents[i];
+            if (ent.type == EntityType::Line)
             {
-                if (elist[i]["type"].GetString() == "LINE"s)
-                {
-                    Eigen::Vector<double, 6> lineDat;
-                    lineDat(0) = elist[i]["start"][0].GetDouble();
-                    lineDat(1) = elist[i]["start"][1].GetDouble();
-                    lineDat(2) = elist[i]["start"][2].GetDouble();
-                    lineDat(3) = elist[i]["end"][0].GetDouble();
-                    lineDat(4) = elist[i]["end"][1].GetDouble();
-                    lineDat(5) = elist[i]["end"][2].GetDouble();
-                    lines.push_back(lineDat);
-                    line2ListIdx.push_back(i);
-                }
-                if (elist[i]["type"].GetString() == "ARC"s || elist[i]["type"].GetString() == "CIRCLE"s)
+                lines.push_back(Eigen::Map<const Eigen::Vector<double, 6>>(elist->line(ent.rec)));
+                line2ListIdx.push_back(i);
+            }
+            if (ent.type == EntityType::Arc || ent.type == EntityType::Circle)
+            {
+                arcs.push_back(Eigen::Map<const Eigen::Vector<double, 9>>(elist->arc(ent.rec)));
+                arc2ListIdx.push_back(i);
+            }
+            if (ent.type == EntityType::Ellipse)
+            {
+                ellipses.push_back(Eigen::Map<const Eigen::Vector<double, 12>>(elist->ellipse(ent.rec)));
+                ellipse2ListIdx.push_back(i);
+            }
+            if (ent.type == EntityType::Spline)
+            {
+                //* fit point splines without a control net are not compared
+                auto &spline = elist->splines[ent.rec];
+                if (spline.nCtrl)
                 {
-                    Eigen::Vector<double, 9> arcDat;
-                    arcDat(0) = elist[i]["extrusion"][0].GetDouble();
-                    arcDat(1) = elist[i]["extrusion"][1].GetDouble();
-                    arcDat(2) = elist[i]["extrusion"][2].GetDouble();
-                    arcDat(3) = elist[i]["center"][0].GetDouble();
-                    arcDat(4) = elist[i]["center"][1].GetDouble();
-                    arcDat(5) = elist[i]["center"][2].GetDouble();
-                    arcDat(6) = elist[i]["radius"].GetDouble();
-                    if (elist[i]["type"].GetString() == "ARC"s)
+                    double *v = splineSet.appendSpline(i, spline.degree, spline.periodic != 0,
+                                                       spline.nCtrl, spline.nKnot);
+                    for (int64_t ip = 0; ip < spline.nCtrl; ip++)
                     {
-                        arcDat(7) = elist[i]["start_angle"].GetDouble();
-                        arcDat(8) = elist[i]["end_angle"].GetDouble();
+                        const double *c = elist->splineCtrlPt(spline, ip);
+                        v[ip * 4 + 0] = c[0], v[ip * 4 + 1] = c[1], v[ip * 4 + 2] = c[2];
+                        v[ip * 4 + 3] = spline.rational ? c[3] : 1;
                     }
-                    else
-                    {
-                        arcDat(7) = 0;
-                        arcDat(8) = 2 * pi;
-                    }
-                    arcs.push_back(arcDat);
-                    arc2ListIdx.push_back(i);
+                    for (int64_t ik = 0; ik < spline.nKnot; ik++)
+                        v[spline.nCtrl * 4 + ik] = elist->splineKnot(spline, ik);
                 }
-                if (elist[i]["type"].GetString() == "POLYLINE_2D"s || elist[i]["type"].GetString() == "POLYLINE_3D"s)
-                {
-                    Eigen::VectorXd polyVecC;
-                    polyVecC.setZero(elist[i]["vertex"].Size() * 4 + 3);
-                    Vec3 extrusion;
-                    extrusion(0) = elist[i]["extrusion"][0].GetDouble();
-                    extrusion(1) = elist[i]["extrusion"][1].GetDouble();
-                    extrusion(2) = elist[i]["extrusion"][2].GetDouble();
-                    if (elist[i]["type"].GetString() == "POLYLINE_3D"s)
-                        extrusion.setZero();
-                    polyVecC(Seq012) = extrusion;
-
-                    for (int64_t iv = 0; iv < elist[i]["vertex"].Size(); iv++)
-                    {
-                        Vec3 p0;
-                        p0(0) = elist[i]["vertex"][iv][0].GetDouble();
-                        p0(1) = elist[i]["vertex"][iv][1].GetDouble();
-                        p0(2) = elist[i]["vertex"][iv][2].GetDouble();
-                        double bulge = elist[i]["bulge"][iv].GetDouble();
-                        if (elist[i]["type"].GetString() == "POLYLINE_3D"s)
-                            bulge = 0;
-                        polyVecC(Eigen::seq(3 + iv * 4, 5 + iv * 4)) = p0;
-                        polyVecC(6 + iv * 4) = bulge;
-                    }
+            }
+            if (ent.type == EntityType::Polyline2D || ent.type == EntityType::Polyline3D ||
+                ent.type == EntityType::LwPolyline)
+            {
+                auto &poly = elist->polylines[ent.rec];
+                bool is3D = ent.type == EntityType::Polyline3D;
+                Vec3 extrusion{poly.extrusion[0], poly.extrusion[1], poly.extrusion[2]};
+                if (is3D)
+                    extrusion.setZero();
+                appendPolylineKeys(polySet, linesPoly, arcsPoly, i, elist->polyVert(poly, 0), poly.nVert,
+                                   elist->polyBulges.data() + poly.bulgeStart, is3D ? 0 : poly.nBulge,
+                                   polylineIsClosed(ent.type, poly), extrusion);
+                linePoly2ListIdx.resize(linesPoly.size(), i);
+                arcPoly2ListIdx.resize(arcsPoly.size(), i);
+                nPoly++;
+            }
+        }
+    }
 
-                    polySet.insertPoly(i, int(elist[i]["vertex"].Size()), polyVecC);
+    void LineDupClean::detect(int k, int nThreads)
+    {
+        auto *c = &counters[k];
+        switch (k)
+        {
+        case 0:
+            std::tie(dupPrecise, dupInclude) = linesDuplications(lines, 1e-8, 1e-5, nThreads, *opts, c);
+            break;
+        case 1:
+            std::tie(dupPreciseArc, dupIncludeArc) = arcsDuplications(arcs, 1e-8, nThreads, *opts, c);
+            break;
+        case 2:
+            std::tie(dupPrecisePoly, dupIncludePoly) = lineInLinesDuplications(linesPoly, lines, 1e-8, 1e-5, nThreads, *opts, c);
+            break;
+        case 3:
+            std::tie(dupPreciseArcPoly, dupIncludeArcPoly) = arcInArcsDuplications(arcsPoly, arcs, 1e-8, nThreads, *opts, c);
+            break;
+        case 4:
+            dupPolyPoly = polySet.getDuplicates(1e-8, nThreads, *opts, c);
+            break;
+        case 5:
+            dupEllipse = ellipsesDuplications(ellipses, 1e-8, nThreads, *opts, c);
+            break;
+        case 6:
+            dupSpline = splineSet.getDuplicates(1e-8, nThreads, *opts, c);
+            break;
+        default:
+            assert(false);
+        }
+    }
 
-                    for (int64_t iv = 1; iv < elist[i]["vertex"].Size(); iv++)
-                    {
-                        Vec3 p0, p1;
-                        p0(0) = elist[i]["vertex"][iv - 1][0].GetDouble();
-                        p0(1) = elist[i]["vertex"][iv - 1][1].GetDouble();
-                        p0(2) = elist[i]["vertex"][iv - 1][2].GetDouble();
-                        p1(0) = elist[i]["vertex"][iv][0].GetDouble();
-                        p1(1) = elist[i]["vertex"][iv][1].GetDouble();
-                        p1(2) = elist[i]["vertex"][iv][2].GetDouble();
-                        double bulge = elist[i]["bulge"][iv - 1].GetDouble();
-
-                        if (elist[i]["type"].GetString() == "POLYLINE_3D"s || std::abs(bulge) < 1e-6)
-                        {
-                            // TODO: if 2D, convert into OCS
-                            Eigen::Vector<double, 6> lineDat;
-                            lineDat(Seq012) = p0;
-                            lineDat(Seq345) = p1;
-                            linesPoly.push_back(lineDat);
-                            linePoly2ListIdx.push_back(i);
-                        }
-                        else
-                        {
-                            // double ctanT = std::tan(pi / 2 - std::atan(bulge) * 2);
-                            double ctanT = (1 - bulge * bulge) / (2 * bulge);
-                            Vec3 p01 = p1 - p0;
-                            Vec3 p01L = p01;
-                            p01L(0) = -p01(1);
-                            p01L(1) = p01(0);
-                            Vec3 cent = 0.5 * (p0 + p1) + p01L * 0.5 * ctanT;
-                            Vec3 pc0 = p0 - cent;
-                            Vec3 pc1 = p1 - cent;
-                            double rad = 0.5 * (pc0.norm() + pc1.norm());
-                            double t0 = angleFromXY(pc0(0), pc0(1), pc0.norm());
-                            double t1 = angleFromXY(pc1(0), pc1(1), pc1.norm());
-                            if (bulge < 0)
-                                std::swap(t0, t1);
-                            Eigen::Vector<double, 9> arcDat;
-                            arcDat(Seq012) = extrusion;
-                            arcDat(Seq345) = cent;
-                            arcDat(6) = rad;
-                            arcDat(7) = t0;
-                            arcDat(8) = t1;
-                            arcsPoly.push_back(arcDat);
-                            arcPoly2ListIdx.push_back(i);
-                        }
-                    }
-                }
+    int64_t LineDupClean::detectCost(int k) const
+    {
+        switch (k)
+        {
+        case 0:
+            return int64_t(lines.size());
+        case 1:
+            return int64_t(arcs.size());
+        case 2:
+            return int64_t(linesPoly.size() + lines.size());
+        case 3:
+            return int64_t(arcsPoly.size() + arcs.size());
+        case 4:
+            return nPoly;
+        case 5:
+            return int64_t(ellipses.size());
+        default:
+            return splineSet.size();
+        }
+    }
+
+    void LineDupClean::report(int warningLevel)
+    {
+        if (warningLevel < 1)
+            return;
+        std::ostringstream o;
+        auto reportLine = [&](const EntityList &list, int64_t i)
+        {
+            auto &ent = list.ents[i];
+            auto line = list.line(ent.rec);
+            o << "  ";
+            o << int64_t(ent.handle);
+            o << " LINE ";
+            o << "Start,End: ";
+            for (int k = 0; k < 6; k++)
+                o << line[k] << " ";
+            o << "\n";
+        };
+        auto reportArcOrCirc = [&](const EntityList &list, int64_t i)
+        {
+            auto &ent = list.ents[i];
+            auto arc = list.arc(ent.rec);
+            o << "  ";
+            o << int64_t(ent.handle) << " ";
+            o << entityTypeName(ent.type) << " ";
+            o << "Extrusion,Center: ";
+            for (int k = 0; k < 7; k++)
+                o << arc[k] << " ";
+            if (ent.type == EntityType::Arc)
+            {
+                o << arc[7] << " ";
+                o << arc[8] << " ";
             }
+            o << "\n";
+        };
+        auto reportPoly = [&](const EntityList &list, int64_t i)
+        {
+            auto &ent = list.ents[i];
+            auto &poly = list.polylines[ent.rec];
+            o << "  ";
+            o << int64_t(ent.handle) << " ";
+            o << entityTypeName(ent.type) << " ";
+            o << "Start,End: ";
+            if (poly.nVert)
+            {
+                for (int k = 0; k < 3; k++)
+                    o << list.polyVert(poly, 0)[k] << " ";
+                for (int k = 0; k < 3; k++)
+                    o << list.polyVert(poly, poly.nVert - 1)[k] << " ";
+            }
+            o << "\n";
+        };
+        auto reportEllipse = [&](const EntityList &list, int64_t i)
+        {
+            auto &ent = list.ents[i];
+            auto ellipse = list.ellipse(ent.rec);
+            o << "  ";
+            o << int64_t(ent.handle);
+            o << " ELLIPSE ";
+            o << "Center,Axis: ";
+            for (int k = 0; k < 6; k++)
+                o << ellipse[k] << " ";
+            o << ellipse[9] << " ";
+            o << ellipse[10] << " ";
+            o << ellipse[11] << " ";
+            o << "\n";
+        };
+        auto reportSpline = [&](const EntityList &list, int64_t i)
+        {
+            auto &ent = list.ents[i];
+            auto &spline = list.splines[ent.rec];
+            o << "  ";
+            o << int64_t(ent.handle);
+            o << " SPLINE ";
+            o << "Start,End: ";
+            if (spline.nCtrl)
+            {
+                for (int k = 0; k < 3; k++)
+                    o << list.splineCtrlPt(spline, 0)[k] << " ";
+                for (int k = 0; k < 3; k++)
+                    o << list.splineCtrlPt(spline, spline.nCtrl - 1)[k] << " ";
+            }
+            o << "\n";
+        };
 
-            auto [dupPrecise, dupInclude] = linesDuplications(lines, 1e-8, 1e-5);
-            auto [dupPreciseArc, dupIncludeArc] = arcsDuplications(arcs, 1e-8);
-            auto [dupPrecisePoly, dupIncludePoly] = lineInLinesDuplications(linesPoly, lines, 1e-8, 1e-5);
-            auto [dupPreciseArcPoly, dupIncludeArcPoly] = arcInArcsDuplications(arcsPoly, arcs, 1e-8);
-            auto dupPolyPoly = polySet.getDuplicates(1e-8);
-            // for (auto &v : linesPoly)
-            //     std::cout << "line " << v.transpose() << std::endl;
-            // for (auto &v : arcsPoly)
-            //     std::cout << "arcs " << v.transpose() << std::endl;
-            if (warningLevel >= 1)
+        if (warningLevel >= 1)
+        {
+            for (auto &s : dupPrecise)
             {
-                for (auto &s : dupPrecise)
-                {
-                    std::cerr << "Duplicate in block [" << blkName << "]" << "\n";
-                    for (auto ii : s)
-                        reportLine(elist[line2ListIdx[ii]]);
-                }
-                for (auto &s : dupPreciseArc)
-                {
-                    std::cerr << "Duplicate in block [" << blkName << "]" << "\n";
-                    for (auto ii : s)
-                        reportArcOrCirc(elist[arc2ListIdx[ii]]);
-                }
-                for (auto &p : dupPrecisePoly)
-                {
-                    std::cerr << "Duplicate from Poly Seg in block [" << blkName << "]" << "\n";
-                    reportLine(elist[line2ListIdx[p.second]]);
-                }
-                for (auto &p : dupPreciseArcPoly)
-                {
-                    std::cerr << "Duplicate from Poly Seg in block [" << blkName << "]" << "\n";
-                    reportArcOrCirc(elist[arc2ListIdx[p.second]]);
-                }
-                for (auto &s : dupPolyPoly)
-                {
-                    std::cerr << "Duplicate in block [" << blkName << "]" << "\n";
-                    for (auto i : s)
-                        reportPoly(elist[i]);
-                }
+                o << "Duplicate in block [" << blkName << "]" << "\n";
+                for (auto ii : s)
+                    reportLine(*elist, line2ListIdx[ii]);
             }
-            if (warningLevel >= 2)
+            for (auto &s : dupPreciseArc)
             {
-                for (auto &p : dupInclude)
-                {
-                    std::cerr << "Line Inclusion in block [" << blkName << "]" << "\n";
-                    auto i = line2ListIdx[p.first];
-                    auto j = line2ListIdx[p.second];
-                    reportLine(elist[i]);
-                    reportLine(elist[j]);
-                }
-                for (auto &p : dupIncludeArc)
-                {
-                    std::cerr << "Arc Inclusion in block [" << blkName << "]" << "\n";
-                    auto i = arc2ListIdx[p.first];
-                    auto j = arc2ListIdx[p.second];
-                    reportArcOrCirc(elist[i]);
-                    reportArcOrCirc(elist[j]);
-                }
-                for (auto &p : dupIncludePoly)
-                {
-                    std::cerr << "Line Inclusion from Poly Seg in block [" << blkName << "]" << "\n";
-                    reportLine(elist[line2ListIdx[p.second]]);
-                }
-                for (auto &p : dupIncludeArcPoly)
-                {
-                    std::cerr << "Arc Inclusion from Poly Seg in block [" << blkName << "]" << "\n";
-                    reportArcOrCirc(elist[arc2ListIdx[p.second]]);
-                }
+                o << "Duplicate in block [" << blkName << "]" << "\n";
+                for (auto ii : s)
+                    reportArcOrCirc(*elist, arc2ListIdx[ii]);
+            }
+            for (auto &p : dupPrecisePoly)
+            {
+                o << "Duplicate from Poly Seg in block [" << blkName << "]" << "\n";
+                reportLine(*elist, line2ListIdx[p.second]);
+            }
+            for (auto &p : dupPreciseArcPoly)
+            {
+                o << "Duplicate from Poly Seg in block [" << blkName << "]" << "\n";
+                reportArcOrCirc(*elist, arc2ListIdx[p.second]);
+            }
+            for (auto &s : dupPolyPoly)
+            {
+                o << "Duplicate in block [" << blkName << "]" << "\n";
+                for (auto i : s)
+                    reportPoly(*elist, i);
+            }
+            for (auto &s : dupEllipse)
+            {
+                o << "Duplicate in block [" << blkName << "]" << "\n";
+                for (auto ii : s)
+                    reportEllipse(*elist, ellipse2ListIdx[ii]);
+            }
+            for (auto &s : dupSpline)
+            {
+                o << "Duplicate in block [" << blkName << "]" << "\n";
+                for (auto i : s)
+                    reportSpline(*elist, i);
+            }
+        }
+        if (warningLevel >= 2)
+        {
+            for (auto &p : dupInclude)
+            {
+                o << "Line Inclusion in block [" << blkName << "]" << "\n";
+                auto i = line2ListIdx[p.first];
+                auto j = line2ListIdx[p.second];
+                reportLine(*elist, i);
+                reportLine(*elist, j);
+            }
+            for (auto &p : dupIncludeArc)
+            {
+                o << "Arc Inclusion in block [" << blkName << "]" << "\n";
+                auto i = arc2ListIdx[p.first];
+                auto j = arc2ListIdx[p.second];
+                reportArcOrCirc(*elist, i);
+                reportArcOrCirc(*elist, j);
+            }
+            for (auto &p : dupIncludePoly)
+            {
+                o << "Line Inclusion from Poly Seg in block [" << blkName << "]" << "\n";
+                reportLine(*elist, line2ListIdx[p.second]);
+            }
+            for (auto &p : dupIncludeArcPoly)
+            {
+                o << "Arc Inclusion from Poly Seg in block [" << blkName << "]" << "\n";
+                reportArcOrCirc(*elist, arc2ListIdx[p.second]);
             }
+        }
+        warnings = o.str();
+    }
 
-            std::set<int64_t> lineDelete;
+    void LineDupClean::apply(int deleteLevel)
+    {
+        std::set<int64_t> lineDelete;
 
-            if (deleteLevel >= 1)
+        if (deleteLevel >= 1)
+        {
+            for (auto &s : dupPrecise)
             {
-                for (auto &s : dupPrecise)
-                {
-                    assert(s.size());
-                    auto s0 = *s.begin();
-                    for (auto ii : s)
-                        if (ii != s0)
-                            lineDelete.insert(line2ListIdx[ii]);
-                }
-                for (auto &s : dupPreciseArc)
-                {
-                    assert(s.size());
-                    auto s0 = *s.begin();
-                    for (auto ii : s)
-                        if (ii != s0)
-                            lineDelete.insert(arc2ListIdx[ii]);
-                }
-                for (auto &p : dupPrecisePoly)
-                    lineDelete.insert(line2ListIdx[p.second]);
-                for (auto &p : dupPreciseArcPoly)
-                    lineDelete.insert(arc2ListIdx[p.second]);
-                for (auto &s : dupPolyPoly)
-                {
-                    assert(s.size());
-                    auto s0 = *s.begin();
-                    for (auto i : s)
-                        if (i != s0)
-                            lineDelete.insert(i);
-                }
+                assert(s.size());
+                auto s0 = *s.begin();
+                for (auto ii : s)
+                    if (ii != s0)
+                        lineDelete.insert(line2ListIdx[ii]);
+            }
+            for (auto &s : dupPreciseArc)
+            {
+                assert(s.size());
+                auto s0 = *s.begin();
+                for (auto ii : s)
+                    if (ii != s0)
+                        lineDelete.insert(arc2ListIdx[ii]);
             }
-            if (deleteLevel >= 2)
+            for (auto &p : dupPrecisePoly)
+                lineDelete.insert(line2ListIdx[p.second]);
+            for (auto &p : dupPreciseArcPoly)
+                lineDelete.insert(arc2ListIdx[p.second]);
+            for (auto &s : dupPolyPoly)
             {
-                for (auto &p : dupInclude)
-                    if (!lineDelete.count(line2ListIdx[p.first]))
-                        lineDelete.insert(line2ListIdx[p.second]);
-                for (auto &p : dupIncludeArc)
-                    if (!lineDelete.count(arc2ListIdx[p.first]))
-                        lineDelete.insert(arc2ListIdx[p.second]);
-                for (auto &p : dupIncludePoly)
+                assert(s.size());
+                auto s0 = *s.begin();
+                for (auto i : s)
+                    if (i != s0)
+                        lineDelete.insert(i);
+            }
+            for (auto &s : dupEllipse)
+            {
+                assert(s.size());
+                auto s0 = *s.begin();
+                for (auto ii : s)
+                    if (ii != s0)
+                        lineDelete.insert(ellipse2ListIdx[ii]);
+            }
+            for (auto &s : dupSpline)
+            {
+                assert(s.size());
+                auto s0 = *s.begin();
+                for (auto i : s)
+                    if (i != s0)
+                        lineDelete.insert(i);
+            }
+        }
+        if (deleteLevel >= 2)
+        {
+            for (auto &p : dupInclude)
+                if (!lineDelete.count(line2ListIdx[p.first]))
                     lineDelete.insert(line2ListIdx[p.second]);
-                for (auto &p : dupIncludeArcPoly)
+            for (auto &p : dupIncludeArc)
+                if (!lineDelete.count(arc2ListIdx[p.first]))
                     lineDelete.insert(arc2ListIdx[p.second]);
+            for (auto &p : dupIncludePoly)
+                lineDelete.insert(line2ListIdx[p.second]);
+            for (auto &p : dupIncludeArcPoly)
+                lineDelete.insert(arc2ListIdx[p.second]);
+        }
+
+        elist->removeEntities(lineDelete);
+    }
+
+    void Reader::CleanLineEntityDuplication(double eps, double lEps, int warningLevel, int deleteLevel)
+    {
+        WindowBatch lists;
+        TraverseEntityLists(
+            [&](EntityList &list, const std::string &blkName, EntitySpaceType space)
+            {
+                lists.emplace_back(&list, blkName);
+            });
+        CleanLineEntityDuplication(lists, eps, lEps, warningLevel, deleteLevel);
+    }
+
+    void Reader::CleanLineEntityDuplication(EntityList &elist, const std::string &blkName,
+                                            double eps, double lEps, int warningLevel, int deleteLevel)
+    {
+        CleanLineEntityDuplication({{&elist, blkName}}, eps, lEps, warningLevel, deleteLevel);
+    }
+
+    void Reader::CleanLineEntityDuplication(const WindowBatch &lists,
+                                            double eps, double lEps, int warningLevel, int deleteLevel)
+    {
+        std::vector<LineDupClean> cleans(lists.size());
+        ParallelFor(
+            int64_t(lists.size()), nThreads,
+            [&](int64_t i)
+            {
+                cleans[i].elist = lists[i].first;
+                cleans[i].blkName = lists[i].second;
+                cleans[i].opts = &dupSearchOptions;
+                cleans[i].gather();
+            });
+
+        //* every (list, detector) pair is a task, so a large model space spreads over nDetect threads
+        std::vector<int64_t> order, cost;
+        int64_t costSum = 0;
+        for (int64_t i = 0; i < int64_t(cleans.size()); i++)
+            for (int k = 0; k < LineDupClean::nDetect; k++)
+            {
+                int64_t c = cleans[i].detectCost(k);
+                cost.push_back(c);
+                costSum += c;
+                if (c)
+                    order.push_back(i * LineDupClean::nDetect + k);
             }
+        std::stable_sort(order.begin(), order.end(),
+                         [&](int64_t a, int64_t b)
+                         { return cost[a] > cost[b]; });
 
-            rapidjson::Value newList(rapidjson::kArrayType);
-            for (int64_t i = 0; i < elist.Size(); i++)
-                if (lineDelete.count(i) == 0)
-                    newList.PushBack(std::move(elist[i]), doc.GetAllocator());
-            elist = std::move(newList);
-        };
+        //* a task worth a thread's whole share runs alone with threaded index builds and queries,
+        //* the rest share the threads one task each; the results do not depend on the split
+        int nThreadsAll = ResolveThreadCount(nThreads);
+        std::vector<int64_t> orderSmall;
+        for (auto t : order)
+            if (nThreadsAll > 1 && cost[t] >= 4096 && cost[t] * nThreadsAll >= costSum)
+                cleans[t / LineDupClean::nDetect].detect(int(t % LineDupClean::nDetect), nThreadsAll);
+            else
+                orderSmall.push_back(t);
+        ParallelForOrdered(
+            orderSmall, nThreads,
+            [&](int64_t t)
+            { cleans[t / LineDupClean::nDetect].detect(int(t % LineDupClean::nDetect)); });
+
+        ParallelFor(
+            int64_t(cleans.size()), nThreads,
+            [&](int64_t i)
+            {
+                cleans[i].report(warningLevel);
+                cleans[i].apply(deleteLevel);
+            });
 
-        cleanEntityListLines(doc["modelSpaceEntities"], "modelSpace");
-        for (auto it = doc["blocks"].MemberBegin(); it != doc["blocks"].MemberEnd(); ++it)
+        //* warnings in list order whatever the thread count
+        for (auto &clean : cleans)
         {
-            cleanEntityListLines(it->value["entities"], it->value["name"].GetString());
+            std::cerr << clean.warnings;
+            for (auto &c : clean.counters)
+                dupSearchCounters += c;
         }
     }
-}
\ No newline at end of file
+}
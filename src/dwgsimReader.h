@@ -1,18 +1,23 @@
 #pragma once
 
 #include "dwgsimDefs.h"
+#include "entityType.h"
+#include "entityStore.h"
+#include "dxfWriter.h"
+#include "splineFitCache.h"
+#include "onlineDupFilter.h"
+#include "dupSearchOptions.h"
 
-#include <rapidjson/rapidjson.h>
-#include <rapidjson/document.h>
-#include <rapidjson/ostreamwrapper.h>
-#include <rapidjson/writer.h>
-#include <rapidjson/prettywriter.h>
 #include <dwg_api.h>
 
 #include <set>
+#include <map>
 #include <unordered_map>
 #include <string>
 #include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
 
 namespace DwgSim
 {
@@ -28,68 +33,54 @@ namespace DwgSim
         BlockSpace = 2,
     };
 
-    using ObjectName = std::string;
-
-    const struct __ObjNameMapping
-    {
-        std::unordered_map<Dwg_Object_Type, ObjectName> map;
-        __ObjNameMapping()
-        {
-#define __MAP_DWG_TYPE(NAME) map[DWG_TYPE_##NAME] = #NAME;
-
-            __MAP_DWG_TYPE(BLOCK)
-            __MAP_DWG_TYPE(LINE)
-            __MAP_DWG_TYPE(ARC)
-            __MAP_DWG_TYPE(SPLINE)
-            __MAP_DWG_TYPE(CIRCLE)
-            __MAP_DWG_TYPE(ELLIPSE)
-            __MAP_DWG_TYPE(LWPOLYLINE)
-            __MAP_DWG_TYPE(POLYLINE_2D)
-            __MAP_DWG_TYPE(POLYLINE_3D)
-            __MAP_DWG_TYPE(MTEXT)
-            __MAP_DWG_TYPE(HATCH)
-            __MAP_DWG_TYPE(DIMENSION_LINEAR)
-            __MAP_DWG_TYPE(DIMENSION_ALIGNED)
-            __MAP_DWG_TYPE(INSERT)
-            __MAP_DWG_TYPE(POINT)
-            __MAP_DWG_TYPE(SOLID)
-            __MAP_DWG_TYPE(ATTDEF)
-
-#undef __MAP_DWG_TYPE
-        }
-    } objNameMapping;
-
-    const struct __ObjName2DxfNameMapping
+    /**
+     * @brief entry of the layer table, everything resolved when the Reader is constructed
+     */
+    struct LayerRecord
     {
-        std::unordered_map<ObjectName, ObjectName> map;
-        __ObjName2DxfNameMapping()
-        {
-#define __MAP_NAME(NAME) map[#NAME] = #NAME;
-            __MAP_NAME(LINE)
-            __MAP_NAME(ARC)
-            __MAP_NAME(CIRCLE)
-            __MAP_NAME(ELLIPSE)
-            __MAP_NAME(SPLINE)
-            __MAP_NAME(LWPOLYLINE)
-            map["POLYLINE_2D"] = "POLYLINE";
-            map["POLYLINE_3D"] = "POLYLINE";
-            __MAP_NAME(INSERT)
-#undef __MAP_NAME
-        }
-    } objName2DxfNameMapping;
+        BITCODE_RLL handle = 0;
+        bool used = false; //* referenced by a collected entity
+        std::string name;
+        int flag = 0;
+        int plotflag = 0;
+        int linewt = 0;
+        std::string ltypeName;
+        int colorIndex = 0;
+    };
 
-    struct LayerRecord
+    struct BlockRecord
     {
-        size_t readId = 0;
+        uint64_t id = 0;
+        uint64_t endBlkId = 0;
+        uint32_t flag = 0;
+        int blkisxref = 0;
         std::string name;
+        std::array<double, 3> base_pt{0, 0, 0};
+        EntityList entities;
     };
 
+    //* entity lists with their block names, as the streamed outputs hand them to processing
+    using WindowBatch = std::vector<std::pair<EntityList *, std::string>>;
+
     class Reader
     {
-        rapidjson::Document doc;
         Dwg_Data dwg;
         int dwgError{0};
-        std::map<BITCODE_RLL, LayerRecord> layerNames;
+        std::vector<LayerRecord> layers;                        //* layer table, indexed by compact layer id
+        std::unordered_map<BITCODE_RLL, uint32_t> layerIndex; //* layer handle -> compact layer id
+        std::vector<uint32_t> layerOrder;                      //* compact layer ids in order of first use
+
+        EntityList modelSpace;
+        std::vector<BlockRecord> blocks;        //* blocks with entities, in traversal order
+        std::unordered_map<uint64_t, size_t> blockIndex; //* block handle -> index in blocks
+
+        int nThreads{1};
+        SplineFitCache splineFitCache; //* fits shared by all spline reforms of this Reader
+        bool dupOnline{false};
+        int64_t nDupOnlineRejected{0};
+        int64_t streamBatchEntities{65536};
+        DupSearchOptions dupSearchOptions;   //* for every duplicate cleaning of this Reader
+        DupSearchCounters dupSearchCounters; //* summed over them
 
     public:
         Reader(const std::string &filename_in)
@@ -102,106 +93,147 @@ namespace DwgSim
                 throw std::runtime_error("dwg file read and decode error");
             }
             // dwg_api_init_version(&dwg);
-            doc.SetObject();
+            buildLayerTable();
         }
 
-        void PrintDoc(std::ostream &o, int nIndent = 0)
-        {
-            rapidjson::OStreamWrapper osw(o);
-            if (nIndent)
-            {
-                rapidjson::PrettyWriter<rapidjson::OStreamWrapper> writer(osw);
-                writer.SetIndent(' ', nIndent);
-                doc.Accept(writer);
-            }
-            else
-            {
-                rapidjson::Writer<rapidjson::OStreamWrapper> writer(osw);
-                doc.Accept(writer);
-            }
-        }
+        void PrintDoc(std::ostream &o, int nIndent = 0);
 
         void PrintDocDXF(std::ostream &o);
 
-        void recordLayerName(dwg_obj_ent *entGen)
+        /**
+         * @brief DXF output straight from the dwg traversal, one block window at a time,
+         * same output as collecting everything and calling PrintDocDXF
+         */
+        void PrintDocDXFStream(std::ostream &o, const std::function<void(const WindowBatch &)> &processWindows);
+
+        void outHeaderDXF(DxfWriter &w);
+
+        void outBlockDXF(DxfWriter &w, const BlockRecord &block);
+
+        uint32_t addLayer(Dwg_Object *layerObj)
         {
-            auto layerId = entGen->layer->absolute_ref;
-            if (layerNames.count(layerId))
-                return;
             int err{0};
-            std::string layer_name_str;
+            LayerRecord rec;
+            rec.handle = layerObj->handle.value;
             {
-                auto layer_name = dwg_ent_get_layer_name(entGen, &err);
+                auto layer_name = dwg_obj_table_get_name(layerObj, &err);
                 if (err)
-                    throw field_query_error("dwg_ent_get_layer_name failed");
+                    throw field_query_error("dwg_obj_table_get_name failed");
                 if (layer_name)
-                    layer_name_str = layer_name;
+                    rec.name = layer_name;
                 else
-                    layer_name_str = "UNKNOWN_LAYER";
+                    rec.name = "UNKNOWN_LAYER";
                 if (layer_name)
-                    if (IS_FROM_TU_DWG((&dwg)) && std::string(layer_name) != "0") //!
+                    if (IS_FROM_TU_DWG((&dwg))) //!
                         free(layer_name);
             }
-            layerNames[layerId] = LayerRecord{layerNames.size(), layer_name_str};
-
-            //* also fill the json
-
-            auto &alloc = doc.GetAllocator();
-            if (!doc.HasMember("layers"))
-                doc.AddMember("layers", rapidjson::Value(rapidjson::kObjectType), alloc);
-
-            {
-                rapidjson::Value layerIdStr;
-                layerIdStr.SetString(std::to_string(layerId).c_str(), alloc);
-                doc["layers"].AddMember(layerIdStr, rapidjson::Value(rapidjson::kObjectType), alloc);
-            }
-            auto &layerJson = doc["layers"][std::to_string(layerId).c_str()];
 
-            auto layer = dwg_object_to_LAYER(entGen->layer->obj);
-            {
-                rapidjson::Value tmpStr;
-                tmpStr.SetString(layer_name_str.c_str(), alloc);
-                layerJson.AddMember("name", tmpStr, alloc);
-            }
-            layerJson.AddMember("flag", layer->flag, alloc);
-            layerJson.AddMember("plotflag", layer->plotflag, alloc);
-            layerJson.AddMember("linewt", layer->linewt, alloc);
-            layerJson.AddMember("ltype", rapidjson::Value(rapidjson::kObjectType), alloc);
-            std::string ltype_name_str;
+            auto layer = dwg_object_to_LAYER(layerObj);
+            rec.flag = layer->flag;
+            rec.plotflag = layer->plotflag;
+            rec.linewt = layer->linewt;
             {
                 auto ltype_name = dwg_obj_table_get_name(layer->ltype->obj, &err);
                 if (err)
-                    throw field_query_error("dwg_ent_get_layer_name failed");
+                    throw field_query_error("dwg_obj_table_get_name failed");
                 if (ltype_name)
-                    ltype_name_str = ltype_name;
+                    rec.ltypeName = ltype_name;
                 else
-                    ltype_name_str = "UNKNOWN_LTYPE";
+                    rec.ltypeName = "UNKNOWN_LTYPE";
                 if (ltype_name)
                     if (IS_FROM_TU_DWG((&dwg))) //!
                         free(ltype_name);
+            }
+            rec.colorIndex = (int)layer->color.index;
 
-                auto ltype = dwg_object_to_LTYPE(layer->ltype->obj);
+            uint32_t id = uint32_t(layers.size());
+            layerIndex[rec.handle] = id;
+            layers.push_back(std::move(rec));
+            return id;
+        }
 
-                {
-                    rapidjson::Value tmpStr;
-                    tmpStr.SetString(ltype_name_str.c_str(), alloc);
-                    layerJson["ltype"].AddMember("name", tmpStr, alloc);
-                }
+        /**
+         * @brief enumerates the LAYER control table once
+         */
+        void buildLayerTable()
+        {
+            layers.clear();
+            layerIndex.clear();
+            layerOrder.clear();
+            auto ctrlRef = dwg.header_vars.LAYER_CONTROL_OBJECT;
+            if (!ctrlRef || !ctrlRef->obj)
+                return;
+            auto layer_control = dwg_object_to_LAYER_CONTROL(ctrlRef->obj);
+            layers.reserve(layer_control->num_entries);
+            for (int i = 0; i < layer_control->num_entries; i++)
+            {
+                auto ref = layer_control->entries[i];
+                if (ref && ref->obj && !layerIndex.count(ref->obj->handle.value))
+                    addLayer(ref->obj);
             }
-            layerJson.AddMember("color", rapidjson::Value(rapidjson::kObjectType), alloc);
+        }
+
+        /**
+         * @brief compact layer id of the entity, marks the layer as used
+         */
+        uint32_t recordLayer(dwg_obj_ent *entGen)
+        {
+            auto found = layerIndex.find(entGen->layer->absolute_ref);
+            uint32_t id = found != layerIndex.end()
+                              ? found->second
+                              : addLayer(entGen->layer->obj); // not listed in the control table
+            auto &layer = layers[id];
+            if (!layer.used)
             {
-                auto &colorJson = layerJson["color"];
-                colorJson.AddMember("index", (int)layer->color.index, alloc);
+                layer.used = true;
+                layerOrder.push_back(id);
             }
+            return id;
         }
 
         void TraverseEntities(std::function<void(Dwg_Object *, EntitySpaceType)> process_object);
 
-        void TraverseEntitiesInSpace(
-            std::function<void(Dwg_Object *, Dwg_Object *, const ObjectName &, Dwg_Object_Type)> process_object,
-            EntitySpaceType space);
+        /**
+         * @brief calls process_object(blk_obj, obj, EntityType) for each handled entity owned by the block header
+         *
+         * @tparam F any callable, inlined instead of going through std::function
+         */
+        template <class F>
+        void TraverseEntitiesInBlockHeader(Dwg_Object_Ref *ref, F &&process_object)
+        {
+            if (!ref || !ref->obj)
+                return;
+            Dwg_Object *obj = get_first_owned_entity(ref->obj);
+            while (obj)
+            {
+                if (!obj || !obj->parent)
+                    throw std::runtime_error("obj not valid");
+                uint32_t type = obj->fixedtype;
+                EntityType eType = toEntityType(type);
+                if (eType != EntityType::Unknown)
+                    process_object(ref->obj, obj, eType);
+                else if (type < DWG_TYPE_ACDSRECORD)
+                    throw unhandled_class_error("DWG Class: " + std::to_string(type));
+                obj = get_next_owned_entity(ref->obj, obj);
+            }
+        }
+
+        template <class F>
+        void TraverseEntitiesInSpace(F &&process_object, EntitySpaceType space)
+        {
+            if (space == ModelSpace)
+                TraverseEntitiesInBlockHeader(dwg_model_space_ref(&dwg), process_object);
+            if (space == PaperSpace)
+                TraverseEntitiesInBlockHeader(dwg_paper_space_ref(&dwg), process_object);
+            if (space == BlockSpace)
+            {
+                Dwg_Object_BLOCK_CONTROL *block_control = dwg_block_control(&dwg);
+                for (int i = 0; i < block_control->num_entries; i++)
+                    TraverseEntitiesInBlockHeader(block_control->entries[i], process_object);
+            }
+        }
 
-        void TraverseDocEntities(std::function<void(rapidjson::Value &, EntitySpaceType)> processEntityJSON);
+        void TraverseEntityLists(std::function<void(EntityList &, const std::string &, EntitySpaceType)> processList);
 
         void DebugPrint()
         {
@@ -218,8 +250,8 @@ namespace DwgSim
                     if (!obj || !obj->parent)
                         throw std::runtime_error("obj not valid");
                     uint32_t type = obj->fixedtype;
-                    if (objNameMapping.map.count((Dwg_Object_Type)type))
-                        printOne(objNameMapping.map.at((Dwg_Object_Type)type));
+                    if (toEntityType(type) != EntityType::Unknown)
+                        printOne(entityTypeName(toEntityType(type)));
                     else
                     {
                         if (type >= DWG_TYPE_ACDSRECORD)
@@ -236,17 +268,17 @@ namespace DwgSim
         void DebugPrint1()
         {
             TraverseEntitiesInSpace(
-                [&](Dwg_Object *blk_obj, Dwg_Object *obj, const ObjectName &name, Dwg_Object_Type type)
+                [&](Dwg_Object *blk_obj, Dwg_Object *obj, EntityType type)
                 {
                     int err{0};
                     auto entGen = dwg_object_to_entity(obj, &err);
                     if (err)
                         throw field_query_error("dwg_object_to_entity failed");
-                    recordLayerName(entGen);
-                    if (type == DWG_TYPE_LINE)
+                    auto layerId = recordLayer(entGen);
+                    if (type == EntityType::Line)
                     {
                         auto ent = dwg_object_to_LINE(obj);
-                        std::cout << layerNames.at(entGen->layer->absolute_ref).name << std::endl;
+                        std::cout << layers[layerId].name << std::endl;
                         std::cout << ent->start.x << "," << ent->start.y << "," << ent->start.z << ", ";
                         std::cout << ent->end.x << "," << ent->end.y << "," << ent->end.z << std::endl;
                     }
@@ -256,87 +288,178 @@ namespace DwgSim
 
         void CollectModelSpaceEntities()
         {
+            modelSpace.clear();
+            OnlineDupFilter dupFilter;
+            auto process_object = [&](Dwg_Object *blk_obj, Dwg_Object *obj, EntityType type)
             {
-                rapidjson::Value modelSpaceArr(rapidjson::kArrayType);
-                doc.AddMember("modelSpaceEntities", modelSpaceArr, doc.GetAllocator());
-            }
-            auto &modelSpaceArr = doc["modelSpaceEntities"];
-            auto process_object = [&](Dwg_Object *blk_obj, Dwg_Object *obj, const ObjectName &name, Dwg_Object_Type type)
-            {
-                rapidjson::Value entJson(rapidjson::kObjectType);
-                fillEntityJson(obj, name, type, entJson);
-                modelSpaceArr.PushBack(entJson, doc.GetAllocator());
+                fillEntity(obj, type, modelSpace, dupOnline ? &dupFilter : nullptr);
             };
             TraverseEntitiesInSpace(process_object, ModelSpace);
         }
 
-        void CollectBlockSpaceEntities()
+        void fillBlockRecord(Dwg_Object *blk_obj, BlockRecord &block)
+        {
+            int err{0};
+            auto block_hdr = dwg_object_to_BLOCK_HEADER(blk_obj);
+            block.blkisxref = block_hdr->blkisxref;
+            block.id = blk_obj->handle.value;
+            block.endBlkId = block_hdr->endblk_entity->absolute_ref;
+            uint32_t blk_flag = 0;
+            blk_flag |= block_hdr->anonymous ? (1 << 0) : 0;
+            blk_flag |= block_hdr->hasattrs ? (1 << 1) : 0;
+            blk_flag |= block_hdr->blkisxref ? (1 << 2) : 0;
+            blk_flag |= block_hdr->xrefoverlaid ? (1 << 3) : 0;
+            // ! extracted from libredwg logic
+            block.flag = blk_flag;
+            char *blockName = dwg_obj_block_header_get_name(block_hdr, &err);
+            block.name = blockName;
+            if (IS_FROM_TU_DWG((&dwg)))
+                free(blockName);
+            block.base_pt = {block_hdr->base_pt.x, block_hdr->base_pt.y, block_hdr->base_pt.z};
+        }
+
+        /**
+         * @brief the record of the block owning blk_obj, created on first use
+         */
+        BlockRecord &findOrAddBlock(Dwg_Object *blk_obj)
         {
+            auto [it, inserted] = blockIndex.try_emplace(blk_obj->handle.value, blocks.size());
+            if (inserted)
             {
-                rapidjson::Value blocks(rapidjson::kObjectType);
-                doc.AddMember("blocks", blocks, doc.GetAllocator());
+                blocks.emplace_back();
+                fillBlockRecord(blk_obj, blocks.back());
             }
-            auto &blocks = doc["blocks"];
+            return blocks[it->second];
+        }
+
+        void CollectBlockSpaceEntities()
+        {
+            blocks.clear();
+            blockIndex.clear();
 
-            auto process_object = [&](Dwg_Object *blk_obj, Dwg_Object *obj, const ObjectName &name, Dwg_Object_Type type)
+            Dwg_Object_BLOCK_CONTROL *block_control = dwg_block_control(&dwg);
+            blocks.reserve(block_control->num_entries);
+            blockIndex.reserve(block_control->num_entries);
+            for (int i = 0; i < block_control->num_entries; i++)
             {
-                int err{0};
-                auto blk_id = blk_obj->handle.value;
-                auto blk_id_name = std::to_string(blk_id);
-                if (!blocks.HasMember(blk_id_name.c_str()))
-                {
-                    rapidjson::Value blk_id_nameJson;
-                    blk_id_nameJson.SetString(blk_id_name.c_str(), doc.GetAllocator());
-                    blocks.AddMember(blk_id_nameJson, rapidjson::Value(rapidjson::kObjectType), doc.GetAllocator());
-                    auto &blockJson = blocks[blk_id_name.c_str()];
-                    auto block_hdr = dwg_object_to_BLOCK_HEADER(blk_obj);
-                    blockJson.AddMember("blkisxref", block_hdr->blkisxref, doc.GetAllocator());
-                    blockJson.AddMember("id", blk_id, doc.GetAllocator());
-                    blockJson.AddMember("endBlkId", block_hdr->endblk_entity->absolute_ref, doc.GetAllocator());
-                    uint32_t blk_flag = 0;
-                    blk_flag |= block_hdr->anonymous ? (1 << 0) : 0;
-                    blk_flag |= block_hdr->hasattrs ? (1 << 1) : 0;
-                    blk_flag |= block_hdr->blkisxref ? (1 << 2) : 0;
-                    blk_flag |= block_hdr->xrefoverlaid ? (1 << 3) : 0;
-                    // ! extracted from libredwg logic
-                    blockJson.AddMember("flag", blk_flag, doc.GetAllocator());
-                    char *blockName = dwg_obj_block_header_get_name(block_hdr, &err);
+                //* block record resolved once per BLOCK_HEADER, blocks without entities get none
+                EntityList *entities = nullptr;
+                OnlineDupFilter dupFilter;
+                TraverseEntitiesInBlockHeader(
+                    block_control->entries[i],
+                    [&](Dwg_Object *blk_obj, Dwg_Object *obj, EntityType type)
                     {
-                        rapidjson::Value strJson;
-                        strJson.SetString((blockName), ((int)std::strlen(blockName)), doc.GetAllocator());
-                        blockJson.AddMember("name", strJson, doc.GetAllocator());
-                    }
-                    if (IS_FROM_TU_DWG((&dwg)))
-                        free(blockName);
-                    {
-                        rapidjson::Value base_pt(rapidjson::kArrayType);
-                        base_pt.Reserve(3, doc.GetAllocator());
-                        base_pt.PushBack(block_hdr->base_pt.x, doc.GetAllocator());
-                        base_pt.PushBack(block_hdr->base_pt.y, doc.GetAllocator());
-                        base_pt.PushBack(block_hdr->base_pt.z, doc.GetAllocator());
-                        blockJson.AddMember("base_pt", base_pt, doc.GetAllocator());
-                    }
+                        if (!entities)
+                            entities = &findOrAddBlock(blk_obj).entities;
+                        fillEntity(obj, type, *entities, dupOnline ? &dupFilter : nullptr);
+                    });
+            }
+        }
 
-                    blockJson.AddMember("entities", rapidjson::kArrayType, doc.GetAllocator());
-                }
-                auto &blockJson = blocks[blk_id_name.c_str()];
-                auto &blockEntJson = blockJson["entities"];
+        /**
+         * @brief collects model space into a window list, calls consume, then frees the window
+         */
+        void StreamModelSpace(const std::function<void(EntityList &)> &consume);
 
-                rapidjson::Value entJson(rapidjson::kObjectType);
-                fillEntityJson(obj, name, type, entJson);
-                blockEntJson.PushBack(entJson, doc.GetAllocator());
-            };
-            TraverseEntitiesInSpace(process_object, BlockSpace);
-        }
+        /**
+         * @brief collects one block at a time, calls consume on each, then frees it;
+         * keeps only one block of entities in memory. A BLOCK_HEADER listed twice is one block, as in CollectBlockSpaceEntities
+         */
+        void StreamBlocks(const std::function<void(BlockRecord &)> &consume);
+
+        /**
+         * @brief StreamBlocks, with the blocks handed to consume in batches of about streamBatchEntities entities,
+         * so that a batch can be processed in parallel; a larger block is a batch of its own
+         */
+        void StreamBlockBatches(const std::function<void(std::vector<BlockRecord> &)> &consume);
 
         void ReformSplines();
 
-        void fillEntityJson(Dwg_Object *obj, const ObjectName &name, Dwg_Object_Type type, rapidjson::Value &entJson);
+        void ReformSplines(EntityList &list);
+
+        /**
+         * @brief fits the splines of all lists on nThreads threads, results identical to a serial run
+         */
+        void ReformSplines(const std::vector<EntityList *> &lists);
+
+        /**
+         * @brief adds the fits saved by SaveSplineFitCache, e.g. from a run on a related drawing;
+         * a missing file is an empty cache, an unreadable one only gives a warning
+         */
+        void LoadSplineFitCache(const std::string &path);
+
+        void SaveSplineFitCache(const std::string &path) const;
+
+        const SplineFitCache &GetSplineFitCache() const { return splineFitCache; }
+
+        /**
+         * @brief threads used by the per-entity stages, <= 0 for all hardware threads
+         */
+        void SetThreads(int n) { nThreads = n; }
+
+        /**
+         * @brief if on, every collection (whole document or streamed) drops LINE, ARC, CIRCLE and POLYLINE_2D/3D entities
+         * that are exact copies of an earlier one in the same block, see OnlineDupFilter;
+         * the dropped copies never reach CleanLineEntityDuplication, so its warnings do not list them
+         */
+        void SetOnlineDedup(bool on) { dupOnline = on; }
+
+        int64_t GetOnlineDedupRejected() const { return nDupOnlineRejected; }
+
+        /**
+         * @brief entities per batch of blocks in the streamed outputs, which bounds their memory; 1 for one block at a time
+         */
+        void SetStreamBatch(int64_t nEntities) { streamBatchEntities = nEntities; }
 
-        void outEntityDXF(std::ostream &o, rapidjson::Value &entJso);
+        void SetDupSearchOptions(const DupSearchOptions &opts) { dupSearchOptions = opts; }
+
+        /**
+         * @brief the paths taken by the duplicate searches of all CleanLineEntityDuplication calls so far
+         */
+        const DupSearchCounters &GetDupSearchCounters() const { return dupSearchCounters; }
+
+        /**
+         * @brief appends the entity to list; with a dupFilter, exact duplicates are dropped again right away
+         */
+        void fillEntity(Dwg_Object *obj, EntityType type, EntityList &list, OnlineDupFilter *dupFilter = nullptr);
+
+        template <class TWriter>
+        void writeDocJSON(TWriter &w);
+
+        template <class TWriter>
+        void streamDocJSON(TWriter &w, const std::function<void(const WindowBatch &)> &processWindows);
+
+        template <class TWriter>
+        void writeLayersJSON(TWriter &w);
+
+        template <class TWriter>
+        void writeBlockJSON(TWriter &w, const BlockRecord &block);
+
+        template <class TWriter>
+        void writeEntityJSON(TWriter &w, const EntityList &list, int64_t i);
+
+        /**
+         * @brief JSON output without building the whole store:
+         * model space, then the blocks in batches (StreamBlockBatches), are collected, passed to processWindows
+         * (spline reform, dedup ...), written and freed before the next batch.
+         * "layers" comes last as it is only complete after all windows.
+         */
+        void PrintDocStream(std::ostream &o, int nIndent, const std::function<void(const WindowBatch &)> &processWindows);
+
+        void outEntityDXF(DxfWriter &w, const EntityList &list, int64_t i);
 
         void CleanLineEntityDuplication(double eps, double lEps, int warningLevel = 0, int deleteLevel = 0);
 
+        void CleanLineEntityDuplication(EntityList &list, const std::string &blkName,
+                                        double eps, double lEps, int warningLevel = 0, int deleteLevel = 0);
+
+        /**
+         * @brief cleans the lists (with their block names) on nThreads threads;
+         * warnings are written in list order, the same for any thread count
+         */
+        void CleanLineEntityDuplication(const WindowBatch &lists,
+                                        double eps, double lEps, int warningLevel = 0, int deleteLevel = 0);
+
         ~Reader()
         {
             dwg_free(&dwg);
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+namespace DwgSim
+{
+    namespace detail
+    {
+        /**
+         * @brief "000102...FEFF", two uppercase hex digits for each byte value
+         */
+        constexpr std::array<char, 512> makeHexPairs()
+        {
+            std::array<char, 512> ret{};
+            const char digits[] = "0123456789ABCDEF";
+            for (int i = 0; i < 256; i++)
+            {
+                ret[i * 2] = digits[i >> 4];
+                ret[i * 2 + 1] = digits[i & 15];
+            }
+            return ret;
+        }
+
+        inline constexpr std::array<char, 512> hexPairs = makeHexPairs();
+    }
+
+    /**
+     * @brief buffered writer of DXF group code / value lines
+     *
+     * Text goes into a large chunk that is handed to the ostream with a single write when full.
+     * Doubles are the shortest round-trip form of std::to_chars, handles are uppercase hex.
+     * The chunk is flushed on destruction.
+     */
+    class DxfWriter
+    {
+        std::ostream &o;
+        std::vector<char> buf;
+        size_t n = 0;
+
+        //* large enough for any number with its line end
+        static constexpr size_t maxNumberLen = 64;
+
+        char *reserve(size_t len)
+        {
+            if (n + len > buf.size())
+                flush();
+            return buf.data() + n;
+        }
+
+    public:
+        static constexpr size_t defaultChunkSize = size_t(1) << 20;
+
+        explicit DxfWriter(std::ostream &nO, size_t chunkSize = defaultChunkSize)
+            : o(nO), buf(std::max(chunkSize, maxNumberLen * 4)) {}
+
+        DxfWriter(const DxfWriter &) = delete;
+        DxfWriter &operator=(const DxfWriter &) = delete;
+
+        ~DxfWriter() { flush(); }
+
+        void flush()
+        {
+            if (n)
+                o.write(buf.data(), std::streamsize(n));
+            n = 0;
+        }
+
+        /**
+         * @brief raw text, written as is
+         */
+        DxfWriter &str(std::string_view s)
+        {
+            if (s.size() > buf.size())
+            {
+                flush();
+                o.write(s.data(), std::streamsize(s.size()));
+                return *this;
+            }
+            char *p = reserve(s.size());
+            std::memcpy(p, s.data(), s.size());
+            n += s.size();
+            return *this;
+        }
+
+        /**
+         * @brief text followed by a line end
+         */
+        DxfWriter &line(std::string_view s)
+        {
+            str(s);
+            *reserve(1) = '\n';
+            n++;
+            return *this;
+        }
+
+        template <class TInt>
+        DxfWriter &integer(TInt v)
+        {
+            char *p = reserve(maxNumberLen);
+            auto res = std::to_chars(p, p + maxNumberLen - 1, v);
+            *res.ptr = '\n';
+            n += res.ptr + 1 - p;
+            return *this;
+        }
+
+        DxfWriter &real(double v)
+        {
+            char *p = reserve(maxNumberLen);
+            auto res = std::to_chars(p, p + maxNumberLen - 1, v);
+            *res.ptr = '\n';
+            n += res.ptr + 1 - p;
+            return *this;
+        }
+
+        DxfWriter &handle(uint64_t h)
+        {
+            char *p = reserve(maxNumberLen);
+            int nByte = 1;
+            while (nByte < 8 && (h >> (nByte * 8)))
+                nByte++;
+            char *c = p;
+            for (int i = nByte - 1; i >= 0; i--)
+            {
+                const char *pair = detail::hexPairs.data() + ((h >> (i * 8)) & 0xFF) * 2;
+                if (c == p && i == nByte - 1 && pair[0] == '0')
+                    *(c++) = pair[1]; // no leading zero
+                else
+                    *(c++) = pair[0], *(c++) = pair[1];
+            }
+            *(c++) = '\n';
+            n += c - p;
+            return *this;
+        }
+
+        /**
+         * @brief the group code line, "  <code>"
+         */
+        DxfWriter &code(int c)
+        {
+            char *p = reserve(maxNumberLen);
+            p[0] = ' ', p[1] = ' ';
+            auto res = std::to_chars(p + 2, p + maxNumberLen - 1, c);
+            *res.ptr = '\n';
+            n += res.ptr + 1 - p;
+            return *this;
+        }
+
+        DxfWriter &groupStr(int c, std::string_view s) { return code(c).line(s); }
+        DxfWriter &groupReal(int c, double v) { return code(c).real(v); }
+        template <class TInt>
+        DxfWriter &groupInt(int c, TInt v) { return code(c).integer(v); }
+        DxfWriter &groupHandle(int c, uint64_t h) { return code(c).handle(h); }
+
+        /**
+         * @brief a point as codes code0, code0 + codeJ, code0 + 2 * codeJ
+         */
+        DxfWriter &groupVector3(const double *v, int code0, int codeJ)
+        {
+            for (int i = 0; i < 3; i++)
+                groupReal(code0 + codeJ * i, v[i]);
+            return *this;
+        }
+    };
+}
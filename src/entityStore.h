@@ -0,0 +1,208 @@
+#pragma once
+
+#include "dwgsimDefs.h"
+#include "entityType.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace DwgSim
+{
+    /**
+     * @brief entry of an EntityList, ordered as in the dwg block
+     *
+     * rec indexes into the typed record arrays of the owning list,
+     * -1 for types that carry no geometric payload (MTEXT, HATCH ...);
+     * layerId is the compact index into the Reader's layer table
+     */
+    struct EntityRef
+    {
+        EntityType type{EntityType::Unknown};
+        int64_t rec{-1};
+        uint64_t handle{0};
+        uint32_t layerId{0};
+    };
+
+    /**
+     * @brief POLYLINE_2D, POLYLINE_3D and LWPOLYLINE
+     *
+     * vertices are in EntityList::polyVerts (3 each, z = the elevation for LWPOLYLINE),
+     * vertex handles are parallel to the vertices (0 for LWPOLYLINE)
+     */
+    struct PolylineRecord
+    {
+        int32_t flag{0};
+        int64_t vertStart{0};
+        int64_t nVert{0};
+        int64_t bulgeStart{0};
+        int64_t nBulge{0};
+        uint64_t seqendHandle{0};
+        std::array<double, 3> extrusion{0, 0, 0};
+    };
+
+    /**
+     * @brief closed flag of a polyline: bit 512 of the dwg flag for LWPOLYLINE, bit 1 for POLYLINE_2D/3D
+     */
+    inline bool polylineIsClosed(EntityType type, const PolylineRecord &poly)
+    {
+        return type == EntityType::LwPolyline ? (poly.flag & 512) : (poly.flag & 1);
+    }
+
+    /**
+     * @brief SPLINE, payloads in EntityList::splineCtrl (x y z w), splineFit (x y z) and splineKnots
+     */
+    struct SplineRecord
+    {
+        int32_t flag{0};
+        int32_t splineflags{0};
+        int32_t periodic{0};
+        int32_t rational{0};
+        int32_t weighted{0};
+        int32_t knotparam{0};
+        int32_t scenario{0};
+        int32_t degree{0};
+        double ctrl_tol{0};
+        double fit_tol{0};
+        double knot_tol{0};
+        std::array<double, 3> beg_tan_vec{0, 0, 0};
+        std::array<double, 3> end_tan_vec{0, 0, 0};
+        int64_t ctrlStart{0};
+        int64_t nCtrl{0};
+        int64_t fitStart{0};
+        int64_t nFit{0};
+        int64_t knotStart{0};
+        int64_t nKnot{0};
+    };
+
+    struct InsertRecord
+    {
+        uint64_t blockId{0};
+        std::string blockName;
+        std::array<double, 3> ins_pt{0, 0, 0};
+        std::array<double, 3> scale{0, 0, 0};
+        double rotation{0};
+        int32_t num_cols{1};
+        int32_t num_rows{1};
+        double col_spacing{0};
+        double row_spacing{0};
+        std::array<double, 3> extrusion{0, 0, 0};
+    };
+
+    /**
+     * @brief structure-of-arrays storage of the entities of one block (or model space)
+     *
+     * fixed size records are packed in flat double arrays:
+     *   lines:    x0 y0 z0 x1 y1 z1             (lineRecSize)
+     *   arcs:     ext(3) center(3) r t0 t1      (arcRecSize), CIRCLE stored with t0 = 0, t1 = 2pi
+     *   ellipses: center(3) sm_axis(3) ext(3) axis_ratio t0 t1 (ellipseRecSize)
+     * variable sized entities keep offsets into shared payload buffers.
+     *
+     * Removing entities only drops them from ents, the payloads stay until the list is cleared.
+     */
+    class EntityList
+    {
+    public:
+        static constexpr int lineRecSize = 6;
+        static constexpr int arcRecSize = 9;
+        static constexpr int ellipseRecSize = 12;
+
+        std::vector<EntityRef> ents;
+
+        std::vector<double> lines;
+        std::vector<double> lineExtrusions; // 3 per line
+        std::vector<double> arcs;
+        std::vector<double> ellipses;
+
+        std::vector<PolylineRecord> polylines;
+        std::vector<double> polyVerts;
+        std::vector<double> polyBulges;
+        std::vector<uint64_t> polyVertHandles;
+
+        std::vector<SplineRecord> splines;
+        std::vector<double> splineCtrl;
+        std::vector<double> splineFit;
+        std::vector<double> splineKnots;
+
+        std::vector<InsertRecord> inserts;
+
+        int64_t size() const { return static_cast<int64_t>(ents.size()); }
+        bool empty() const { return ents.empty(); }
+
+        const double *line(int64_t rec) const { return lines.data() + rec * lineRecSize; }
+        const double *lineExtrusion(int64_t rec) const { return lineExtrusions.data() + rec * 3; }
+        const double *arc(int64_t rec) const { return arcs.data() + rec * arcRecSize; }
+        const double *ellipse(int64_t rec) const { return ellipses.data() + rec * ellipseRecSize; }
+
+        const double *polyVert(const PolylineRecord &p, int64_t iv) const { return polyVerts.data() + (p.vertStart + iv) * 3; }
+        double polyBulge(const PolylineRecord &p, int64_t ib) const { return polyBulges[p.bulgeStart + ib]; }
+        uint64_t polyVertHandle(const PolylineRecord &p, int64_t iv) const { return polyVertHandles[p.vertStart + iv]; }
+
+        const double *splineCtrlPt(const SplineRecord &s, int64_t i) const { return splineCtrl.data() + (s.ctrlStart + i) * 4; }
+        const double *splineFitPt(const SplineRecord &s, int64_t i) const { return splineFit.data() + (s.fitStart + i) * 3; }
+        double splineKnot(const SplineRecord &s, int64_t i) const { return splineKnots[s.knotStart + i]; }
+
+        EntityRef &push(EntityType type, uint64_t handle, uint32_t layerId)
+        {
+            ents.push_back(EntityRef{type, -1, handle, layerId});
+            return ents.back();
+        }
+
+        /**
+         * @brief drops the last entity together with its payload, which is at the end of the record arrays
+         */
+        void popBack()
+        {
+            auto &ent = ents.back();
+            switch (ent.type)
+            {
+            case EntityType::Line:
+                lines.resize(ent.rec * lineRecSize);
+                lineExtrusions.resize(ent.rec * 3);
+                break;
+            case EntityType::Arc:
+            case EntityType::Circle:
+                arcs.resize(ent.rec * arcRecSize);
+                break;
+            case EntityType::Polyline2D:
+            case EntityType::Polyline3D:
+            case EntityType::LwPolyline:
+            {
+                auto &poly = polylines[ent.rec];
+                polyVerts.resize(poly.vertStart * 3);
+                polyVertHandles.resize(poly.vertStart);
+                polyBulges.resize(poly.bulgeStart);
+                polylines.pop_back();
+                break;
+            }
+            default:
+                assert(false); // only the types OnlineDupFilter handles
+            }
+            ents.pop_back();
+        }
+
+        /**
+         * @brief drops ents[i] for each i in idx, order of the rest is kept
+         */
+        void removeEntities(const std::set<int64_t> &idx)
+        {
+            if (idx.empty())
+                return;
+            std::vector<EntityRef> kept;
+            kept.reserve(ents.size() - std::min(ents.size(), idx.size()));
+            for (int64_t i = 0; i < size(); i++)
+                if (!idx.count(i))
+                    kept.push_back(ents[i]);
+            ents = std::move(kept);
+        }
+
+        void clear()
+        {
+            *this = EntityList();
+        }
+    };
+}
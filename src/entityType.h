@@ -0,0 +1,128 @@
+#pragma once
+
+#include "dwgsimDefs.h"
+
+#include <array>
+#include <cstdint>
+
+namespace DwgSim
+{
+    /**
+     * @brief the dwg object types dwgsim handles, dense so that every stage can switch on it
+     */
+    enum class EntityType : uint8_t
+    {
+        Unknown = 0,
+        Block,
+        Line,
+        Arc,
+        Spline,
+        Circle,
+        Ellipse,
+        LwPolyline,
+        Polyline2D,
+        Polyline3D,
+        MText,
+        Hatch,
+        DimensionLinear,
+        DimensionAligned,
+        Insert,
+        Point,
+        Solid,
+        Attdef,
+        Count
+    };
+
+    namespace detail
+    {
+        //* fixed dwg types handled are all small, anything above is Unknown
+        static constexpr size_t entityTypeTableSize = 512;
+
+        constexpr std::array<EntityType, entityTypeTableSize> makeEntityTypeTable()
+        {
+            std::array<EntityType, entityTypeTableSize> ret{};
+            ret[DWG_TYPE_BLOCK] = EntityType::Block;
+            ret[DWG_TYPE_LINE] = EntityType::Line;
+            ret[DWG_TYPE_ARC] = EntityType::Arc;
+            ret[DWG_TYPE_SPLINE] = EntityType::Spline;
+            ret[DWG_TYPE_CIRCLE] = EntityType::Circle;
+            ret[DWG_TYPE_ELLIPSE] = EntityType::Ellipse;
+            ret[DWG_TYPE_LWPOLYLINE] = EntityType::LwPolyline;
+            ret[DWG_TYPE_POLYLINE_2D] = EntityType::Polyline2D;
+            ret[DWG_TYPE_POLYLINE_3D] = EntityType::Polyline3D;
+            ret[DWG_TYPE_MTEXT] = EntityType::MText;
+            ret[DWG_TYPE_HATCH] = EntityType::Hatch;
+            ret[DWG_TYPE_DIMENSION_LINEAR] = EntityType::DimensionLinear;
+            ret[DWG_TYPE_DIMENSION_ALIGNED] = EntityType::DimensionAligned;
+            ret[DWG_TYPE_INSERT] = EntityType::Insert;
+            ret[DWG_TYPE_POINT] = EntityType::Point;
+            ret[DWG_TYPE_SOLID] = EntityType::Solid;
+            ret[DWG_TYPE_ATTDEF] = EntityType::Attdef;
+            return ret;
+        }
+
+        inline constexpr std::array<EntityType, entityTypeTableSize> entityTypeTable = makeEntityTypeTable();
+
+        //* names in the JSON output, same as the DWG_TYPE_ names
+        inline constexpr std::array<const char *, size_t(EntityType::Count)> entityTypeNames{
+            "UNKNOWN",
+            "BLOCK",
+            "LINE",
+            "ARC",
+            "SPLINE",
+            "CIRCLE",
+            "ELLIPSE",
+            "LWPOLYLINE",
+            "POLYLINE_2D",
+            "POLYLINE_3D",
+            "MTEXT",
+            "HATCH",
+            "DIMENSION_LINEAR",
+            "DIMENSION_ALIGNED",
+            "INSERT",
+            "POINT",
+            "SOLID",
+            "ATTDEF",
+        };
+
+        //* DXF entity names, nullptr for types not written to DXF
+        inline constexpr std::array<const char *, size_t(EntityType::Count)> entityTypeDxfNames{
+            nullptr,
+            nullptr,
+            "LINE",
+            "ARC",
+            "SPLINE",
+            "CIRCLE",
+            "ELLIPSE",
+            "LWPOLYLINE",
+            "POLYLINE",
+            "POLYLINE",
+            nullptr,
+            nullptr,
+            nullptr,
+            nullptr,
+            "INSERT",
+            nullptr,
+            nullptr,
+            nullptr,
+        };
+    }
+
+    constexpr EntityType toEntityType(uint32_t dwgType)
+    {
+        return dwgType < detail::entityTypeTableSize ? detail::entityTypeTable[dwgType] : EntityType::Unknown;
+    }
+
+    constexpr const char *entityTypeName(EntityType type)
+    {
+        return detail::entityTypeNames[size_t(type)];
+    }
+
+    constexpr const char *entityTypeDxfName(EntityType type)
+    {
+        return detail::entityTypeDxfNames[size_t(type)];
+    }
+
+    static_assert(toEntityType(DWG_TYPE_LINE) == EntityType::Line);
+    static_assert(toEntityType(DWG_TYPE_POLYLINE_3D) == EntityType::Polyline3D);
+}
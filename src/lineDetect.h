@@ -2,7 +2,20 @@
 
 #include "dwgsimDefs.h"
 #include "splineUtil.h"
+#include "dupGridHash.h"
+#include "dupKernels.h"
+#include "dupExternal.h"
+#include "dupSearchOptions.h"
+#include "parallelUtil.h"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <limits>
 #include <set>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
 #include <vector>
 DISABLE_WARNING_PUSH
 #if defined(_MSC_VER) && defined(_WIN32) && !defined(__clang__)
@@ -101,71 +114,584 @@ namespace DwgSim
     template <int dim>
     using t_eigenPts = std::vector<Eigen::Vector<double, dim>>;
 
-    template <int dim>
-    inline auto getPtsDuplications(t_eigenPts<dim> &linesInf, double eps)
+    namespace detail
     {
-        using namespace nanoflann;
-        typedef KDTreeVectorOfVectorsAdaptor<t_eigenPts<dim>, double>
-            kd_tree_t;
+        /**
+         * @brief rows of equal length in a flat array, a point set for ForPtsNeighbors;
+         * row i starts at offsets[i], or at i * stride without offsets
+         */
+        struct FlatRows
+        {
+            struct Row
+            {
+                const double *p;
+                int64_t n;
+                const double *data() const { return p; }
+                int64_t size() const { return n; }
+                double operator[](size_t d) const { return p[d]; }
+            };
 
-        std::vector<std::set<int64_t>> ret;
-        if (!linesInf.size())
-            return ret;
+            const double *base = nullptr;
+            const int64_t *offsets = nullptr;
+            int64_t nRow = 0;
+            int64_t rowSize = 0;
+            int64_t stride = 0;
 
-        kd_tree_t kd_tree(linesInf[0].size(), linesInf);
+            size_t size() const { return size_t(nRow); }
+            bool empty() const { return nRow == 0; }
+            Row operator[](size_t i) const { return Row{base + (offsets ? offsets[i] : int64_t(i) * stride), rowSize}; }
+        };
 
-        std::vector<int64_t> inSet;
-        inSet.resize(linesInf.size(), -1);
+        /**
+         * @brief the first nCol values of each point, without a copy
+         */
+        template <int dim>
+        FlatRows LeadingColumns(const t_eigenPts<dim> &pts, int64_t nCol)
+        {
+            static_assert(sizeof(Eigen::Vector<double, dim>) == dim * sizeof(double), "points are not packed");
+            return FlatRows{pts.empty() ? nullptr : pts[0].data(), nullptr, int64_t(pts.size()), nCol, dim};
+        }
+
+        /**
+         * @brief the rows idx[0 .. n-1] of pts, a point set for ForPtsNeighbors
+         */
+        template <class TPts>
+        struct SubsetRows
+        {
+            const TPts *pts = nullptr;
+            const int64_t *idx = nullptr;
+            int64_t n = 0;
+
+            size_t size() const { return size_t(n); }
+            bool empty() const { return n == 0; }
+            decltype(auto) operator[](size_t k) const { return (*pts)[idx[k]]; }
+        };
 
-        nanoflann::SearchParameters params;
-        params.sorted = true;
-        for (int i = 0; i < linesInf.size(); i++)
+        /**
+         * @brief float copies of the rows of a point set, a point set for ForPtsNeighbors
+         */
+        struct FloatRows
         {
-            std::vector<nanoflann::ResultItem<size_t, double>> result;
-            kd_tree.index->radiusSearch(linesInf[i].data(), (eps * eps), result, params);
-            if (result.size() > 1) // has to contain itself
+            struct Row
             {
-                if (inSet[i] == -1)
+                const float *p;
+                int64_t n;
+                const float *data() const { return p; }
+                int64_t size() const { return n; }
+                float operator[](size_t d) const { return p[d]; }
+            };
+
+            std::vector<float> values;
+            int64_t nRow = 0;
+            int64_t dim = 0;
+
+            FloatRows() = default;
+
+            template <class TPts>
+            explicit FloatRows(const TPts &pts)
+                : nRow(int64_t(pts.size())), dim(pts.empty() ? 0 : int64_t(pts[0].size()))
+            {
+                values.resize(size_t(nRow * dim));
+                for (int64_t i = 0; i < nRow; i++)
                 {
-                    inSet[i] = static_cast<int64_t>(ret.size());
-                    ret.emplace_back();
+                    const double *p = pts[i].data();
+                    for (int64_t d = 0; d < dim; d++)
+                        values[i * dim + d] = float(p[d]);
+                }
+            }
+
+            size_t size() const { return size_t(nRow); }
+            bool empty() const { return nRow == 0; }
+            Row operator[](size_t i) const { return Row{values.data() + int64_t(i) * dim, dim}; }
+        };
+
+        /**
+         * @brief radius of a float candidate search that finds every pair with DupDistSqr < eps * eps in double,
+         * 0 if the keys do not suit one
+         *
+         * Rounding a key value v to float moves it by at most |v| 2^-24 (2^-150 if subnormal), so a coordinate
+         * difference moves by at most delta = 2 M 2^-24 + 2^-149, M the largest |v|, and the distance by sqrt(dim) delta.
+         * The float subtraction, the float sum of squares, the KD-tree bounds and the rounding of the squared radius
+         * add relative errors of a few dim 2^-24, covered by the factor 1 + (dim + 8) 2^-22.
+         * Keys past 1e30 would not round to finite floats, and past 1024 eps the candidates would be too many to gain.
+         */
+        template <class TPts>
+        double FloatCandidateEps(const TPts &pts, const TPts &queries, double eps)
+        {
+            if (pts.empty() || queries.empty() || !(eps > 0))
+                return 0;
+            int64_t dim = int64_t(pts[0].size());
+            double M = 0;
+            for (const TPts *set : {&pts, &queries})
+                for (size_t i = 0; i < set->size(); i++)
+                {
+                    const double *p = (*set)[i].data();
+                    for (int64_t d = 0; d < dim; d++)
+                        if (std::isfinite(p[d]))
+                            M = std::max(M, std::abs(p[d]));
                 }
-                auto &cset = ret.at(inSet[i]);
-                cset.insert(i);
-                for (auto j : result)
+            if (!(M <= 1e30))
+                return 0;
+            double delta = 2 * M * std::ldexp(1.0, -24) + std::ldexp(1.0, -149);
+            double epsF = (eps + std::sqrt(double(dim)) * delta) * (1 + double(dim + 8) * std::ldexp(1.0, -22));
+            if (!(epsF <= 1024 * eps) || !(epsF * epsF >= 1e-30))
+                return 0;
+            return epsF;
+        }
+
+        //* a cell of SplitDupTiles: its queries and the points that can be within eps of them, both ascending
+        struct DupTile
+        {
+            std::vector<int64_t> queries;
+            std::vector<int64_t> pts;
+        };
+
+        /**
+         * @brief k-d split of the queries into tiles of at most maxQueries
+         *
+         * A cell is split at the median of its queries along the coordinate of largest finite spread.
+         * Points within a halo of the split plane go to both sides; the halo is wider than any coordinate
+         * difference of a pair with DupDistSqr < eps * eps, so every neighbour of a query is in its tile.
+         * Points with a NaN coordinate can have no neighbours and may be left out.
+         */
+        template <class TPts>
+        std::vector<DupTile> SplitDupTiles(const TPts &pts, const TPts &queries, double eps, int64_t maxQueries)
+        {
+            std::vector<DupTile> tiles, stack(1);
+            stack[0].queries.resize(queries.size());
+            stack[0].pts.resize(pts.size());
+            for (int64_t i = 0; i < int64_t(queries.size()); i++)
+                stack[0].queries[i] = i;
+            for (int64_t j = 0; j < int64_t(pts.size()); j++)
+                stack[0].pts[j] = j;
+            int64_t dim = queries.empty() ? 0 : int64_t(queries[0].size());
+
+            std::vector<double> vals;
+            while (!stack.empty())
+            {
+                DupTile t = std::move(stack.back());
+                stack.pop_back();
+                if (int64_t(t.queries.size()) <= maxQueries)
+                {
+                    tiles.push_back(std::move(t));
+                    continue;
+                }
+
+                int64_t dSplit = -1;
+                double spread = 0;
+                for (int64_t d = 0; d < dim; d++)
                 {
-                    cset.insert(static_cast<int64_t>(j.first));
-                    inSet[j.first] = inSet[i];
+                    double lo = std::numeric_limits<double>::infinity(), hi = -lo;
+                    for (auto i : t.queries)
+                    {
+                        double v = queries[i][d];
+                        if (std::isfinite(v))
+                            lo = std::min(lo, v), hi = std::max(hi, v);
+                    }
+                    if (hi - lo > spread)
+                        spread = hi - lo, dSplit = d;
                 }
+                if (dSplit < 0) //* all queries at one point
+                {
+                    tiles.push_back(std::move(t));
+                    continue;
+                }
+
+                vals.clear();
+                for (auto i : t.queries)
+                    if (std::isfinite(queries[i][dSplit]))
+                        vals.push_back(queries[i][dSplit]);
+                std::nth_element(vals.begin(), vals.begin() + vals.size() / 2, vals.end());
+                double m = vals[vals.size() / 2];
+                //* left takes v < m, or v <= m if m is the smallest value; both sides get queries
+                bool leftClosed = *std::min_element(vals.begin(), vals.end()) == m;
+
+                DupTile l, r;
+                for (auto i : t.queries)
+                {
+                    double v = queries[i][dSplit];
+                    (v < m || (leftClosed && v == m) ? l : r).queries.push_back(i);
+                }
+                double halo = 2 * eps + 4 * std::numeric_limits<double>::epsilon() * std::abs(m);
+                for (auto j : t.pts)
+                {
+                    double v = pts[j][dSplit];
+                    if (v < m + halo)
+                        l.pts.push_back(j);
+                    if (v > m - halo)
+                        r.pts.push_back(j);
+                }
+                stack.push_back(std::move(l));
+                stack.push_back(std::move(r));
             }
+            return tiles;
         }
 
-        return ret;
+        template <class TPts, class F>
+        DupSearchCounters ForPtsNeighborsIndexed(const TPts &pts, const TPts &queries, double eps, int nThreads, F &&f,
+                                                 const DupSearchOptions &opts);
+
+        /**
+         * @brief calls f(i, neighbours) for every query i on nThreads threads,
+         * neighbours being the indices of pts within eps of queries[i] sorted by distance, ties by index
+         *
+         * Over opts.tileMax points, the queries are split into tiles (SplitDupTiles) searched one per task,
+         * each against its own points only. Up to opts.bruteForceMax points, each query is compared with all of them.
+         * Otherwise the index (KD-tree or grid) is built once and shared, each thread reuses its own buffers;
+         * with opts.floatCandidates it indexes float copies of the keys and is searched with FloatCandidateEps,
+         * the candidates are then checked in double.
+         * All paths test the same DupDistSqr < eps * eps, the neighbours do not depend on the path.
+         * @return the paths the search took
+         */
+        template <class TPts, class F>
+        DupSearchCounters ForPtsNeighbors(const TPts &pts, const TPts &queries, double eps, int nThreads, F &&f,
+                                          const DupSearchOptions &opts)
+        {
+            if (opts.tileMax > 0 && int64_t(pts.size()) > opts.tileMax && int64_t(queries.size()) > opts.tileMax)
+            {
+                auto tiles = SplitDupTiles(pts, queries, eps, opts.tileMax);
+                std::vector<DupSearchCounters> tileCounters(tiles.size());
+                std::vector<int64_t> order(tiles.size());
+                for (int64_t k = 0; k < int64_t(tiles.size()); k++)
+                    order[k] = k;
+                std::stable_sort(order.begin(), order.end(),
+                                 [&](int64_t a, int64_t b)
+                                 { return tiles[a].pts.size() > tiles[b].pts.size(); });
+                ParallelForOrdered(
+                    order, nThreads,
+                    [&](int64_t k)
+                    {
+                        auto &t = tiles[k];
+                        SubsetRows<TPts> tilePts{&pts, t.pts.data(), int64_t(t.pts.size())};
+                        SubsetRows<TPts> tileQueries{&queries, t.queries.data(), int64_t(t.queries.size())};
+                        std::vector<int64_t> result;
+                        tileCounters[k] = ForPtsNeighborsIndexed(
+                            tilePts, tileQueries, eps, 1,
+                            [&](int64_t i, const std::vector<int64_t> &local)
+                            {
+                                //* t.pts is ascending, ties stay ordered by index
+                                result.clear();
+                                for (auto j : local)
+                                    result.push_back(t.pts[j]);
+                                f(t.queries[i], result);
+                            },
+                            opts);
+                    });
+                DupSearchCounters counters;
+                counters.tiled++;
+                for (auto &c : tileCounters)
+                    counters += c;
+                return counters;
+            }
+            return ForPtsNeighborsIndexed(pts, queries, eps, nThreads, std::forward<F>(f), opts);
+        }
+
+        /**
+         * @brief ForPtsNeighbors with one search over all of pts
+         */
+        template <class TPts, class F>
+        DupSearchCounters ForPtsNeighborsIndexed(const TPts &pts, const TPts &queries, double eps, int nThreads, F &&f,
+                                                 const DupSearchOptions &opts)
+        {
+            using Scalar = PtsScalar<TPts>;
+            using kd_tree_t = KDTreeVectorOfVectorsAdaptor<TPts, Scalar>;
+            DupSearchCounters counters;
+
+            if constexpr (std::is_same_v<Scalar, double>)
+            {
+                double epsF = opts.floatCandidates && int64_t(pts.size()) > opts.bruteForceMax
+                                  ? FloatCandidateEps(pts, queries, eps)
+                                  : 0;
+                if (epsF > 0)
+                {
+                    counters.floatCandidates++;
+                    bool self = static_cast<const void *>(&pts) == static_cast<const void *>(&queries);
+                    FloatRows ptsF(pts), queriesF;
+                    if (!self)
+                        queriesF = FloatRows(queries);
+                    int64_t dim = int64_t(pts[0].size());
+                    double radiusSqr = eps * eps;
+                    counters += ForPtsNeighborsIndexed(
+                        ptsF, self ? ptsF : queriesF, epsF, nThreads,
+                        [&](int64_t i, const std::vector<int64_t> &candidates)
+                        {
+                            //* per thread, f may be called from several
+                            thread_local std::vector<std::pair<double, int64_t>> found;
+                            thread_local std::vector<int64_t> result;
+                            found.clear(), result.clear();
+                            for (auto j : candidates)
+                            {
+                                double distSqr = DupDistSqr(queries[i].data(), pts[j].data(), size_t(dim));
+                                if (distSqr < radiusSqr)
+                                    found.emplace_back(distSqr, j);
+                            }
+                            std::sort(found.begin(), found.end());
+                            for (auto &[d, j] : found)
+                                result.push_back(j);
+                            f(i, result);
+                        },
+                        opts);
+                    return counters;
+                }
+            }
+
+            if (int64_t(pts.size()) <= opts.bruteForceMax)
+            {
+                counters.bruteForce++;
+                std::vector<const Scalar *> rows(pts.size());
+                for (size_t j = 0; j < pts.size(); j++)
+                    rows[j] = pts[j].data();
+                int64_t dim = pts.empty() ? 0 : int64_t(pts[0].size());
+                Scalar radiusSqr = Scalar(eps * eps);
+                ParallelForChunks(
+                    int64_t(queries.size()), nThreads,
+                    [&](int64_t begin, int64_t end)
+                    {
+                        std::vector<std::pair<Scalar, int64_t>> found;
+                        std::vector<int64_t> result;
+                        for (int64_t i = begin; i < end; i++)
+                        {
+                            found.clear();
+                            DupDistSqrRows(queries[i].data(), rows.data(), int64_t(rows.size()), dim,
+                                           [&](int64_t j, double distSqr)
+                                           {
+                                               if (distSqr < radiusSqr)
+                                                   found.emplace_back(distSqr, j);
+                                           });
+                            std::sort(found.begin(), found.end());
+                            result.clear();
+                            for (auto &[d, j] : found)
+                                result.push_back(j);
+                            f(i, result);
+                        }
+                    });
+                return counters;
+            }
+
+            if (opts.backend == DupSearchBackend::GridHash)
+            {
+                PtsGridHash<TPts> grid(pts, eps);
+                if (grid.ok)
+                {
+                    counters.gridHash++;
+                    ParallelForChunks(
+                        int64_t(queries.size()), nThreads,
+                        [&](int64_t begin, int64_t end)
+                        {
+                            std::vector<std::pair<Scalar, int64_t>> found;
+                            std::vector<int64_t> result;
+                            for (int64_t i = begin; i < end; i++)
+                            {
+                                found.clear();
+                                grid.forNeighbors(queries[i].data(), [&](int64_t j, Scalar distSqr)
+                                                  { found.emplace_back(distSqr, j); });
+                                std::sort(found.begin(), found.end());
+                                result.clear();
+                                for (auto &[d, j] : found)
+                                    result.push_back(j);
+                                f(i, result);
+                            }
+                        });
+                    return counters;
+                }
+            }
+
+            counters.kdTree++;
+            kd_tree_t kd_tree(pts[0].size(), pts, 10, unsigned(ResolveThreadCount(nThreads)));
+            ParallelForChunks(
+                int64_t(queries.size()), nThreads,
+                [&](int64_t begin, int64_t end)
+                {
+                    nanoflann::SearchParameters params;
+                    params.sorted = true;
+                    std::vector<nanoflann::ResultItem<size_t, Scalar>> resultKD;
+                    std::vector<int64_t> result;
+                    for (int64_t i = begin; i < end; i++)
+                    {
+                        kd_tree.index->radiusSearch(queries[i].data(), Scalar(eps * eps), resultKD, params);
+                        //* nanoflann leaves the order of equal distances open
+                        std::stable_sort(resultKD.begin(), resultKD.end(),
+                                         [](auto &x, auto &y)
+                                         { return x.second < y.second || (x.second == y.second && x.first < y.first); });
+                        result.clear();
+                        for (auto &j : resultKD)
+                            result.push_back(static_cast<int64_t>(j.first));
+                        f(i, result);
+                    }
+                });
+            return counters;
+        }
+
+        //* keeps every pair the search finds, given by indices or keys
+        struct AcceptAll
+        {
+            template <class A, class B>
+            bool operator()(A, B) const { return true; }
+        };
+
+        /**
+         * @brief the connected components of uf with more than one member, ordered by their smallest index
+         */
+        inline std::vector<std::set<int64_t>> UnionFindGroups(ConcurrentUnionFind &uf, int64_t n)
+        {
+            std::vector<std::set<int64_t>> ret;
+            //* roots are the smallest members
+            std::vector<int64_t> root(n), groupOf(n, -1);
+            std::vector<int64_t> count(n, 0);
+            for (int64_t i = 0; i < n; i++)
+                count[root[i] = uf.find(i)]++;
+            for (int64_t i = 0; i < n; i++)
+            {
+                if (count[root[i]] < 2)
+                    continue;
+                if (root[i] == i)
+                {
+                    groupOf[i] = int64_t(ret.size());
+                    ret.emplace_back();
+                }
+                ret[groupOf[root[i]]].insert(ret[groupOf[root[i]]].end(), i);
+            }
+            return ret;
+        }
+
+        /**
+         * @brief getPtsDuplications over any point set ForPtsNeighbors takes,
+         * a neighbour j of query i only counts if accept(i, j)
+         */
+        template <class TPts, class Accept = AcceptAll>
+        std::vector<std::set<int64_t>> PtsDuplicationGroups(const TPts &pts, double eps, int nThreads,
+                                                            const DupSearchOptions &opts, DupSearchCounters *counters,
+                                                            Accept accept = {})
+        {
+            std::vector<std::set<int64_t>> ret;
+            if (!pts.size())
+                return ret;
+
+            int64_t n = int64_t(pts.size());
+            ConcurrentUnionFind uf(n);
+            auto c = ForPtsNeighbors(
+                pts, pts, eps, nThreads,
+                [&](int64_t i, const std::vector<int64_t> &result)
+                {
+                    for (auto j : result)
+                        if (j != i && accept(i, j))
+                            uf.unite(i, j);
+                },
+                opts);
+            if (counters)
+                *counters += c;
+            return UnionFindGroups(uf, n);
+        }
     }
 
+    /**
+     * @brief groups of points within eps of each other, transitively
+     *
+     * Groups are the connected components with more than one point, ordered by their smallest index;
+     * they do not depend on the backend or the thread count.
+     * The paths the search took are added to counters if given, as for the other duplicate searches below.
+     */
     template <int dim>
-    inline auto getPtsDuplicationsInPts(t_eigenPts<dim> &linesInf, t_eigenPts<dim> &tests, double eps)
+    inline auto getPtsDuplications(t_eigenPts<dim> &linesInf, double eps, int nThreads = 1,
+                                   const DupSearchOptions &opts = {}, DupSearchCounters *counters = nullptr)
     {
-        using namespace nanoflann;
-        typedef KDTreeVectorOfVectorsAdaptor<t_eigenPts<dim>, double>
-            kd_tree_t;
+        return detail::PtsDuplicationGroups(linesInf, eps, nThreads, opts, counters);
+    }
 
-        std::vector<std::pair<int64_t, int64_t>> ret;
-        if (!linesInf.size())
+    namespace detail
+    {
+        /**
+         * @brief getPtsDuplicationsInPts over any point sets ForPtsNeighbors takes,
+         * pts[j] only counts for tests[i] if accept(i, j)
+         */
+        template <class TPts, class Accept = AcceptAll>
+        std::vector<std::pair<int64_t, int64_t>> PtsDuplicationPairs(const TPts &pts, const TPts &tests, double eps, int nThreads,
+                                                                     const DupSearchOptions &opts, DupSearchCounters *counters,
+                                                                     Accept accept = {})
+        {
+            std::vector<std::pair<int64_t, int64_t>> ret;
+            if (!pts.size())
+                return ret;
+
+            std::vector<std::vector<int64_t>> found(tests.size());
+            auto c = ForPtsNeighbors(
+                pts, tests, eps, nThreads,
+                [&](int64_t i, const std::vector<int64_t> &result)
+                {
+                    for (auto j : result)
+                        if (accept(i, j))
+                            found[i].push_back(j);
+                },
+                opts);
+            if (counters)
+                *counters += c;
+            for (int64_t i = 0; i < int64_t(tests.size()); i++)
+                for (auto j : found[i])
+                    ret.push_back(std::make_pair(j, i));
             return ret;
+        }
+    }
 
-        kd_tree_t kd_tree(dim, linesInf);
+    namespace detail
+    {
+        /**
+         * @brief PtsDuplicationGroups of the n keys made by fill, with an ExternalDupSweep of budget bytes;
+         * a pair counts if accept(keyI, keyJ)
+         */
+        template <class Accept = AcceptAll>
+        std::vector<std::set<int64_t>> ExternalDuplicationGroups(int64_t n, int dim, int stride, const ExternalDupSweep::Fill &fill,
+                                                                 double eps, size_t budget, Accept accept = {})
+        {
+            if (!n)
+                return {};
+            ConcurrentUnionFind uf(n);
+            ExternalDupSweep sweep(dim, stride, eps, budget);
+            sweep.forPairs(n, fill, -1, nullptr,
+                           [&](int64_t i, int64_t j, double, const double *keyI, const double *keyJ)
+                           {
+                               if (accept(keyI, keyJ))
+                                   uf.unite(i, j);
+                           });
+            return UnionFindGroups(uf, n);
+        }
 
-        nanoflann::SearchParameters params;
-        params.sorted = true;
-        for (int64_t i = 0; i < int64_t(tests.size()); i++)
+        /**
+         * @brief PtsDuplicationPairs of the nPts and nTests keys made by fillPts and fillTests, with an ExternalDupSweep;
+         * a pair counts if accept(keyTest, keyPt)
+         */
+        template <class Accept = AcceptAll>
+        std::vector<std::pair<int64_t, int64_t>> ExternalDuplicationPairs(int64_t nPts, const ExternalDupSweep::Fill &fillPts,
+                                                                          int64_t nTests, const ExternalDupSweep::Fill &fillTests,
+                                                                          int dim, int stride, double eps, size_t budget,
+                                                                          Accept accept = {})
         {
-            std::vector<nanoflann::ResultItem<size_t, double>> result;
-            kd_tree.index->radiusSearch(tests[i].data(), (eps * eps), result, params);
-            for (auto j : result)
-                ret.push_back(std::make_pair(int64_t(j.first), i));
+            if (!nPts)
+                return {};
+            std::vector<std::tuple<int64_t, double, int64_t>> found;
+            ExternalDupSweep sweep(dim, stride, eps, budget);
+            sweep.forPairs(nPts, fillPts, nTests, fillTests,
+                           [&](int64_t i, int64_t j, double distSqr, const double *keyI, const double *keyJ)
+                           {
+                               if (accept(keyI, keyJ))
+                                   found.emplace_back(i, distSqr, j);
+                           });
+            std::sort(found.begin(), found.end());
+            std::vector<std::pair<int64_t, int64_t>> ret;
+            ret.reserve(found.size());
+            for (auto &[i, d, j] : found)
+                ret.push_back(std::make_pair(j, i));
+            return ret;
         }
-        return ret;
+    }
+
+    /**
+     * @brief pairs (j, i) of linesInf[j] within eps of tests[i], by i then by distance
+     */
+    template <int dim>
+    inline auto getPtsDuplicationsInPts(t_eigenPts<dim> &linesInf, t_eigenPts<dim> &tests, double eps, int nThreads = 1,
+                                        const DupSearchOptions &opts = {}, DupSearchCounters *counters = nullptr)
+    {
+        return detail::PtsDuplicationPairs(linesInf, tests, eps, nThreads, opts, counters);
     }
 
     static auto Seq012 = Eigen::seq(Eigen::fix<0>, Eigen::fix<2>);
@@ -180,193 +706,575 @@ namespace DwgSim
      */
     inline auto linesToInfLine(t_eigenPts<6> &lines)
     {
-        t_eigenPts<6> ret = lines;
-        for (int64_t i = 0; i < (int64_t)lines.size(); i++)
-        {
-            Vec3 p0 = lines[i](Seq012);
-            Vec3 p1 = lines[i](Seq345);
-            double LRef = std::max(p0.norm(), p1.norm());
-            Vec3 dir;
-            Vec3 base;
-            dir = p1 - p0;
-            double dirNormSqr = dir.squaredNorm();
-            if (dir.norm() < LRef * 1e-10 || LRef == 0)
-            {
-                dir.setZero();
-                dir(0) = 1;
-                base = p0;
-            }
-            else
-            {
-                double alphaB = -p0.dot(dir) / (dirNormSqr + 1e-300);
-                base = (1 - alphaB) * p0 + alphaB * p1;
-            }
-            dir.normalize();
-            if (std::abs(dir(2)) > 1e-13) //! discard dir diff
-            {
-                if (dir(2) < 0)
-                    dir *= -1;
-            }
-            else if (std::abs(dir(0)) > 1e-13)
-            {
-                if (dir(0) < 0)
-                    dir *= -1;
-            }
-            else
-            {
-                if (dir(1) < 0)
-                    dir *= -1;
-            }
-
-            ret[i](Seq012) = dir;
-            ret[i](Seq345) = base;
-        }
-
+        t_eigenPts<6> ret(lines.size());
+        if (lines.size())
+            detail::InfLineRows<3>(lines[0].data(), ret[0].data(), int64_t(lines.size()), 0);
         return ret;
     }
 
     inline auto getInfLineNormalized(t_eigenPts<6> &linesInf, double &maxBaseSiz, bool updateMax = true)
     {
-        t_eigenPts<6> ret = linesInf;
-        if (updateMax)
-            maxBaseSiz = 1e-300;
+        t_eigenPts<6> ret(linesInf.size());
         if (updateMax)
-            for (int64_t i = 0; i < (int64_t)linesInf.size(); i++)
-                maxBaseSiz = std::max(maxBaseSiz, ret[i](Seq345).norm());
-        for (int64_t i = 0; i < (int64_t)linesInf.size(); i++)
-            ret[i](Seq345) /= maxBaseSiz;
+            maxBaseSiz = linesInf.size() ? detail::MaxNorm3Rows(linesInf[0].data(), int64_t(linesInf.size()), 6, 3, 1e-300) : 1e-300;
+        if (linesInf.size())
+            detail::DivideRows(linesInf[0].data(), ret[0].data(), int64_t(linesInf.size()), 6, 3, 3, maxBaseSiz);
         return ret;
     }
 
-    inline auto getLinesDuplicationsAtInf(t_eigenPts<6> &lines, double eps = 1e-8)
+    /**
+     * @brief linesToInfLine and getInfLineNormalized in one pass over the lines
+     *
+     * @param linesInf set to linesToInfLine(lines)
+     * @return getInfLineNormalized(linesInf, maxBaseSiz)
+     */
+    inline auto linesToInfLineNormalized(t_eigenPts<6> &lines, t_eigenPts<6> &linesInf, double &maxBaseSiz)
     {
-        double maxBase;
-        auto linesInf = linesToInfLine(lines);
-        auto linesInfNorm = getInfLineNormalized(linesInf, maxBase);
-        return getPtsDuplications<6>(linesInfNorm, eps);
+        linesInf.resize(lines.size());
+        t_eigenPts<6> ret(lines.size());
+        maxBaseSiz = 1e-300;
+        if (lines.size())
+        {
+            maxBaseSiz = detail::InfLineRows<3>(lines[0].data(), linesInf[0].data(), int64_t(lines.size()), maxBaseSiz);
+            detail::DivideRows(linesInf[0].data(), ret[0].data(), int64_t(lines.size()), 6, 3, 3, maxBaseSiz);
+        }
+        return ret;
     }
 
     /**
-     * @brief
+     * @brief the duplicate searches below are templates on the spatial dimension nd of the keys
      *
-     * @param lines vector of (x1 y1 z1 x2 y2 z2)
-     * @return (preciseDups, includeDups)
+     * A set of lines with all z = 0, or of arcs with extrusion (0 0 1) and center z = 0, is searched with nd = 2:
+     * the constant columns are left out of the keys, (xd yd xb yb) for lines, (cx cy r t0 t1) for arcs and
+     * (cx cy r) for circles. Those columns add exact zeros to the distances of the 3-D keys, so the 2-D line and
+     * circle distances are the same bit for bit; the 5-D arc distance sums in another order, its candidates are
+     * taken within a slightly larger radius and checked with PlanarArcDistSqr. Results are those of nd = 3.
      */
-    inline auto linesDuplications(t_eigenPts<6> &lines, double eps = 1e-8, double lEps = 1e-5)
+    namespace detail
     {
-        double maxBase{1e-100};
-        auto linesInf = linesToInfLine(lines);
-        auto linesInfNorm = getInfLineNormalized(linesInf, maxBase);
-        auto infDup = getPtsDuplications<6>(linesInfNorm, eps);
-        std::vector<int64_t> inPreciseDups(lines.size(), -1);
-        std::vector<std::set<int64_t>> preciseDups;
-        std::vector<std::pair<int64_t, int64_t>> includeDups;
-
-        for (auto &s : infDup)
-        {
-            for (auto i : s)
-            {
-                Vec3 dir = linesInf[i](Seq012);
-                Vec3 base = linesInf[i](Seq345);
-                double Li = (lines[i](Seq012) - base).dot(dir);
-                double Ri = (lines[i](Seq345) - base).dot(dir);
-                if (Li > Ri)
-                    std::swap(Li, Ri);
-                for (auto j : s) //! currently use O(N^2) search
+        inline bool LinesArePlanar(const t_eigenPts<6> &lines)
+        {
+            for (auto &l : lines)
+                if (l(2) != 0 || l(5) != 0)
+                    return false;
+            return true;
+        }
+
+        inline bool ArcsArePlanar(const t_eigenPts<9> &arcs)
+        {
+            for (auto &a : arcs)
+                if (a(0) != 0 || a(1) != 0 || a(2) != 1 || a(5) != 0)
+                    return false;
+            return true;
+        }
+
+        /**
+         * @brief linesToInfLine and getInfLineNormalized into rows of 2 * nd,
+         * maxBaseSiz is only read if !updateMax
+         */
+        template <int nd>
+        void InfLineKeys(t_eigenPts<6> &lines, t_eigenPts<2 * nd> &linesInf, t_eigenPts<2 * nd> &linesInfNorm,
+                         double &maxBaseSiz, bool updateMax = true)
+        {
+            linesInf.resize(lines.size());
+            linesInfNorm.resize(lines.size());
+            if (updateMax)
+                maxBaseSiz = 1e-300;
+            if (!lines.size())
+                return;
+            double maxBase = InfLineRows<nd>(lines[0].data(), linesInf[0].data(), int64_t(lines.size()), 1e-300);
+            if (updateMax)
+                maxBaseSiz = maxBase;
+            DivideRows(linesInf[0].data(), linesInfNorm[0].data(), int64_t(lines.size()), 2 * nd, nd, nd, maxBaseSiz);
+        }
+
+        //* rows per chunk when keys are made a chunk at a time, a multiple of 4 so the kernels batch the rows as over all
+        inline constexpr int64_t dupKeyChunk = 4096;
+
+        //* the maxBaseSiz of InfLineKeys, a chunk at a time
+        template <int nd>
+        double InfLineMaxBase(t_eigenPts<6> &lines)
+        {
+            double maxBase = 1e-300;
+            std::vector<double> buf(dupKeyChunk * 2 * nd);
+            for (int64_t b = 0; b < int64_t(lines.size()); b += dupKeyChunk)
+                maxBase = InfLineRows<nd>(lines[b].data(), buf.data(), std::min<int64_t>(dupKeyChunk, int64_t(lines.size()) - b), maxBase);
+            return maxBase;
+        }
+
+        //* rows of linesInfNorm of InfLineKeys, for ExternalDupSweep
+        template <int nd>
+        ExternalDupSweep::Fill InfLineKeyFill(t_eigenPts<6> &lines, double maxBaseSiz)
+        {
+            return [&lines, maxBaseSiz](int64_t begin, int64_t end, double *rows)
+            {
+                InfLineRows<nd>(lines[begin].data(), rows, end - begin, 0);
+                DivideRows(rows, rows, end - begin, 2 * nd, nd, nd, maxBaseSiz);
+            };
+        }
+
+        //* linesInf[i] of InfLineKeys, from the 4 rows the kernels batch it with
+        template <int nd>
+        Eigen::Vector<double, 2 * nd> InfLineAt(t_eigenPts<6> &lines, int64_t i)
+        {
+            int64_t b = i / 4 * 4;
+            double buf[4 * 2 * nd];
+            InfLineRows<nd>(lines[b].data(), buf, std::min<int64_t>(4, int64_t(lines.size()) - b), 0);
+            return Eigen::Map<Eigen::Vector<double, 2 * nd>>(buf + (i - b) * 2 * nd);
+        }
+
+        template <int nd>
+        auto LinesDuplications(t_eigenPts<6> &lines, double eps, double lEps, int nThreads,
+                               const DupSearchOptions &opts, DupSearchCounters *counters)
+        {
+            using VecN = Eigen::Vector<double, nd>;
+            double maxBase{1e-100};
+            t_eigenPts<2 * nd> linesInf, linesInfNorm;
+            std::vector<std::set<int64_t>> infDup;
+            if (opts.externalBudget > 0)
+            {
+                //* linesInf is not kept, the clusters' rows are made again
+                maxBase = InfLineMaxBase<nd>(lines);
+                infDup = ExternalDuplicationGroups(int64_t(lines.size()), 2 * nd, 2 * nd, InfLineKeyFill<nd>(lines, maxBase), eps,
+                                                   opts.externalBudget);
+            }
+            else
+            {
+                InfLineKeys<nd>(lines, linesInf, linesInfNorm, maxBase);
+                infDup = getPtsDuplications<2 * nd>(linesInfNorm, eps, nThreads, opts, counters);
+            }
+            auto infOf = [&](int64_t i) -> Eigen::Vector<double, 2 * nd>
+            { return linesInf.size() ? linesInf[i] : InfLineAt<nd>(lines, i); };
+            std::vector<int64_t> inPreciseDups(lines.size(), -1);
+            std::vector<std::set<int64_t>> preciseDups;
+            std::vector<std::pair<int64_t, int64_t>> includeDups;
+
+            //* per carrier line cluster, the pairs are taken from a window of the intervals sorted by their left end
+            //* then checked exactly as in an all pairs loop, in the same order
+            std::vector<int64_t> cand;
+            std::vector<double> LR, RR;
+            std::vector<int64_t> byL;
+            std::vector<double> LSorted;
+            for (auto &s : infDup)
+            {
+                //* projections in the frame of any member i are within delta of those in the frame of r
+                int64_t r = *s.begin();
+                auto infR = infOf(r);
+                VecN dirR = infR.template head<nd>();
+                VecN baseR = infR.template tail<nd>();
+                double dMax = 0, bMax = 0, pMax = 0;
+                for (auto i : s)
+                {
+                    auto inf = infOf(i);
+                    dMax = std::max(dMax, (inf.template head<nd>() - dirR).norm());
+                    bMax = std::max(bMax, (inf.template tail<nd>() - baseR).norm());
+                    pMax = std::max({pMax, (lines[i].template head<nd>() - baseR).norm(),
+                                     (lines[i].template segment<nd>(3) - baseR).norm()});
+                }
+                double delta = pMax * dMax + bMax;
+                double w = lEps + 2 * delta + 1e-12 * (pMax + bMax + baseR.norm());
+
+                LR.clear(), RR.clear(), byL.clear(), LSorted.clear();
+                for (auto i : s)
+                {
+                    double L = (lines[i].template head<nd>() - baseR).dot(dirR);
+                    double R = (lines[i].template segment<nd>(3) - baseR).dot(dirR);
+                    if (L > R)
+                        std::swap(L, R);
+                    LR.push_back(L), RR.push_back(R);
+                    if (std::isfinite(L) && std::isfinite(R))
+                        byL.push_back(int64_t(LR.size()) - 1);
+                }
+                std::vector<int64_t> members(s.begin(), s.end());
+                std::sort(byL.begin(), byL.end(),
+                          [&](int64_t a, int64_t b)
+                          { return LR[a] < LR[b]; });
+                for (auto k : byL)
+                    LSorted.push_back(LR[k]);
+
+                for (int64_t ii = 0; ii < int64_t(members.size()); ii++)
                 {
-                    if (i == j)
+                    auto i = members[ii];
+                    if (!(std::isfinite(LR[ii]) && std::isfinite(RR[ii])))
                         continue;
-                    double Lj = (lines[j](Seq012) - base).dot(dir);
-                    double Rj = (lines[j](Seq345) - base).dot(dir);
-                    if (Lj > Rj)
-                        std::swap(Lj, Rj);
+                    //* precise: Lj near Li, inclusion: Li <= Lj <= Rj <= Ri, both widened by w
+                    auto lo = std::lower_bound(LSorted.begin(), LSorted.end(), LR[ii] - w) - LSorted.begin();
+                    auto hi = std::upper_bound(LSorted.begin(), LSorted.end(), RR[ii] + w) - LSorted.begin();
+                    cand.clear();
+                    for (auto k = lo; k < hi; k++)
+                        cand.push_back(members[byL[k]]);
+                    std::sort(cand.begin(), cand.end());
 
-                    if (std::abs(Li - Lj) < lEps && std::abs(Ri - Rj) < lEps)
+                    auto inf = infOf(i);
+                    VecN dir = inf.template head<nd>();
+                    VecN base = inf.template tail<nd>();
+                    double Li = (lines[i].template head<nd>() - base).dot(dir);
+                    double Ri = (lines[i].template segment<nd>(3) - base).dot(dir);
+                    if (Li > Ri)
+                        std::swap(Li, Ri);
+                    for (auto j : cand)
                     {
-                        if (inPreciseDups[i] == -1)
+                        if (i == j)
+                            continue;
+                        double Lj = (lines[j].template head<nd>() - base).dot(dir);
+                        double Rj = (lines[j].template segment<nd>(3) - base).dot(dir);
+                        if (Lj > Rj)
+                            std::swap(Lj, Rj);
+
+                        if (std::abs(Li - Lj) < lEps && std::abs(Ri - Rj) < lEps)
                         {
-                            inPreciseDups[i] = preciseDups.size();
-                            preciseDups.emplace_back();
+                            if (inPreciseDups[i] == -1)
+                            {
+                                inPreciseDups[i] = preciseDups.size();
+                                preciseDups.emplace_back();
+                            }
+                            inPreciseDups[j] = inPreciseDups[i];
+                            preciseDups.at(inPreciseDups[i]).insert(i);
+                            preciseDups.at(inPreciseDups[i]).insert(j);
                         }
-                        inPreciseDups[j] = inPreciseDups[i];
-                        preciseDups.at(inPreciseDups[i]).insert(i);
-                        preciseDups.at(inPreciseDups[i]).insert(j);
+                        if (Li - lEps < Lj && Ri + lEps > Rj)
+                            includeDups.emplace_back(std::make_pair(i, j));
                     }
-                    if (Li - lEps < Lj && Ri + lEps > Rj)
-                        includeDups.emplace_back(std::make_pair(i, j));
                 }
             }
+
+            return std::make_tuple(preciseDups, includeDups);
+        }
+
+        template <int nd>
+        auto LineInLinesDuplications(t_eigenPts<6> &lines, t_eigenPts<6> &linesTest, double eps, double lEps, int nThreads,
+                                     const DupSearchOptions &opts, DupSearchCounters *counters)
+        {
+            using VecN = Eigen::Vector<double, nd>;
+            double maxL{1e-100};
+            t_eigenPts<2 * nd> linesInf, linesInfNorm, linesInfTest, linesInfNormTest;
+            std::vector<std::pair<int64_t, int64_t>> infDup;
+            if (opts.externalBudget > 0)
+            {
+                maxL = InfLineMaxBase<nd>(lines);
+                infDup = ExternalDuplicationPairs(int64_t(lines.size()), InfLineKeyFill<nd>(lines, maxL),
+                                                  int64_t(linesTest.size()), InfLineKeyFill<nd>(linesTest, maxL), 2 * nd, 2 * nd, eps,
+                                                  opts.externalBudget);
+            }
+            else
+            {
+                InfLineKeys<nd>(lines, linesInf, linesInfNorm, maxL);
+                InfLineKeys<nd>(linesTest, linesInfTest, linesInfNormTest, maxL, false);
+                infDup = getPtsDuplicationsInPts<2 * nd>(linesInfNorm, linesInfNormTest, eps, nThreads, opts, counters);
+            }
+
+            std::vector<std::pair<int64_t, int64_t>> preciseDups;
+            std::vector<std::pair<int64_t, int64_t>> includeDups;
+
+            for (auto &p : infDup)
+            {
+                auto i = p.first;
+                auto j = p.second;
+
+                auto inf = linesInf.size() ? Eigen::Vector<double, 2 * nd>(linesInf[i]) : InfLineAt<nd>(lines, i);
+                VecN dir = inf.template head<nd>();
+                VecN base = inf.template tail<nd>();
+                double Li = (lines[i].template head<nd>() - base).dot(dir);
+                double Ri = (lines[i].template segment<nd>(3) - base).dot(dir);
+                if (Li > Ri)
+                    std::swap(Li, Ri);
+                double Lj = (linesTest[j].template head<nd>() - base).dot(dir);
+                double Rj = (linesTest[j].template segment<nd>(3) - base).dot(dir);
+                if (Lj > Rj)
+                    std::swap(Lj, Rj);
+
+                if (std::abs(Li - Lj) < lEps && std::abs(Ri - Rj) < lEps)
+                    preciseDups.push_back(std::make_pair(i, j));
+                if (Li - lEps < Lj && Ri + lEps > Rj)
+                    includeDups.emplace_back(std::make_pair(i, j));
+            }
+            return std::make_tuple(preciseDups, includeDups);
         }
+    }
 
-        return std::make_tuple(preciseDups, includeDups);
+    inline auto getLinesDuplicationsAtInf(t_eigenPts<6> &lines, double eps = 1e-8, int nThreads = 1,
+                                          const DupSearchOptions &opts = {}, DupSearchCounters *counters = nullptr)
+    {
+        double maxBase;
+        if (detail::LinesArePlanar(lines))
+        {
+            t_eigenPts<4> linesInf, linesInfNorm;
+            detail::InfLineKeys<2>(lines, linesInf, linesInfNorm, maxBase);
+            return getPtsDuplications<4>(linesInfNorm, eps, nThreads, opts, counters);
+        }
+        t_eigenPts<6> linesInf, linesInfNorm;
+        detail::InfLineKeys<3>(lines, linesInf, linesInfNorm, maxBase);
+        return getPtsDuplications<6>(linesInfNorm, eps, nThreads, opts, counters);
     }
 
-    inline auto lineInLinesDuplications(t_eigenPts<6> &lines, t_eigenPts<6> &linesTest, double eps = 1e-8, double lEps = 1e-5)
+    /**
+     * @brief
+     *
+     * @param lines vector of (x1 y1 z1 x2 y2 z2)
+     * @return (preciseDups, includeDups)
+     */
+    inline auto linesDuplications(t_eigenPts<6> &lines, double eps = 1e-8, double lEps = 1e-5, int nThreads = 1,
+                                  const DupSearchOptions &opts = {}, DupSearchCounters *counters = nullptr)
     {
-        double maxL{1e-100};
-        auto linesInf = linesToInfLine(lines);
-        auto linesInfNorm = getInfLineNormalized(linesInf, maxL);
-        auto linesInfTest = linesToInfLine(linesTest);
-        auto linesInfNormTest = getInfLineNormalized(linesInfTest, maxL, false);
-
-        auto infDup = getPtsDuplicationsInPts<6>(linesInfNorm, linesInfNormTest, eps);
-
-        std::vector<std::pair<int64_t, int64_t>> preciseDups;
-        std::vector<std::pair<int64_t, int64_t>> includeDups;
-
-        for (auto &p : infDup)
-        {
-            auto i = p.first;
-            auto j = p.second;
-
-            Vec3 dir = linesInf[i](Seq012);
-            Vec3 base = linesInf[i](Seq345);
-            double Li = (lines[i](Seq012) - base).dot(dir);
-            double Ri = (lines[i](Seq345) - base).dot(dir);
-            if (Li > Ri)
-                std::swap(Li, Ri);
-            double Lj = (linesTest[j](Seq012) - base).dot(dir);
-            double Rj = (linesTest[j](Seq345) - base).dot(dir);
-            if (Lj > Rj)
-                std::swap(Lj, Rj);
-
-            if (std::abs(Li - Lj) < lEps && std::abs(Ri - Rj) < lEps)
-                preciseDups.push_back(std::make_pair(i, j));
-            if (Li - lEps < Lj && Ri + lEps > Rj)
-                includeDups.emplace_back(std::make_pair(i, j));
-        }
-        return std::make_tuple(preciseDups, includeDups);
+        if (detail::LinesArePlanar(lines))
+            return detail::LinesDuplications<2>(lines, eps, lEps, nThreads, opts, counters);
+        return detail::LinesDuplications<3>(lines, eps, lEps, nThreads, opts, counters);
     }
 
-    inline auto arcsRegulate(t_eigenPts<9> &arcs, double &maxPos, double &maxR, double eps, bool updateMax = true)
+    inline auto lineInLinesDuplications(t_eigenPts<6> &lines, t_eigenPts<6> &linesTest, double eps = 1e-8, double lEps = 1e-5, int nThreads = 1,
+                                        const DupSearchOptions &opts = {}, DupSearchCounters *counters = nullptr)
     {
-        t_eigenPts<9> ret = arcs;
-        if (updateMax)
+        if (detail::LinesArePlanar(lines) && detail::LinesArePlanar(linesTest))
+            return detail::LineInLinesDuplications<2>(lines, linesTest, eps, lEps, nThreads, opts, counters);
+        return detail::LineInLinesDuplications<3>(lines, linesTest, eps, lEps, nThreads, opts, counters);
+    }
+
+    namespace detail
+    {
+        //* layout of the regulated arc keys: ext(3) center(3) r t0 t1 for nd = 3, center(2) r t0 t1 for nd = 2
+        template <int nd>
+        struct ArcKey
+        {
+            static constexpr int size = nd == 3 ? 9 : 5;
+            static constexpr int circle = size - 2; //* the leading values that make the circle key
+            static constexpr int t0 = size - 2, t1 = size - 1;
+        };
+
+        template <int nd>
+        auto ArcsRegulate(t_eigenPts<9> &arcs, double &maxPos, double &maxR, double eps, bool updateMax = true)
         {
-            maxPos = 1e-100;
-            maxR = 1e-100;
+            constexpr int m = ArcKey<nd>::size;
+            t_eigenPts<m> ret(arcs.size());
+            if (!arcs.size())
+            {
+                if (updateMax)
+                    maxPos = 1e-100, maxR = 1e-100;
+                return ret;
+            }
+            double maxPosAll = 1e-100, maxRAll = 1e-100;
+            ArcRows<nd>(arcs[0].data(), ret[0].data(), int64_t(arcs.size()), eps, maxPosAll, maxRAll);
+            if (updateMax)
+                maxPos = maxPosAll, maxR = maxRAll;
+            DivideRows(ret[0].data(), ret[0].data(), int64_t(arcs.size()), m, nd == 3 ? 3 : 0, nd, maxPos);
+            DivideRows(ret[0].data(), ret[0].data(), int64_t(arcs.size()), m, m - 3, 1, maxR);
+            return ret;
         }
-        for (auto &v : ret)
+
+        /**
+         * @brief DupDistSqr of the 9-D keys of two planar arcs, from their 5-D keys:
+         * the extrusion and cz differences are zero, the other terms are summed in the same order
+         */
+        inline double PlanarArcDistSqr(const double *a, const double *b)
         {
-            if (v(8) < v(7))
-                v(8) += 2 * pi;
-            if (v(7) >= 2 * pi - eps)
-                v(8) -= 2 * pi, v(7) -= 2 * pi;
-            assert(v(8) >= v(7));
+            double dcx = a[0] - b[0], dcy = a[1] - b[1], dr = a[2] - b[2], dt0 = a[3] - b[3], dt1 = a[4] - b[4];
+            double result = 0;
+            result += dcx * dcx;                         //* ex ey ez cx
+            result += (dcy * dcy + dr * dr) + dt0 * dt0; //* cy cz r t0
+            result += dt1 * dt1;
+            return result;
+        }
 
-            v(Seq012).normalize();
-            if (updateMax)
+        //* the 5-D arc distance may round the other way than PlanarArcDistSqr, candidates are searched a little wider
+        inline constexpr double planarArcSearchWiden = 1 + 1e-12;
+
+        //* maxPos and maxR of ArcsRegulate, a chunk at a time
+        template <int nd>
+        void ArcsMaxPosR(t_eigenPts<9> &arcs, double eps, double &maxPos, double &maxR)
+        {
+            maxPos = 1e-100, maxR = 1e-100;
+            std::vector<double> buf(dupKeyChunk * ArcKey<nd>::size);
+            for (int64_t b = 0; b < int64_t(arcs.size()); b += dupKeyChunk)
+                ArcRows<nd>(arcs[b].data(), buf.data(), std::min<int64_t>(dupKeyChunk, int64_t(arcs.size()) - b), eps, maxPos, maxR);
+        }
+
+        //* rows of ArcsRegulate, for ExternalDupSweep
+        template <int nd>
+        ExternalDupSweep::Fill ArcKeyFill(t_eigenPts<9> &arcs, double eps, double maxPos, double maxR)
+        {
+            return [&arcs, eps, maxPos, maxR](int64_t begin, int64_t end, double *rows)
+            {
+                constexpr int m = ArcKey<nd>::size;
+                double maxPosAll = 1e-100, maxRAll = 1e-100;
+                ArcRows<nd>(arcs[begin].data(), rows, end - begin, eps, maxPosAll, maxRAll);
+                DivideRows(rows, rows, end - begin, m, nd == 3 ? 3 : 0, nd, maxPos);
+                DivideRows(rows, rows, end - begin, m, m - 3, 1, maxR);
+            };
+        }
+
+        //* (t0, t1) of ArcsRegulate for arc i, from the 4 rows the kernels batch it with
+        template <int nd>
+        std::pair<double, double> ArcAnglesAt(t_eigenPts<9> &arcs, int64_t i, double eps)
+        {
+            constexpr int m = ArcKey<nd>::size;
+            int64_t b = i / 4 * 4;
+            double buf[4 * m], maxPos = 1e-100, maxR = 1e-100;
+            ArcRows<nd>(arcs[b].data(), buf, std::min<int64_t>(4, int64_t(arcs.size()) - b), eps, maxPos, maxR);
+            return {buf[(i - b) * m + ArcKey<nd>::t0], buf[(i - b) * m + ArcKey<nd>::t1]};
+        }
+
+        template <int nd>
+        auto ArcsDuplications(t_eigenPts<9> &arcs, double eps, int nThreads,
+                              const DupSearchOptions &opts, DupSearchCounters *counters)
+        {
+            using K = ArcKey<nd>;
+            double maxPos{1e-100}, maxR{1e-100};
+            t_eigenPts<K::size> arcsReg;
+            // std::vector<int64_t> inPreciseDups(arcs.size(), -1);
+            std::vector<std::set<int64_t>> preciseDups;
+            std::vector<std::pair<int64_t, int64_t>> includeDups;
+            std::vector<std::set<int64_t>> circDup;
+            auto acceptPlanar = [&](const double *a, const double *b)
+            { return PlanarArcDistSqr(a, b) < eps * eps; };
+            size_t budget = opts.externalBudget;
+            if (budget > 0)
             {
-                maxPos = std::max(maxPos, v(Seq345).norm());
-                maxR = std::max(maxR, v(6));
+                //* arcsReg is not kept, the clusters' angles are made again
+                ArcsMaxPosR<nd>(arcs, eps, maxPos, maxR);
+                auto fill = ArcKeyFill<nd>(arcs, eps, maxPos, maxR);
+                circDup = ExternalDuplicationGroups(int64_t(arcs.size()), K::circle, K::size, fill, eps, budget);
+                if constexpr (nd == 3)
+                    preciseDups = ExternalDuplicationGroups(int64_t(arcs.size()), K::size, K::size, fill, eps, budget);
+                else
+                    preciseDups = ExternalDuplicationGroups(int64_t(arcs.size()), K::size, K::size, fill,
+                                                            eps * planarArcSearchWiden, budget, acceptPlanar);
             }
+            else
+            {
+                arcsReg = ArcsRegulate<nd>(arcs, maxPos, maxR, eps);
+                //* circles are the leading values of the arcs, searched in place
+                circDup = PtsDuplicationGroups(LeadingColumns(arcsReg, K::circle), eps, nThreads, opts, counters);
+                if constexpr (nd == 3)
+                    preciseDups = getPtsDuplications<9>(arcsReg, eps, nThreads, opts, counters);
+                else
+                    preciseDups = PtsDuplicationGroups(
+                        arcsReg, eps * planarArcSearchWiden, nThreads, opts, counters,
+                        [&](int64_t i, int64_t j)
+                        { return acceptPlanar(arcsReg[i].data(), arcsReg[j].data()); });
+            }
+            auto anglesOf = [&](int64_t i)
+            { return arcsReg.size() ? std::make_pair(arcsReg[i](K::t0), arcsReg[i](K::t1)) : ArcAnglesAt<nd>(arcs, i, eps); };
+
+            //* per circle cluster, arc j can only be in arc i if t0c is in [t0 - eps, t1 + eps],
+            //* those are taken from a window of the arcs sorted by t0, full circles still pair with all;
+            //* cand and byT0 hold positions in members
+            std::vector<int64_t> cand, byT0, all;
+            std::vector<double> t0Sorted, T0, T1;
+            for (auto &s : circDup)
+            {
+                std::vector<int64_t> members(s.begin(), s.end());
+                bool ordered = true;
+                byT0.clear(), t0Sorted.clear(), T0.clear(), T1.clear(), all.clear();
+                for (int64_t k = 0; k < int64_t(members.size()); k++)
+                {
+                    auto [t0, t1] = anglesOf(members[k]);
+                    T0.push_back(t0), T1.push_back(t1), all.push_back(k);
+                    ordered = ordered && t0 <= t1;
+                    if (std::isfinite(t0))
+                        byT0.push_back(k);
+                }
+                std::sort(byT0.begin(), byT0.end(),
+                          [&](int64_t a, int64_t b)
+                          { return T0[a] < T0[b]; });
+                for (auto k : byT0)
+                    t0Sorted.push_back(T0[k]);
+
+                for (int64_t ki = 0; ki < int64_t(members.size()); ki++)
+                {
+                    auto i = members[ki];
+                    double t0 = T0[ki];
+                    double t1 = T1[ki];
+                    bool isCircle = t0 == 0 && t1 == 2 * pi;
+                    if (isCircle || !ordered)
+                        cand = all;
+                    else
+                    {
+                        double margin = 1e-12 * (std::abs(t0) + std::abs(t1) + 1);
+                        auto lo = std::lower_bound(t0Sorted.begin(), t0Sorted.end(), t0 - eps - margin) - t0Sorted.begin();
+                        auto hi = std::upper_bound(t0Sorted.begin(), t0Sorted.end(), t1 + eps + margin) - t0Sorted.begin();
+                        cand.clear();
+                        for (auto k = lo; k < hi; k++)
+                            cand.push_back(byT0[k]);
+                        std::sort(cand.begin(), cand.end());
+                    }
+                    for (auto kj : cand)
+                    {
+                        auto j = members[kj];
+                        if (j == i)
+                            continue;
+                        double t0c = T0[kj];
+                        double t1c = T1[kj];
+                        if (t0 <= t0c + eps && t1 >= t1c - eps)
+                            includeDups.push_back(std::make_pair(i, j));
+                        if (isCircle) // is a circle
+                            includeDups.push_back(std::make_pair(i, j));
+                    }
+                }
+            }
+
+            return std::make_tuple(preciseDups, includeDups);
         }
-        for (auto &v : ret)
+
+        template <int nd>
+        auto ArcInArcsDuplications(t_eigenPts<9> &arcs, t_eigenPts<9> &arcsTests, double eps, int nThreads,
+                                   const DupSearchOptions &opts, DupSearchCounters *counters)
         {
-            v(Seq345) /= maxPos;
-            v(6) /= maxR;
+            using K = ArcKey<nd>;
+            double maxPos{1e-100}, maxR{1e-100};
+            t_eigenPts<K::size> arcsReg, arcsRegTests;
+            std::vector<std::pair<int64_t, int64_t>> circDup, preciseDups;
+            auto acceptPlanar = [&](const double *a, const double *b)
+            { return PlanarArcDistSqr(a, b) < eps * eps; };
+            size_t budget = opts.externalBudget;
+            if (budget > 0)
+            {
+                ArcsMaxPosR<nd>(arcs, eps, maxPos, maxR);
+                auto fill = ArcKeyFill<nd>(arcs, eps, maxPos, maxR);
+                auto fillTests = ArcKeyFill<nd>(arcsTests, eps, maxPos, maxR);
+                int64_t n = int64_t(arcs.size()), nTests = int64_t(arcsTests.size());
+                circDup = ExternalDuplicationPairs(n, fill, nTests, fillTests, K::circle, K::size, eps, budget);
+                if constexpr (nd == 3)
+                    preciseDups = ExternalDuplicationPairs(n, fill, nTests, fillTests, K::size, K::size, eps, budget);
+                else
+                    preciseDups = ExternalDuplicationPairs(n, fill, nTests, fillTests, K::size, K::size,
+                                                           eps * planarArcSearchWiden, budget, acceptPlanar);
+            }
+            else
+            {
+                arcsReg = ArcsRegulate<nd>(arcs, maxPos, maxR, eps);
+                arcsRegTests = ArcsRegulate<nd>(arcsTests, maxPos, maxR, eps, false);
+                circDup = PtsDuplicationPairs(LeadingColumns(arcsReg, K::circle), LeadingColumns(arcsRegTests, K::circle), eps, nThreads,
+                                              opts, counters);
+                if constexpr (nd == 3)
+                    preciseDups = getPtsDuplicationsInPts<9>(arcsReg, arcsRegTests, eps, nThreads, opts, counters);
+                else
+                    preciseDups = PtsDuplicationPairs(
+                        arcsReg, arcsRegTests, eps * planarArcSearchWiden, nThreads, opts, counters,
+                        [&](int64_t i, int64_t j)
+                        { return acceptPlanar(arcsRegTests[i].data(), arcsReg[j].data()); });
+            }
+
+            std::vector<std::pair<int64_t, int64_t>> includeDups;
+            for (auto &p : circDup)
+            {
+                auto i = p.first;
+                auto j = p.second;
+
+                auto [t0, t1] = arcsReg.size() ? std::make_pair(arcsReg[i](K::t0), arcsReg[i](K::t1)) : ArcAnglesAt<nd>(arcs, i, eps);
+                auto [t0c, t1c] = arcsRegTests.size() ? std::make_pair(arcsRegTests[j](K::t0), arcsRegTests[j](K::t1))
+                                                      : ArcAnglesAt<nd>(arcsTests, j, eps);
+                if (t0 <= t0c + eps && t1 >= t1c - eps)
+                    includeDups.push_back(std::make_pair(i, j));
+                if (t0 == 0 && t1 == 2 * pi) // is a circle
+                    includeDups.push_back(std::make_pair(i, j));
+            }
+
+            return std::make_tuple(preciseDups, includeDups);
         }
-        return ret;
+    }
+
+    inline auto arcsRegulate(t_eigenPts<9> &arcs, double &maxPos, double &maxR, double eps, bool updateMax = true)
+    {
+        return detail::ArcsRegulate<3>(arcs, maxPos, maxR, eps, updateMax);
     }
 
     inline auto arcsToCircle(t_eigenPts<9> &arcs)
@@ -377,69 +1285,20 @@ namespace DwgSim
         return ret;
     }
 
-    inline auto arcsDuplications(t_eigenPts<9> &arcs, double eps = 1e-8)
+    inline auto arcsDuplications(t_eigenPts<9> &arcs, double eps = 1e-8, int nThreads = 1,
+                                 const DupSearchOptions &opts = {}, DupSearchCounters *counters = nullptr)
     {
-        double maxPos{1e-100}, maxR{1e-100};
-        auto arcsReg = arcsRegulate(arcs, maxPos, maxR, eps);
-        auto circs = arcsToCircle(arcsReg);
-        // std::vector<int64_t> inPreciseDups(arcs.size(), -1);
-        std::vector<std::set<int64_t>> preciseDups;
-        std::vector<std::pair<int64_t, int64_t>> includeDups;
-        auto circDup = getPtsDuplications<7>(circs, eps);
-        preciseDups = getPtsDuplications<9>(arcsReg, eps);
-
-        for (auto &s : circDup)
-        {
-            for (auto i : s)
-            {
-                double t0 = arcsReg[i](7);
-                double t1 = arcsReg[i](8);
-                for (auto j : s)
-                {
-                    if (j == i)
-                        continue;
-                    double t0c = arcsReg[j](7);
-                    double t1c = arcsReg[j](8);
-                    if (t0 <= t0c + eps && t1 >= t1c - eps)
-                        includeDups.push_back(std::make_pair(i, j));
-                    if (t0 == 0 && t1 == 2 * pi) // is a circle
-                        includeDups.push_back(std::make_pair(i, j));
-                }
-            }
-        }
-
-        return std::make_tuple(preciseDups, includeDups);
+        if (detail::ArcsArePlanar(arcs))
+            return detail::ArcsDuplications<2>(arcs, eps, nThreads, opts, counters);
+        return detail::ArcsDuplications<3>(arcs, eps, nThreads, opts, counters);
     }
 
-    inline auto arcInArcsDuplications(t_eigenPts<9> &arcs, t_eigenPts<9> &arcsTests, double eps = 1e-8)
+    inline auto arcInArcsDuplications(t_eigenPts<9> &arcs, t_eigenPts<9> &arcsTests, double eps = 1e-8, int nThreads = 1,
+                                      const DupSearchOptions &opts = {}, DupSearchCounters *counters = nullptr)
     {
-        double maxPos{1e-100}, maxR{1e-100};
-        auto arcsReg = arcsRegulate(arcs, maxPos, maxR, eps);
-        auto circs = arcsToCircle(arcsReg);
-
-        auto arcsRegTests = arcsRegulate(arcsTests, maxPos, maxR, eps, false);
-        auto circsTests = arcsToCircle(arcsRegTests);
-
-        auto circDup = getPtsDuplicationsInPts<7>(circs, circsTests, eps);
-        auto preciseDups = getPtsDuplicationsInPts<9>(arcsReg, arcsRegTests, eps);
-
-        std::vector<std::pair<int64_t, int64_t>> includeDups;
-        for (auto &p : circDup)
-        {
-            auto i = p.first;
-            auto j = p.second;
-
-            double t0 = arcsReg[i](7);
-            double t1 = arcsReg[i](8);
-            double t0c = arcsRegTests[j](7);
-            double t1c = arcsRegTests[j](8);
-            if (t0 <= t0c + eps && t1 >= t1c - eps)
-                includeDups.push_back(std::make_pair(i, j));
-            if (t0 == 0 && t1 == 2 * pi) // is a circle
-                includeDups.push_back(std::make_pair(i, j));
-        }
-
-        return std::make_tuple(preciseDups, includeDups);
+        if (detail::ArcsArePlanar(arcs) && detail::ArcsArePlanar(arcsTests))
+            return detail::ArcInArcsDuplications<2>(arcs, arcsTests, eps, nThreads, opts, counters);
+        return detail::ArcInArcsDuplications<3>(arcs, arcsTests, eps, nThreads, opts, counters);
     }
 
     /**
@@ -464,73 +1323,425 @@ namespace DwgSim
 
     class PolylineGeomSet
     {
-        std::map<int, std::set<int64_t>> siz_to_idx;
+        //* polyline k is arena[offsets[k] ...], siz * 4 + 3 values: extrusion, then x y z bulge per vertex
+        std::vector<double> arena;
+        std::vector<int64_t> offsets;
+        std::vector<int> sizes;
+        std::vector<char> closeds;
         std::vector<int64_t> poly2list;
-        std::vector<Eigen::VectorXd> polyVecs; // size of vectorxd is p_siz * 4 + 3
+        bool canonical = false;
+
+        /**
+         * @brief scales the vertices by 1 / maxL and orients the polyline so that the lower end comes first;
+         * the last bulge is that of the closing segment if closed, unused otherwise
+         */
+        static void canonicalize(double *v, int siz, bool closed, double maxL, double eps)
+        {
+            for (int ii = 0; ii < siz; ii++)
+                for (int d = 0; d < 3; d++)
+                    v[3 + 4 * ii + d] /= maxL; // normalize
+            if (!closed && siz)
+                v[4 * siz + 2] = 0; // last bulge is not used
+            if (siz < 2)
+                return;
+            auto vert = [&](int ii)
+            { return Vec3{v[3 + 4 * ii], v[4 + 4 * ii], v[5 + 4 * ii]}; };
+            auto bulge = [&](int ii) -> double &
+            { return v[6 + 4 * ii]; };
+
+            int cmp01 = coordCompare(vert(0), vert(siz - 1), eps);
+            bool invert = false;
+            if (cmp01 > 0)
+                invert = true;
+            if (cmp01 == 0)
+            {
+                int cmpm11 = coordCompare(vert(1), vert(siz - 2), eps);
+                if (cmpm11 > 0 || (cmpm11 == 0 && bulge(0) < 0) || (cmpm11 == 0 && bulge(siz - 2) < 0))
+                    invert = true;
+            }
+            if (invert)
+            {
+                for (int ii = 0; ii < siz / 2; ii++)
+                    for (int d = 0; d < 3; d++)
+                        std::swap(v[3 + 4 * ii + d], v[3 + 4 * (siz - 1 - ii) + d]);
+                for (int ii = 0; ii < (siz - 1) / 2; ii++)
+                    std::swap(bulge(ii), bulge(siz - 2 - ii));
+                for (int ii = 0; ii < siz - 1; ii++)
+                    bulge(ii) = -bulge(ii);
+                if (closed) //* the closing segment is run backwards too
+                    bulge(siz - 1) = -bulge(siz - 1);
+            }
+        }
+
     public:
-        void insertPoly(int64_t list_idx, int siz, const Eigen::VectorXd &polyData)
+        /**
+         * @brief appends a polyline of siz vertices, closed ones are only compared with closed ones
+         * @return its siz * 4 + 3 values, zeroed, to be filled before the next append;
+         * throws after getDuplicates, which leaves the stored polylines canonical and would skip the new one
+         */
+        double *appendPoly(int64_t list_idx, int siz, bool closed = false)
         {
+            if (canonical)
+                throw std::logic_error("PolylineGeomSet: appendPoly after getDuplicates");
             poly2list.push_back(list_idx);
-            polyVecs.push_back(polyData);
-            if (!siz_to_idx.count(siz))
-                siz_to_idx[siz] = std::set<int64_t>();
-            siz_to_idx.at(siz).insert(poly2list.size() - 1);
+            sizes.push_back(siz);
+            closeds.push_back(char(closed));
+            offsets.push_back(int64_t(arena.size()));
+            arena.resize(arena.size() + size_t(siz) * 4 + 3, 0.0);
+            return arena.data() + offsets.back();
         }
 
-        auto getDuplicates(double eps = 1e-8)
+        void insertPoly(int64_t list_idx, int siz, const Eigen::VectorXd &polyData, bool closed = false)
         {
+            double *v = appendPoly(list_idx, siz, closed);
+            std::copy(polyData.data(), polyData.data() + polyData.size(), v);
+        }
+
+        /**
+         * @brief groups of duplicate polylines, as list indices
+         *
+         * Polylines with the same vertex count and closedness are normalized and oriented in place,
+         * then a grid hash over their values gives the candidates, which are verified with the full distance.
+         * The stored polylines stay canonical, so later calls skip that step.
+         * opts only give the limits of the search, the backend is always the grid hash.
+         */
+        auto getDuplicates(double eps = 1e-8, int nThreads = 1,
+                           const DupSearchOptions &opts = {}, DupSearchCounters *counters = nullptr)
+        {
+            DupSearchOptions optsGrid = opts;
+            optsGrid.backend = DupSearchBackend::GridHash;
             std::vector<std::set<int64_t>> ret;
-            for (auto &[siz, s] : siz_to_idx)
+            //* by vertex count and closedness, then in insertion order
+            std::vector<int64_t> bySize(sizes.size());
+            for (int64_t i = 0; i < int64_t(bySize.size()); i++)
+                bySize[i] = i;
+            std::stable_sort(bySize.begin(), bySize.end(),
+                             [&](int64_t a, int64_t b)
+                             { return std::make_pair(sizes[a], closeds[a]) < std::make_pair(sizes[b], closeds[b]); });
+
+            for (size_t g0 = 0, g1 = 0; g0 < bySize.size(); g0 = g1)
             {
-                std::vector<Eigen::VectorXd> polyVecsCur;
-                std::vector<int64_t> localIdx;
-                polyVecsCur.reserve(s.size());
-                localIdx.reserve(s.size());
-                double maxL{1e-100};
-                for (auto i : s)
-                {
-                    polyVecsCur.push_back(polyVecs[i]);
-                    localIdx.push_back(i);
-                    for (int ii = 0; ii < siz; ii++)
-                        maxL = std::max(maxL, polyVecs[i](Eigen::seq(3 + 4 * ii, 5 + 4 * ii)).array().abs().maxCoeff());
-                }
-                for (auto &v : polyVecsCur)
+                int siz = sizes[bySize[g0]];
+                bool closed = closeds[bySize[g0]];
+                while (g1 < bySize.size() && sizes[bySize[g1]] == siz && bool(closeds[bySize[g1]]) == closed)
+                    g1++;
+                std::vector<int64_t> groupOffsets(g1 - g0);
+                for (size_t k = 0; k < groupOffsets.size(); k++)
+                    groupOffsets[k] = offsets[bySize[g0 + k]];
+
+                if (!canonical)
                 {
-                    for (int ii = 0; ii < siz; ii++)
-                        v(Eigen::seq(3 + 4 * ii, 5 + 4 * ii)) /= maxL; // normalize
-                    v(v.size() - 1) = 0;                               // last bulge is not used
-                    if (siz >= 2)
-                    {
-                        int cmp01 = coordCompare(v(Eigen::seq(3 + 4 * 0, 5 + 4 * 0)), v(Eigen::seq(3 + 4 * (siz - 1), 5 + 4 * (siz - 1))), eps);
-                        bool invert = false;
-                        if (cmp01 > 0) 
-                            invert = true;
-                        if (cmp01 == 0)
+                    double maxL{1e-100};
+                    for (auto o : groupOffsets)
+                        for (int ii = 0; ii < siz; ii++)
                         {
-                            int cmpm11 = coordCompare(v(Eigen::seq(3 + 4 * 1, 5 + 4 * 1)), v(Eigen::seq(3 + 4 * (siz - 2), 5 + 4 * (siz - 2))), eps);
-                            if (cmpm11 > 0 || (cmpm11 == 0 && v(6 + 4 * 0) < 0) || (cmpm11 == 0 && v(6 + 4 * (siz - 2)) < 0))
-                                invert = true;
+                            const double *x = arena.data() + o + 3 + 4 * ii;
+                            maxL = std::max(maxL, std::max(std::abs(x[0]), std::max(std::abs(x[1]), std::abs(x[2]))));
                         }
-                        if (invert) // invert
+                    ParallelForChunks(
+                        int64_t(groupOffsets.size()), nThreads,
+                        [&](int64_t begin, int64_t end)
                         {
-                            Eigen::VectorXd v1 = v;
-                            for (int ii = 0; ii < siz; ii++)
-                                v1(Eigen::seq(3 + 4 * ii, 5 + 4 * ii)) = v(Eigen::seq(3 + 4 * (siz - 1 - ii), 5 + 4 * (siz - 1 - ii)));
-                            for (int ii = 0; ii < siz - 1; ii++)
-                                v1(6 + 4 * ii) = -v(6 + 4 * (siz - 2 - ii));
-                            v = v1;
-                        }
-                    }
+                            for (int64_t k = begin; k < end; k++)
+                                canonicalize(arena.data() + groupOffsets[k], siz, closed, maxL, eps);
+                        });
+                }
+
+                detail::FlatRows rows{arena.data(), groupOffsets.data(), int64_t(groupOffsets.size()), int64_t(siz) * 4 + 3};
+                auto dups = detail::PtsDuplicationGroups(rows, eps, nThreads, optsGrid, counters);
+                for (auto &ss : dups)
+                {
+                    ret.emplace_back();
+                    for (auto ii : ss)
+                        ret.back().insert(poly2list[bySize[g0 + ii]]);
+                }
+            }
+            canonical = true;
+            return ret;
+        }
+    };
+
+    /**
+     * @brief keys of one polyline for the duplicate cleaning: the polyline into polySet,
+     * its straight segments into linesPoly and its bulged ones into arcsPoly
+     *
+     * verts are the nVert points (x y z) in the polyline's OCS, z the elevation for LWPOLYLINE;
+     * bulges are nBulge values, missing ones count as 0. POLYLINE_3D passes a zero extrusion and no bulges.
+     * A closed polyline also gets the segment from the last vertex back to the first, with the last bulge,
+     * unless the two coincide.
+     */
+    inline void appendPolylineKeys(PolylineGeomSet &polySet, t_eigenPts<6> &linesPoly, t_eigenPts<9> &arcsPoly,
+                                   int64_t listIdx, const double *verts, int64_t nVert,
+                                   const double *bulges, int64_t nBulge, bool closed, const Vec3 &extrusion)
+    {
+        auto vert = [&](int64_t iv)
+        { return Vec3{verts[iv * 3], verts[iv * 3 + 1], verts[iv * 3 + 2]}; };
+        auto bulge = [&](int64_t iv)
+        { return iv < nBulge ? bulges[iv] : 0.0; };
+
+        double *polyVecC = polySet.appendPoly(listIdx, int(nVert), closed);
+        Eigen::Map<Vec3>{polyVecC} = extrusion;
+        for (int64_t iv = 0; iv < nVert; iv++)
+        {
+            Eigen::Map<Vec3>{polyVecC + 3 + iv * 4} = vert(iv);
+            polyVecC[6 + iv * 4] = bulge(iv);
+        }
+
+        auto addSegment = [&](const Vec3 &p0, const Vec3 &p1, double bulge)
+        {
+            if (std::abs(bulge) < 1e-6)
+            {
+                // TODO: if 2D, convert into OCS
+                Eigen::Vector<double, 6> lineDat;
+                lineDat(Seq012) = p0;
+                lineDat(Seq345) = p1;
+                linesPoly.push_back(lineDat);
+            }
+            else
+            {
+                // double ctanT = std::tan(pi / 2 - std::atan(bulge) * 2);
+                double ctanT = (1 - bulge * bulge) / (2 * bulge);
+                Vec3 p01 = p1 - p0;
+                Vec3 p01L = p01;
+                p01L(0) = -p01(1);
+                p01L(1) = p01(0);
+                Vec3 cent = 0.5 * (p0 + p1) + p01L * 0.5 * ctanT;
+                Vec3 pc0 = p0 - cent;
+                Vec3 pc1 = p1 - cent;
+                double rad = 0.5 * (pc0.norm() + pc1.norm());
+                double t0 = angleFromXY(pc0(0), pc0(1), pc0.norm());
+                double t1 = angleFromXY(pc1(0), pc1(1), pc1.norm());
+                if (bulge < 0)
+                    std::swap(t0, t1);
+                Eigen::Vector<double, 9> arcDat;
+                arcDat(Seq012) = extrusion;
+                arcDat(Seq345) = cent;
+                arcDat(6) = rad;
+                arcDat(7) = t0;
+                arcDat(8) = t1;
+                arcsPoly.push_back(arcDat);
+            }
+        };
+        for (int64_t iv = 1; iv < nVert; iv++)
+            addSegment(vert(iv - 1), vert(iv), bulge(iv - 1));
+        if (closed && nVert >= 2 && vert(nVert - 1) != vert(0))
+            addSegment(vert(nVert - 1), vert(0), bulge(nVert - 1));
+    }
+
+    namespace detail
+    {
+        /**
+         * @brief ellipse (center(3) sm_axis(3) ext(3) ratio t0 t1) -> key ext(3) center(3) axis(3) ratio t0 t1,
+         * center and axis not yet scaled
+         *
+         * The extrusion is normalized. The major axis and its negative give the same ellipse with the
+         * parameters shifted by pi, the one with its leading nonzero component (z, x, then y) positive is kept.
+         * Angles go to t0 in [0, 2pi) and t1 > t0, a full ellipse to (0, 2pi).
+         */
+        inline void EllipseRow(const double *e, double *o, double eps)
+        {
+            double ex = e[6], ey = e[7], ez = e[8];
+            double n = (ex * ex + ey * ey) + ez * ez;
+            if (n > 0)
+            {
+                n = std::sqrt(n);
+                ex /= n, ey /= n, ez /= n;
+            }
+            double ax = e[3], ay = e[4], az = e[5];
+            double aRef = 1e-13 * std::sqrt((ax * ax + ay * ay) + az * az);
+            bool flip;
+            if (std::abs(az) > aRef)
+                flip = az < 0;
+            else if (std::abs(ax) > aRef)
+                flip = ax < 0;
+            else
+                flip = ay < 0;
+            double t0 = e[10], t1 = e[11];
+            double span = t1 - t0;
+            if (span <= 0)
+                span += 2 * pi;
+            if (flip)
+                ax = -ax, ay = -ay, az = -az, t0 += pi;
+            t0 = std::fmod(t0, 2 * pi);
+            if (t0 < 0)
+                t0 += 2 * pi;
+            if (t0 >= 2 * pi - eps)
+                t0 -= 2 * pi;
+            if (span >= 2 * pi - eps)
+                t0 = 0, span = 2 * pi;
+            o[0] = ex, o[1] = ey, o[2] = ez;
+            o[3] = e[0], o[4] = e[1], o[5] = e[2];
+            o[6] = ax, o[7] = ay, o[8] = az;
+            o[9] = e[9], o[10] = t0, o[11] = t0 + span;
+        }
+    }
+
+    /**
+     * @brief ellipses (as EntityList stores them) to the keys of ellipsesDuplications,
+     * center and axis divided by their largest absolute value
+     */
+    inline auto ellipsesRegulate(t_eigenPts<12> &ellipses, double eps)
+    {
+        t_eigenPts<12> ret(ellipses.size());
+        double maxPos{1e-100};
+        for (size_t i = 0; i < ellipses.size(); i++)
+        {
+            detail::EllipseRow(ellipses[i].data(), ret[i].data(), eps);
+            for (int k = 3; k < 9; k++)
+                maxPos = std::max(maxPos, std::abs(ret[i][k]));
+        }
+        for (auto &v : ret)
+            v(Eigen::seq(3, 8)) /= maxPos;
+        return ret;
+    }
+
+    /**
+     * @brief groups of ellipses within eps of each other after ellipsesRegulate, transitively
+     */
+    inline auto ellipsesDuplications(t_eigenPts<12> &ellipses, double eps = 1e-8, int nThreads = 1,
+                                     const DupSearchOptions &opts = {}, DupSearchCounters *counters = nullptr)
+    {
+        auto ellipsesReg = ellipsesRegulate(ellipses, eps);
+        return getPtsDuplications<12>(ellipsesReg, eps, nThreads, opts, counters);
+    }
+
+    class SplineGeomSet
+    {
+        //* spline k is arena[offsets[k] ...]: x y z w per control point, then the knots
+        std::vector<double> arena;
+        std::vector<int64_t> offsets;
+        std::vector<std::array<int64_t, 4>> shapes; //* degree, periodic, nCtrl, nKnot
+        std::vector<int64_t> spline2list;
+        bool canonical = false;
+
+        /**
+         * @brief scales the control points by 1 / maxL and the weights by their largest,
+         * maps the knots onto [0, 1] and orients the spline so that the lower end comes first
+         */
+        static void canonicalize(double *v, int64_t nCtrl, int64_t nKnot, double maxL, double eps)
+        {
+            double maxW{0};
+            for (int64_t i = 0; i < nCtrl; i++)
+                maxW = std::max(maxW, std::abs(v[4 * i + 3]));
+            for (int64_t i = 0; i < nCtrl; i++)
+            {
+                for (int d = 0; d < 3; d++)
+                    v[4 * i + d] /= maxL;
+                if (maxW > 0)
+                    v[4 * i + 3] /= maxW;
+            }
+            double *knots = v + 4 * nCtrl;
+            if (nKnot)
+            {
+                double k0 = knots[0], kSpan = knots[nKnot - 1] - knots[0];
+                for (int64_t i = 0; i < nKnot; i++)
+                    knots[i] = kSpan > 0 ? (knots[i] - k0) / kSpan : 0;
+            }
+            if (nCtrl < 2)
+                return;
+            auto ctrl = [&](int64_t i)
+            { return Vec3{v[4 * i], v[4 * i + 1], v[4 * i + 2]}; };
+
+            int cmp = coordCompare(ctrl(0), ctrl(nCtrl - 1), eps);
+            if (cmp == 0)
+                cmp = coordCompare(ctrl(1), ctrl(nCtrl - 2), eps);
+            for (int64_t i = 0; i < nKnot && cmp == 0; i++) //* against the reversed knots 1 - knots[nKnot - 1 - i]
+            {
+                double kr = 1 - knots[nKnot - 1 - i];
+                if (knots[i] < kr - eps)
+                    cmp = -1;
+                else if (knots[i] - eps > kr)
+                    cmp = 1;
+            }
+            if (cmp > 0)
+            {
+                for (int64_t i = 0; i < nCtrl / 2; i++)
+                    for (int d = 0; d < 4; d++)
+                        std::swap(v[4 * i + d], v[4 * (nCtrl - 1 - i) + d]);
+                std::reverse(knots, knots + nKnot);
+                for (int64_t i = 0; i < nKnot; i++)
+                    knots[i] = 1 - knots[i];
+            }
+        }
+
+    public:
+        /**
+         * @brief appends a spline of nCtrl control points and nKnot knots,
+         * only splines of the same degree, periodicity and counts are compared
+         * @return its nCtrl * 4 + nKnot values, zeroed, to be filled before the next append;
+         * throws after getDuplicates, as PolylineGeomSet::appendPoly
+         */
+        double *appendSpline(int64_t list_idx, int degree, bool periodic, int64_t nCtrl, int64_t nKnot)
+        {
+            if (canonical)
+                throw std::logic_error("SplineGeomSet: appendSpline after getDuplicates");
+            spline2list.push_back(list_idx);
+            shapes.push_back({int64_t(degree), int64_t(periodic), nCtrl, nKnot});
+            offsets.push_back(int64_t(arena.size()));
+            arena.resize(arena.size() + size_t(nCtrl * 4 + nKnot), 0.0);
+            return arena.data() + offsets.back();
+        }
+
+        int64_t size() const { return int64_t(offsets.size()); }
+
+        /**
+         * @brief groups of duplicate splines, as list indices
+         *
+         * As PolylineGeomSet::getDuplicates: splines of one shape are canonicalized in place,
+         * then a grid hash over their values gives the candidates, which are verified with the full distance.
+         */
+        auto getDuplicates(double eps = 1e-8, int nThreads = 1,
+                           const DupSearchOptions &opts = {}, DupSearchCounters *counters = nullptr)
+        {
+            DupSearchOptions optsGrid = opts;
+            optsGrid.backend = DupSearchBackend::GridHash;
+            std::vector<std::set<int64_t>> ret;
+            //* by shape, then in insertion order
+            std::vector<int64_t> byShape(shapes.size());
+            for (int64_t i = 0; i < int64_t(byShape.size()); i++)
+                byShape[i] = i;
+            std::stable_sort(byShape.begin(), byShape.end(),
+                             [&](int64_t a, int64_t b)
+                             { return shapes[a] < shapes[b]; });
+
+            for (size_t g0 = 0, g1 = 0; g0 < byShape.size(); g0 = g1)
+            {
+                auto shape = shapes[byShape[g0]];
+                int64_t nCtrl = shape[2], nKnot = shape[3];
+                while (g1 < byShape.size() && shapes[byShape[g1]] == shape)
+                    g1++;
+                std::vector<int64_t> groupOffsets(g1 - g0);
+                for (size_t k = 0; k < groupOffsets.size(); k++)
+                    groupOffsets[k] = offsets[byShape[g0 + k]];
+
+                if (!canonical)
+                {
+                    double maxL{1e-100};
+                    for (auto o : groupOffsets)
+                        for (int64_t i = 0; i < nCtrl; i++)
+                            for (int d = 0; d < 3; d++)
+                                maxL = std::max(maxL, std::abs(arena[o + 4 * i + d]));
+                    ParallelForChunks(
+                        int64_t(groupOffsets.size()), nThreads,
+                        [&](int64_t begin, int64_t end)
+                        {
+                            for (int64_t k = begin; k < end; k++)
+                                canonicalize(arena.data() + groupOffsets[k], nCtrl, nKnot, maxL, eps);
+                        });
                 }
+                if (nCtrl * 4 + nKnot == 0)
+                    continue;
 
-                auto dups = getPtsDuplications<Eigen::Dynamic>(polyVecsCur, eps);
+                detail::FlatRows rows{arena.data(), groupOffsets.data(), int64_t(groupOffsets.size()), nCtrl * 4 + nKnot};
+                auto dups = detail::PtsDuplicationGroups(rows, eps, nThreads, optsGrid, counters);
                 for (auto &ss : dups)
                 {
                     ret.emplace_back();
                     for (auto ii : ss)
-                        ret.back().insert(poly2list[localIdx[ii]]);
+                        ret.back().insert(spline2list[byShape[g0 + ii]]);
                 }
             }
+            canonical = true;
             return ret;
         }
     };
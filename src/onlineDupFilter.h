@@ -0,0 +1,93 @@
+#pragma once
+
+#include "entityStore.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace DwgSim
+{
+    /**
+     * @brief rejects LINE, ARC, CIRCLE and POLYLINE_2D/3D entities whose geometry equals an earlier one of the same list
+     *
+     * The key is what CleanLineEntityDuplication compares: the line end points,
+     * the arc record (CIRCLE is an arc from 0 to 2pi) or the polyline closed flag, extrusion, vertices and bulges
+     * (both zero for POLYLINE_3D). Keys are compared bit by bit, so a rejected entity is one that
+     * --dupDel 1 would delete in favour of the earlier copy; near duplicates are left to that pass.
+     * Keys with NaN or infinity are never rejected, they are no duplicates of anything there either.
+     *
+     * Kept entities are indexed by a hash of their key, the key itself is read back from the list.
+     */
+    class OnlineDupFilter
+    {
+        std::unordered_multimap<uint64_t, int64_t> seen; //* key hash -> index in ents
+        std::vector<double> key, keyOther;
+
+        //* false for entities the filter does not handle
+        static bool keyOf(const EntityList &list, int64_t i, std::vector<double> &k)
+        {
+            auto &ent = list.ents[i];
+            k.clear();
+            switch (ent.type)
+            {
+            case EntityType::Line:
+                k.push_back(0);
+                k.insert(k.end(), list.line(ent.rec), list.line(ent.rec) + EntityList::lineRecSize);
+                return true;
+            case EntityType::Arc:
+            case EntityType::Circle:
+                k.push_back(1);
+                k.insert(k.end(), list.arc(ent.rec), list.arc(ent.rec) + EntityList::arcRecSize);
+                return true;
+            case EntityType::Polyline2D:
+            case EntityType::Polyline3D:
+            {
+                auto &poly = list.polylines[ent.rec];
+                bool is3D = ent.type == EntityType::Polyline3D;
+                k.push_back(2);
+                k.push_back(double(poly.nVert));
+                k.push_back(polylineIsClosed(ent.type, poly) ? 1.0 : 0.0);
+                for (int d = 0; d < 3; d++)
+                    k.push_back(is3D ? 0.0 : poly.extrusion[d]);
+                for (int64_t iv = 0; iv < poly.nVert; iv++)
+                {
+                    k.insert(k.end(), list.polyVert(poly, iv), list.polyVert(poly, iv) + 3);
+                    k.push_back(is3D ? 0.0 : list.polyBulge(poly, iv));
+                }
+                return true;
+            }
+            default:
+                return false;
+            }
+        }
+
+    public:
+        /**
+         * @brief checks the last entity of list against the kept ones
+         * @return false if it duplicates one, the caller drops it then; true if it was kept (and indexed)
+         */
+        bool keepLast(const EntityList &list)
+        {
+            int64_t i = list.size() - 1;
+            if (!keyOf(list, i, key))
+                return true;
+            for (double v : key)
+                if (!std::isfinite(v))
+                    return true;
+            uint64_t h = HashDoubleBits(key.data(), key.size());
+            auto [begin, end] = seen.equal_range(h);
+            for (auto it = begin; it != end; ++it)
+            {
+                keyOf(list, it->second, keyOther);
+                if (keyOther.size() == key.size() &&
+                    std::memcmp(keyOther.data(), key.data(), key.size() * sizeof(double)) == 0)
+                    return false;
+            }
+            seen.emplace(h, i);
+            return true;
+        }
+    };
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace DwgSim
+{
+    /**
+     * @brief number of threads to use, nThreads <= 0 means all hardware threads
+     */
+    inline int ResolveThreadCount(int nThreads)
+    {
+        if (nThreads > 0)
+            return nThreads;
+        return std::max(1, int(std::thread::hardware_concurrency()));
+    }
+
+    /**
+     * @brief calls f(order[k]) for every k on up to nThreads threads
+     *
+     * Idle threads take the next task from a shared counter, so tasks start in the given order;
+     * put the most expensive ones first to balance the load.
+     * f must only write to its own task's output.
+     * If tasks throw, the exception of the lowest task index is rethrown after all threads join,
+     * the same one a serial loop over 0 .. n-1 would stop at.
+     */
+    template <class F>
+    void ParallelForOrdered(const std::vector<int64_t> &order, int nThreads, F &&f)
+    {
+        int64_t n = int64_t(order.size());
+        nThreads = int(std::min<int64_t>(ResolveThreadCount(nThreads), n));
+
+        std::atomic<int64_t> next{0};
+        std::mutex errMutex;
+        int64_t errTask = INT64_MAX;
+        std::exception_ptr err;
+
+        auto worker = [&]()
+        {
+            for (int64_t k = next++; k < n; k = next++)
+            {
+                try
+                {
+                    f(order[k]);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(errMutex);
+                    if (order[k] < errTask)
+                        errTask = order[k], err = std::current_exception();
+                }
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(std::max(nThreads - 1, 0));
+        for (int t = 1; t < nThreads; t++)
+            threads.emplace_back(worker);
+        worker();
+        for (auto &t : threads)
+            t.join();
+        if (err)
+            std::rethrow_exception(err);
+    }
+
+    /**
+     * @brief ParallelForOrdered over 0 .. n-1
+     */
+    template <class F>
+    void ParallelFor(int64_t n, int nThreads, F &&f)
+    {
+        std::vector<int64_t> order(n);
+        for (int64_t i = 0; i < n; i++)
+            order[i] = i;
+        ParallelForOrdered(order, nThreads, std::forward<F>(f));
+    }
+
+    /**
+     * @brief ParallelFor over nChunk contiguous ranges of 0 .. n-1, f(begin, end)
+     *
+     * For per-item work too small to be a task; f can keep buffers for its whole range.
+     * A few chunks per thread balance the load.
+     */
+    template <class F>
+    void ParallelForChunks(int64_t n, int nThreads, F &&f)
+    {
+        nThreads = ResolveThreadCount(nThreads);
+        int64_t nChunk = nThreads == 1 ? std::min<int64_t>(n, 1) : std::min<int64_t>(n, int64_t(nThreads) * 8);
+        ParallelFor(
+            nChunk, nThreads,
+            [&](int64_t c)
+            { f(n * c / nChunk, n * (c + 1) / nChunk); });
+    }
+
+    /**
+     * @brief lock-free union-find over 0 .. n-1
+     *
+     * A root is always linked under the smaller root, so the root of a set is its smallest element
+     * and the sets are the same whatever order the unions come in.
+     */
+    class ConcurrentUnionFind
+    {
+        std::vector<std::atomic<int64_t>> parent;
+
+    public:
+        explicit ConcurrentUnionFind(int64_t n) : parent(n)
+        {
+            for (int64_t i = 0; i < n; i++)
+                parent[i].store(i, std::memory_order_relaxed);
+        }
+
+        int64_t find(int64_t x)
+        {
+            while (true)
+            {
+                int64_t p = parent[x].load(std::memory_order_acquire);
+                if (p == x)
+                    return x;
+                int64_t gp = parent[p].load(std::memory_order_acquire);
+                if (gp != p) // path halving, losing the race is harmless
+                    parent[x].compare_exchange_weak(p, gp, std::memory_order_acq_rel);
+                x = gp;
+            }
+        }
+
+        void unite(int64_t a, int64_t b)
+        {
+            while (true)
+            {
+                a = find(a), b = find(b);
+                if (a == b)
+                    return;
+                if (a > b)
+                    std::swap(a, b);
+                int64_t expected = b;
+                if (parent[b].compare_exchange_strong(expected, a, std::memory_order_acq_rel))
+                    return;
+            }
+        }
+    };
+}
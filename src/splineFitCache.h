@@ -0,0 +1,166 @@
+#pragma once
+
+#include "splineUtil.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace DwgSim
+{
+    /**
+     * @brief inputs of one fit-point spline fit, translated so that the first fit point is the origin
+     */
+    struct SplineFitInput
+    {
+        VecX knots;
+        Mat3X fit_pts; //* relative to origin
+        Vec3 start_tan{0, 0, 0};
+        Vec3 end_tan{0, 0, 0};
+        bool closed = false;
+        Vec3 origin{0, 0, 0};
+
+        //* everything the fit depends on, flattened
+        std::vector<double> key(int knotparam) const
+        {
+            std::vector<double> ret;
+            ret.reserve(4 + 6 + knots.size() + fit_pts.size());
+            ret.push_back(double(knotparam));
+            ret.push_back(closed ? 1.0 : 0.0);
+            ret.push_back(double(knots.size()));
+            ret.push_back(double(fit_pts.cols()));
+            ret.insert(ret.end(), start_tan.data(), start_tan.data() + 3);
+            ret.insert(ret.end(), end_tan.data(), end_tan.data() + 3);
+            ret.insert(ret.end(), knots.data(), knots.data() + knots.size());
+            ret.insert(ret.end(), fit_pts.data(), fit_pts.data() + fit_pts.size());
+            return ret;
+        }
+    };
+
+    /**
+     * @brief fit result relative to the SplineFitInput origin
+     */
+    struct SplineFitResult
+    {
+        VecX b_knots;
+        Mat3X b_pts;
+    };
+
+    /**
+     * @brief content-addressed store of spline fits
+     *
+     * Keys are the translated fit inputs, compared bit by bit,
+     * so copies of a spline that differ by an exactly representable shift share one fit.
+     * The fit only ever sees the translated input, so a hit gives the same bits as a fresh fit.
+     */
+    class SplineFitCache
+    {
+        struct KeyHash
+        {
+            size_t operator()(const std::vector<double> &k) const
+            {
+                return size_t(HashDoubleBits(k.data(), k.size()));
+            }
+        };
+        struct KeyEqual
+        {
+            bool operator()(const std::vector<double> &a, const std::vector<double> &b) const
+            {
+                return a.size() == b.size() &&
+                       (a.empty() || std::memcmp(a.data(), b.data(), a.size() * sizeof(double)) == 0);
+            }
+        };
+
+        std::unordered_map<std::vector<double>, SplineFitResult, KeyHash, KeyEqual> entries;
+
+        static constexpr char fileMagic[8] = {'D', 'W', 'G', 'S', 'F', 'I', 'T', '1'};
+
+    public:
+        int64_t nHit = 0;
+        int64_t nMiss = 0;
+
+        size_t size() const { return entries.size(); }
+
+        SplineFitResult *find(const std::vector<double> &key)
+        {
+            auto it = entries.find(key);
+            return it == entries.end() ? nullptr : &it->second;
+        }
+
+        /**
+         * @brief the entry for key, default constructed if new
+         */
+        SplineFitResult &operator[](const std::vector<double> &key) { return entries[key]; }
+
+        /**
+         * @brief writes all entries, native byte order
+         */
+        void Save(const std::string &path) const
+        {
+            std::ofstream o(path, std::ios::binary);
+            if (!o)
+                throw std::runtime_error("cannot open spline fit cache for writing: " + path);
+            auto writeU64 = [&](uint64_t v)
+            { o.write(reinterpret_cast<const char *>(&v), sizeof(v)); };
+            auto writeDoubles = [&](const double *v, size_t n)
+            {
+                writeU64(n);
+                o.write(reinterpret_cast<const char *>(v), std::streamsize(n * sizeof(double)));
+            };
+            o.write(fileMagic, sizeof(fileMagic));
+            writeU64(entries.size());
+            for (auto &[key, res] : entries)
+            {
+                writeDoubles(key.data(), key.size());
+                writeDoubles(res.b_knots.data(), size_t(res.b_knots.size()));
+                writeDoubles(res.b_pts.data(), size_t(res.b_pts.size()));
+            }
+            if (!o)
+                throw std::runtime_error("failed writing spline fit cache: " + path);
+        }
+
+        /**
+         * @brief adds the entries of a file written by Save
+         * @return false if the file cannot be opened or is not a spline fit cache, nothing is added then
+         */
+        bool Load(const std::string &path)
+        {
+            std::ifstream in(path, std::ios::binary);
+            if (!in)
+                return false;
+            char magic[sizeof(fileMagic)];
+            if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, fileMagic, sizeof(magic)) != 0)
+                return false;
+            auto readU64 = [&](uint64_t &v)
+            { return bool(in.read(reinterpret_cast<char *>(&v), sizeof(v))); };
+            auto readDoubles = [&](std::vector<double> &v)
+            {
+                uint64_t n;
+                if (!readU64(n) || n > (uint64_t(1) << 32))
+                    return false;
+                v.resize(n);
+                return bool(in.read(reinterpret_cast<char *>(v.data()), std::streamsize(n * sizeof(double))));
+            };
+            uint64_t nEntry;
+            if (!readU64(nEntry))
+                return false;
+            std::vector<std::pair<std::vector<double>, SplineFitResult>> loaded;
+            std::vector<double> key, knots, pts;
+            for (uint64_t i = 0; i < nEntry; i++)
+            {
+                if (!readDoubles(key) || !readDoubles(knots) || !readDoubles(pts) || pts.size() % 3)
+                    return false;
+                SplineFitResult res;
+                res.b_knots = Eigen::Map<VecX>(knots.data(), int64_t(knots.size()));
+                res.b_pts = Eigen::Map<Mat3X>(pts.data(), 3, int64_t(pts.size() / 3));
+                loaded.emplace_back(key, std::move(res));
+            }
+            for (auto &[k, res] : loaded)
+                entries.try_emplace(std::move(k), std::move(res));
+            return true;
+        }
+    };
+}
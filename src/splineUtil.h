@@ -3,9 +3,9 @@
 #include "dwgsimDefs.h"
 
 #include <Eigen/Dense>
-#include <rapidjson/rapidjson.h>
-#include <rapidjson/document.h>
-#include <rapidjson/allocators.h>
+
+#include <algorithm>
+#include <vector>
 
 namespace DwgSim
 {
@@ -16,79 +16,33 @@ namespace DwgSim
 
     static const double verySmallDouble = 1e-200;
 
-    inline VecX RapidJsonGetVecX(const rapidjson::Value &a)
+    /**
+     * @brief gathers n values from a flat buffer
+     *
+     * @param a buffer start
+     * @param stride distance between consecutive values
+     */
+    inline VecX BufferGetVecX(const double *a, int64_t n, int stride = 1)
     {
-        if (!a.IsArray())
-            throw std::runtime_error("input is not array");
         VecX ret;
-        ret.resize(a.Size());
-        for (int64_t i = 0; i < ret.size(); i++)
-            ret[i] = a[i].GetDouble();
+        ret.resize(n);
+        for (int64_t i = 0; i < n; i++)
+            ret[i] = a[i * stride];
         return ret;
     }
 
-    inline VecX RapidJsonGetVecX4th(const rapidjson::Value &a)
+    /**
+     * @brief gathers n points from a flat buffer of (x y z ...) records
+     *
+     * @param stride record size, 3 for points, 4 for weighted control points
+     */
+    inline Mat3X BufferGetMat3X(const double *a, int64_t n, int stride = 3)
     {
-        if (!a.IsArray())
-            throw std::runtime_error("input is not array");
-        VecX ret;
-        ret.resize(a.Size());
-        for (int64_t i = 0; i < ret.size(); i++)
-            ret[i] = a[i][3].GetDouble();
-        return ret;
-    }
-
-    inline Vec3 RapidJsonGetVec3(const rapidjson::Value &a)
-    {
-        if (!a.IsArray() || a.Size() < 3)
-            throw std::runtime_error("input is not at least 3-sized array");
-        Vec3 ret;
-        for (int64_t i = 0; i < 3; i++)
-            ret[i] = a[i].GetDouble();
-        return ret;
-    }
-
-    inline Mat3X RapidJsonGetMat3X(const rapidjson::Value &a)
-    {
-        if (!a.IsArray())
-            throw std::runtime_error("input is not array");
         Mat3X ret;
-        ret.resize(Eigen::NoChange, a.Size());
-        for (int64_t i = 0; i < a.Size(); i++)
-            ret(Eigen::all, i) = RapidJsonGetVec3(a[i]);
-        return ret;
-    }
-
-    inline rapidjson::Value VecXGetRapidJson(
-        const VecX &m,
-        rapidjson::MemoryPoolAllocator<> &alloc)
-    {
-        rapidjson::Value ret(rapidjson::kArrayType);
-        ret.Reserve(m.size(), alloc);
-        for (int64_t i = 0; i < m.size(); i++)
-            ret.PushBack(m[i], alloc);
-        return ret;
-    }
-
-    inline rapidjson::Value Vec3GetRapidJson(
-        const Vec3 &m,
-        rapidjson::MemoryPoolAllocator<> &alloc)
-    {
-        rapidjson::Value ret(rapidjson::kArrayType);
-        ret.Reserve(3, alloc);
-        for (int i = 0; i < 3; i++)
-            ret.PushBack(m[i], alloc);
-        return ret;
-    }
-
-    inline rapidjson::Value Mat3XGetRapidJson(
-        const Mat3X &m,
-        rapidjson::MemoryPoolAllocator<> &alloc)
-    {
-        rapidjson::Value ret(rapidjson::kArrayType);
-        ret.Reserve(m.cols(), alloc);
-        for (int64_t i = 0; i < m.cols(); i++)
-            ret.PushBack(Vec3GetRapidJson(m(Eigen::all, i), alloc), alloc);
+        ret.resize(Eigen::NoChange, n);
+        for (int64_t i = 0; i < n; i++)
+            for (int d = 0; d < 3; d++)
+                ret(d, i) = a[i * stride + d];
         return ret;
     }
 
@@ -246,56 +200,427 @@ namespace DwgSim
         ddBases = ddBasesC(Eigen::seq(0, nBases - 1), Eigen::all);
     }
 
+    namespace detail
+    {
+        /**
+         * @brief inserts knot u r times into a B-Spline, the NURBS Book A5.1
+         *
+         * knots and points (one point per column, homogeneous if rational) are replaced by the refined ones
+         */
+        inline void BSplineKnotInsert(int p, std::vector<double> &knots, MatX &points, double u, int r)
+        {
+            if (r <= 0)
+                return;
+            int64_t nP = points.cols();
+            int64_t k = int64_t(std::upper_bound(knots.begin(), knots.end(), u) - knots.begin()) - 1;
+            int s = 0;
+            while (s <= k && knots[k - s] == u)
+                s++;
+            if (k < p || k - s >= nP)
+                throw std::runtime_error("B-Spline knot to insert out of range");
+            if (s + r > p)
+                throw std::runtime_error("B-Spline knot multiplicity exceeds degree");
+
+            std::vector<double> knotsNew(knots.size() + r);
+            std::copy(knots.begin(), knots.begin() + k + 1, knotsNew.begin());
+            std::fill(knotsNew.begin() + k + 1, knotsNew.begin() + k + 1 + r, u);
+            std::copy(knots.begin() + k + 1, knots.end(), knotsNew.begin() + k + 1 + r);
+
+            MatX pointsNew(points.rows(), nP + r);
+            pointsNew.leftCols(k - p + 1) = points.leftCols(k - p + 1);
+            pointsNew.rightCols(nP - (k - s)) = points.rightCols(nP - (k - s));
+            MatX R = points.middleCols(k - p, p - s + 1);
+            int64_t L = k - p;
+            for (int j = 1; j <= r; j++)
+            {
+                L = k - p + j;
+                for (int i = 0; i <= p - j - s; i++)
+                {
+                    double alpha = (u - knots[L + i]) / (knots[i + k + 1] - knots[L + i]);
+                    R.col(i) = alpha * R.col(i + 1) + (1.0 - alpha) * R.col(i);
+                }
+                pointsNew.col(L) = R.col(0);
+                pointsNew.col(k + r - j - s) = R.col(p - j - s);
+            }
+            for (int64_t i = L + 1; i < k - s; i++)
+                pointsNew.col(i) = R.col(i - L);
+
+            knots = std::move(knotsNew);
+            points = std::move(pointsNew);
+        }
+    }
+
+    /**
+     * @brief exact clamped (open) form of a periodic B-Spline, by knot insertion
+     *
+     * b_knots_p are the n + 1 knots of one period for the n points b_points_p,
+     * the same layout as BSplineBasesPeriodic.
+     * The points are one per column, of any dimension; pass homogeneous (w x, w y, w z, w) for rational splines.
+     * The curve is unrolled over one period and both period ends are inserted up to multiplicity p,
+     * giving the n + p points and n + 2p + 1 knots [t0 x (p + 1), t1 .. tn-1, tn x (p + 1)]
+     * of the same curve over [t0, tn]. O(n p), no linear solve.
+     */
     inline void PeriodicSplineToOpenSpline(
-        const VecX &b_knots_p, const Mat3X &b_points_p,
-        VecX &b_knots, Mat3X &b_points)
+        int p,
+        const VecX &b_knots_p, const MatX &b_points_p,
+        VecX &b_knots, MatX &b_points)
     {
-        // Note: this only fits to cubic b-spline, using standard
-        // double maxKnot = b_knots_p.maxCoeff();
-        // double minKnot = b_knots_p.minCoeff();
-        // double knotInterval = maxKnot - minKnot;
-        // if (knotInterval < verySmallDouble)
-        //     throw numerical_error("knot input too close to same");
-        // for (int i = 1; i < b_knots_p.size(); i++)
-        //     if (b_knots_p[i - 1] > b_knots_p[i])
-        //         throw numerical_error("knot input not ascending");
-
-        // b_knots.resize(b_knots_p.size() + 6);
-        // b_knots(Eigen::seq(3, 3 + b_knots_p.size() - 1)) = b_knots_p;
-        // b_knots(Eigen::seq(0, 2)).setConstant(minKnot);
-        // b_knots(Eigen::seq(3 + b_knots_p.size(), Eigen::last)).setConstant(maxKnot);
-
-        // MatX bases, dBases, ddBases;
-        // BSplineBases(3, b_knots, b_knots_p, bases, dBases, ddBases);
+        int64_t n = b_points_p.cols();
+        if (p < 1)
+            throw std::runtime_error("B-Spline degree should be at least 1");
+        if (b_knots_p.size() != n + 1)
+            throw std::runtime_error("periodic B-Spline should have n + 1 knots for n points");
+        if (n <= p)
+            throw std::runtime_error("periodic B-Spline should have more points than its degree");
+        for (int64_t i = 0; i < n; i++)
+            if (b_knots_p[i] > b_knots_p[i + 1])
+                throw std::runtime_error("knot input not ascending");
+        double t0 = b_knots_p[0], tn = b_knots_p[n];
+        double period = tn - t0;
+        if (period <= 0)
+            throw std::runtime_error("periodic B-Spline knot period is zero");
+
+        //* knots unrolled p periods-worth to both sides, extended point k is periodic point k - p
+        std::vector<double> ext(n + 2 * p + 1);
+        for (int64_t k = 0; k < int64_t(ext.size()); k++)
+        {
+            int64_t i = k - p;
+            int64_t nPeriod = i >= 0 ? i / n : -((-i + n - 1) / n);
+            ext[k] = i >= 0 && i <= n ? b_knots_p[i] : b_knots_p[i - nPeriod * n] + nPeriod * period;
+        }
+        MatX pts(b_points_p.rows(), n + p);
+        for (int64_t k = 0; k < n + p; k++)
+            pts.col(k) = b_points_p.col(((k - p) % n + n) % n);
+
+        auto multiplicity = [&](double u)
+        { return int(std::upper_bound(ext.begin(), ext.end(), u) - std::lower_bound(ext.begin(), ext.end(), u)); };
+        detail::BSplineKnotInsert(p, ext, pts, t0, p - multiplicity(t0));
+        detail::BSplineKnotInsert(p, ext, pts, tn, p - multiplicity(tn));
+
+        //* with p copies of t0, the first point on [t0, tn] is at the one before them,
+        //* and the knot before them no longer matters; the same at tn
+        int64_t iBeg = int64_t(std::lower_bound(ext.begin(), ext.end(), t0) - ext.begin()) - 1;
+        int64_t iEnd = int64_t(std::lower_bound(ext.begin(), ext.end(), tn) - ext.begin()) - 1;
+        int64_t nOut = iEnd - iBeg + 1; // n + p
+
+        b_points = pts.middleCols(iBeg, nOut);
+        b_knots.resize(nOut + p + 1);
+        for (int64_t k = 0; k < b_knots.size(); k++)
+            b_knots[k] = ext[iBeg + k];
+        b_knots[0] = t0;
+        b_knots[b_knots.size() - 1] = tn;
     }
 
-    inline void CubicSplineToBSpline(
+    /**
+     * @brief values and first two derivatives of the p + 1 B-Spline bases nonzero in knot span [knots[span], knots[span + 1])
+     *
+     * ders[k][j] is the k-th derivative of basis span - p + j at u; the local Cox-de Boor recursion
+     * (algorithm A2.3 of The NURBS Book), the span must have nonzero length
+     */
+    template <int p>
+    void BSplineBasisDers(const double *knots, int64_t span, double u, double ders[3][p + 1])
+    {
+        double ndu[p + 1][p + 1];
+        double left[p + 1], right[p + 1];
+        ndu[0][0] = 1.0;
+        for (int j = 1; j <= p; j++)
+        {
+            left[j] = u - knots[span + 1 - j];
+            right[j] = knots[span + j] - u;
+            double saved = 0.0;
+            for (int r = 0; r < j; r++)
+            {
+                ndu[j][r] = right[r + 1] + left[j - r];
+                double temp = ndu[r][j - 1] / ndu[j][r];
+                ndu[r][j] = saved + right[r + 1] * temp;
+                saved = left[j - r] * temp;
+            }
+            ndu[j][j] = saved;
+        }
+        for (int j = 0; j <= p; j++)
+            ders[0][j] = ndu[j][p];
+
+        const int nDer = std::min(2, p);
+        for (int k = nDer + 1; k <= 2; k++)
+            for (int j = 0; j <= p; j++)
+                ders[k][j] = 0.0;
+        double a[2][p + 1];
+        for (int r = 0; r <= p; r++)
+        {
+            int s1 = 0, s2 = 1;
+            a[0][0] = 1.0;
+            for (int k = 1; k <= nDer; k++)
+            {
+                double d = 0.0;
+                int rk = r - k, pk = p - k;
+                if (r >= k)
+                {
+                    a[s2][0] = a[s1][0] / ndu[pk + 1][rk];
+                    d = a[s2][0] * ndu[rk][pk];
+                }
+                int j1 = rk >= -1 ? 1 : -rk;
+                int j2 = (r - 1 <= pk) ? k - 1 : p - r;
+                for (int j = j1; j <= j2; j++)
+                {
+                    a[s2][j] = (a[s1][j] - a[s1][j - 1]) / ndu[pk + 1][rk + j];
+                    d += a[s2][j] * ndu[rk + j][pk];
+                }
+                if (r <= pk)
+                {
+                    a[s2][k] = -a[s1][k - 1] / ndu[pk + 1][r];
+                    d += a[s2][k] * ndu[r][pk];
+                }
+                ders[k][r] = d;
+                std::swap(s1, s2);
+            }
+        }
+        double fac = p;
+        for (int k = 1; k <= nDer; k++)
+        {
+            for (int j = 0; j <= p; j++)
+                ders[k][j] *= fac;
+            fac *= (p - k);
+        }
+    }
+
+    /**
+     * @brief power coefficients of the uniform cubic B-Spline bases on one span, times 6
+     *
+     * basis r (span - 3 + r) at local coordinate t in [0, 1) is sum_k uniformCubicCoeffs[r][k] t^k / 6
+     */
+    static constexpr double uniformCubicCoeffs[4][4] = {
+        {1, -3, 3, -1},
+        {4, 0, -6, 3},
+        {1, 3, 3, -3},
+        {0, 0, 0, 1},
+    };
+
+    /**
+     * @brief BSplineBasisDers<3> for a span whose 6 surrounding knots are equally spaced by h
+     */
+    inline void UniformCubicBasisDers(double t, double h, double ders[3][4])
+    {
+        for (int r = 0; r < 4; r++)
+        {
+            const double *c = uniformCubicCoeffs[r];
+            ders[0][r] = (c[0] + t * (c[1] + t * (c[2] + t * c[3]))) * (1. / 6.);
+            ders[1][r] = (c[1] + t * (2 * c[2] + t * 3 * c[3])) * (1. / 6.) / h;
+            ders[2][r] = (2 * c[2] + 6 * c[3] * t) * (1. / 6.) / (h * h);
+        }
+    }
+
+    static const int bSplineMaxLocalDegree = 7;
+
+    /**
+     * @brief the p + 1 nonzero bases of a B-Spline at each sample, with first and second derivatives
+     *
+     * sample j has bases first[j] .. first[j] + p nonzero,
+     * their values in column j of N, dN and ddN ((p + 1) x nSamples)
+     */
+    struct BSplineLocalBases
+    {
+        int p = 0;
+        int64_t nBases = 0;
+        std::vector<int64_t> first;
+        MatX N, dN, ddN;
+
+        int64_t basis(int64_t j, int r) const
+        {
+            return first[j] + r;
+        }
+
+        void resize(int nP, int64_t nNBases, int64_t nSamps)
+        {
+            p = nP, nBases = nNBases;
+            first.resize(nSamps);
+            N.resize(p + 1, nSamps);
+            dN.resize(p + 1, nSamps);
+            ddN.resize(p + 1, nSamps);
+        }
+    };
+
+    namespace detail
+    {
+        template <int p>
+        void BSplineLocalBasesFill(const double *knots, int64_t span, double u, BSplineLocalBases &lb, int64_t j)
+        {
+            double ders[3][p + 1];
+            bool uniform = false;
+            if constexpr (p == 3)
+            {
+                double h = knots[span + 1] - knots[span];
+                uniform = true;
+                for (int k = -2; k <= 2; k++)
+                    uniform = uniform && (knots[span + k + 1] - knots[span + k] == h);
+                if (uniform)
+                    UniformCubicBasisDers((u - knots[span]) / h, h, ders);
+            }
+            if (!uniform)
+                BSplineBasisDers<p>(knots, span, u, ders);
+            for (int r = 0; r <= p; r++)
+            {
+                lb.N(r, j) = ders[0][r];
+                lb.dN(r, j) = ders[1][r];
+                lb.ddN(r, j) = ders[2][r];
+            }
+        }
+
+        inline void BSplineLocalBasesFill(int p, const double *knots, int64_t span, double u, BSplineLocalBases &lb, int64_t j)
+        {
+            switch (p)
+            {
+            case 1:
+                return BSplineLocalBasesFill<1>(knots, span, u, lb, j);
+            case 2:
+                return BSplineLocalBasesFill<2>(knots, span, u, lb, j);
+            case 3:
+                return BSplineLocalBasesFill<3>(knots, span, u, lb, j);
+            case 4:
+                return BSplineLocalBasesFill<4>(knots, span, u, lb, j);
+            case 5:
+                return BSplineLocalBasesFill<5>(knots, span, u, lb, j);
+            case 6:
+                return BSplineLocalBasesFill<6>(knots, span, u, lb, j);
+            case 7:
+                return BSplineLocalBasesFill<7>(knots, span, u, lb, j);
+            default:
+                throw std::runtime_error("B-Spline degree not supported by the local evaluator");
+            }
+        }
+
+        /**
+         * @brief span s in [lo, hi) with knots[s] <= u < knots[s + 1] and a nonzero length,
+         * the last nonzero span if u is at or beyond knots[hi]
+         */
+        inline int64_t BSplineFindSpan(const double *knots, int64_t lo, int64_t hi, double u)
+        {
+            if (u >= knots[hi])
+            {
+                int64_t s = hi - 1;
+                while (s > lo && !(knots[s] < knots[s + 1]))
+                    s--;
+                return s;
+            }
+            int64_t s = int64_t(std::upper_bound(knots + lo, knots + hi + 1, u) - knots) - 1;
+            return std::max(s, lo);
+        }
+    }
+
+    /**
+     * @brief local version of BSplineBases, O(p^2) per sample
+     */
+    inline void BSplineBasesLocal(
+        int p,
+        const VecX &b_knots, const VecX &b_samps,
+        BSplineLocalBases &lb)
+    {
+        int64_t nBases = b_knots.size() - p - 1;
+        if (nBases <= 0)
+            throw std::runtime_error("BSpline knots number not enough");
+        if (p < 1 || p > bSplineMaxLocalDegree)
+            throw std::runtime_error("B-Spline degree not supported by the local evaluator");
+        lb.resize(p, nBases, b_samps.size());
+        for (int64_t j = 0; j < b_samps.size(); j++)
+        {
+            int64_t span = detail::BSplineFindSpan(b_knots.data(), p, nBases, b_samps[j]);
+            lb.first[j] = span - p;
+            detail::BSplineLocalBasesFill(p, b_knots.data(), span, b_samps[j], lb, j);
+        }
+    }
+
+    /**
+     * @brief LU with partial pivoting of an n x n matrix with kl sub- and ku super-diagonals
+     *
+     * O(n (kl + ku) kl) to factorize, O(n (kl + ku)) per right hand side column
+     */
+    class BandLU
+    {
+        int64_t n;
+        int kl, ku, w;
+        std::vector<double> a; //* (i, j) at a[i * w + j - i + kl], upper part widened by kl for fill-in
+        std::vector<int64_t> piv;
+
+    public:
+        BandLU(int64_t nN, int nKl, int nKu)
+            : n(nN), kl(nKl), ku(nKu), w(2 * nKl + nKu + 1), a(nN * (2 * nKl + nKu + 1), 0.0), piv(nN) {}
+
+        bool inBand(int64_t i, int64_t j) const { return j - i >= -kl && j - i <= ku; }
+
+        double &operator()(int64_t i, int64_t j) { return a[i * w + j - i + kl]; }
+
+        /**
+         * @brief factorizes in place
+         * @return false if a pivot is too small relative to the largest entry
+         */
+        bool factorize()
+        {
+            double aMax = 0;
+            for (auto v : a)
+                aMax = std::max(aMax, std::abs(v));
+            if (aMax == 0)
+                return false;
+            for (int64_t k = 0; k < n; k++)
+            {
+                int64_t iEnd = std::min(n - 1, k + kl);
+                int64_t jEnd = std::min(n - 1, k + kl + ku);
+                int64_t p = k;
+                for (int64_t i = k + 1; i <= iEnd; i++)
+                    if (std::abs((*this)(i, k)) > std::abs((*this)(p, k)))
+                        p = i;
+                piv[k] = p;
+                if (std::abs((*this)(p, k)) <= aMax * 1e-14)
+                    return false;
+                if (p != k)
+                    for (int64_t j = k; j <= jEnd; j++)
+                        std::swap((*this)(k, j), (*this)(p, j));
+                double pivInv = 1.0 / (*this)(k, k);
+                for (int64_t i = k + 1; i <= iEnd; i++)
+                {
+                    double l = (*this)(i, k) * pivInv;
+                    (*this)(i, k) = l;
+                    if (l != 0)
+                        for (int64_t j = k + 1; j <= jEnd; j++)
+                            (*this)(i, j) -= l * (*this)(k, j);
+                }
+            }
+            return true;
+        }
+
+        /**
+         * @brief solves in place for each column of b, after factorize()
+         */
+        void solve(MatX &b)
+        {
+            for (int64_t k = 0; k < n; k++)
+            {
+                if (piv[k] != k)
+                    b.row(k).swap(b.row(piv[k]));
+                int64_t iEnd = std::min(n - 1, k + kl);
+                for (int64_t i = k + 1; i <= iEnd; i++)
+                    b.row(i) -= (*this)(i, k) * b.row(k);
+            }
+            for (int64_t i = n - 1; i >= 0; i--)
+            {
+                int64_t jEnd = std::min(n - 1, i + kl + ku);
+                for (int64_t j = i + 1; j <= jEnd; j++)
+                    b.row(i) -= (*this)(i, j) * b.row(j);
+                b.row(i) /= (*this)(i, i);
+            }
+        }
+    };
+
+    /**
+     * @brief the dense reference path of CubicSplineToBSpline, b_knots already built
+     */
+    inline void CubicSplineToBSplineDense(
         const VecX &fit_knots,
         const Mat3X &fitPts,
         const Vec3 &startTan,
         const Vec3 &endTan,
-        VecX &b_knots,
+        const VecX &b_knots,
         Mat3X &b_points,
         bool periodic = false)
     {
-        if (fit_knots.size() < 2)
-            throw std::runtime_error("input vector too small");
-        if (fit_knots.size() != fitPts.cols())
-            throw std::runtime_error("input pts size not matching knots");
-        double maxKnot = fit_knots.maxCoeff();
-        double minKnot = fit_knots.minCoeff();
-        double knotInterval = maxKnot - minKnot;
-        if (knotInterval < verySmallDouble)
-            throw numerical_error("knot input too close to same");
-        for (int i = 1; i < fit_knots.size(); i++)
-            if (fit_knots[i - 1] > fit_knots[i])
-                throw numerical_error("knot input not ascending");
-
-        b_knots.resize(fit_knots.size() + 6);
-        b_knots(Eigen::seq(3, 3 + fit_knots.size() - 1)) = fit_knots;
-        b_knots(Eigen::seq(0, 2)).setConstant(minKnot);
-        b_knots(Eigen::seq(3 + fit_knots.size(), Eigen::last)).setConstant(maxKnot);
-
         MatX bases, dBases, ddBases;
         BSplineBases(3, b_knots, fit_knots, bases, dBases, ddBases);
         MatX A;
@@ -333,4 +658,160 @@ namespace DwgSim
         }
     }
 
+    /**
+     * @brief O(n) path of CubicSplineToBSpline, same system as the dense one
+     *
+     * Row 0 and row n + 1 are the end conditions, row i + 1 interpolates fit point i
+     * (bases i .. i + 3, one sub- and two super-diagonals). The end rows fit in a band of 2 + 2 except
+     * for the periodic couplings of the two ends, which are removed as a rank <= 2 update and put back
+     * with Sherman-Morrison-Woodbury.
+     *
+     * @return false if the fit knots repeat or the banded solve is not accurate, then the dense path is to be used
+     */
+    inline bool CubicSplineToBSplineBanded(
+        const VecX &fit_knots,
+        const Mat3X &fitPts,
+        const Vec3 &startTan,
+        const Vec3 &endTan,
+        const VecX &b_knots,
+        Mat3X &b_points,
+        bool periodic = false)
+    {
+        int64_t n = fit_knots.size();
+        int64_t N = n + 2;
+        for (int64_t i = 1; i < n; i++)
+            if (!(fit_knots[i - 1] < fit_knots[i])) // the dense bases average both sides of repeated knots
+                return false;
+
+        struct Entry
+        {
+            int64_t i, j;
+            double v;
+        };
+        std::vector<Entry> entries;
+        entries.reserve(4 * N + 8);
+        BSplineLocalBases lb;
+        BSplineBasesLocal(3, b_knots, fit_knots, lb);
+        auto addRow = [&](int64_t i, int64_t jSamp, const MatX &vals, double scale)
+        {
+            for (int r = 0; r < 4; r++)
+                if (vals(r, jSamp) != 0)
+                    entries.push_back(Entry{i, lb.basis(jSamp, r), vals(r, jSamp) * scale});
+        };
+
+        MatX rhs;
+        rhs.setZero(N, 3);
+        for (int64_t ik = 0; ik < n; ik++)
+        {
+            addRow(ik + 1, ik, lb.N, 1.0);
+            rhs.row(ik + 1) = fitPts(Eigen::all, ik).transpose();
+        }
+        if (periodic)
+        {
+            addRow(0, 0, lb.ddN, 1.0);
+            addRow(0, n - 1, lb.ddN, -1.0);
+            addRow(N - 1, 0, lb.dN, 1.0);
+            addRow(N - 1, n - 1, lb.dN, -1.0);
+        }
+        else
+        {
+            if (startTan.squaredNorm() == 0)
+                addRow(0, 0, lb.ddN, 1.0);
+            else
+                addRow(0, 0, lb.dN, 1.0),
+                    rhs.row(0) = startTan.transpose(); //* the startTan points to right
+            if (endTan.squaredNorm() == 0)
+                addRow(N - 1, n - 1, lb.ddN, 1.0);
+            else
+                addRow(N - 1, n - 1, lb.dN, 1.0),
+                    rhs.row(N - 1) = endTan.transpose();
+        }
+
+        BandLU band(N, 2, 2);
+        std::vector<int64_t> cornerRows; //* rows with entries outside the band
+        std::vector<Entry> corners;
+        for (auto &e : entries)
+            if (band.inBand(e.i, e.j))
+                band(e.i, e.j) += e.v;
+            else
+            {
+                if (std::find(cornerRows.begin(), cornerRows.end(), e.i) == cornerRows.end())
+                    cornerRows.push_back(e.i);
+                corners.push_back(e);
+            }
+        if (!band.factorize())
+            return false;
+
+        // A = B + sum_r e_r c_r^T, solve B [y Z] = [rhs E]
+        int64_t m = int64_t(cornerRows.size());
+        MatX yZ;
+        yZ.setZero(N, 3 + m);
+        yZ.leftCols(3) = rhs;
+        for (int64_t r = 0; r < m; r++)
+            yZ(cornerRows[r], 3 + r) = 1.0;
+        band.solve(yZ);
+        MatX x = yZ.leftCols(3);
+        if (m)
+        {
+            // x = y - Z (I + C^T Z)^-1 C^T y
+            MatX CtYZ;
+            CtYZ.setZero(m, 3 + m);
+            for (auto &e : corners)
+            {
+                int64_t r = std::find(cornerRows.begin(), cornerRows.end(), e.i) - cornerRows.begin();
+                CtYZ.row(r) += e.v * yZ.row(e.j);
+            }
+            MatX cap = MatX::Identity(m, m) + CtYZ.rightCols(m);
+            auto capLU = cap.fullPivLu();
+            if (!capLU.isInvertible())
+                return false;
+            x -= yZ.rightCols(m) * capLU.solve(CtYZ.leftCols(3));
+        }
+
+        // accept only if as accurate as a direct solve
+        MatX res = -rhs;
+        double aMax = 0;
+        for (auto &e : entries)
+        {
+            res.row(e.i) += e.v * x.row(e.j);
+            aMax = std::max(aMax, std::abs(e.v));
+        }
+        if (!(res.norm() <= 1e-11 * (aMax * x.norm() + rhs.norm())))
+            return false;
+
+        b_points = x.transpose();
+        return true;
+    }
+
+    inline void CubicSplineToBSpline(
+        const VecX &fit_knots,
+        const Mat3X &fitPts,
+        const Vec3 &startTan,
+        const Vec3 &endTan,
+        VecX &b_knots,
+        Mat3X &b_points,
+        bool periodic = false)
+    {
+        if (fit_knots.size() < 2)
+            throw std::runtime_error("input vector too small");
+        if (fit_knots.size() != fitPts.cols())
+            throw std::runtime_error("input pts size not matching knots");
+        double maxKnot = fit_knots.maxCoeff();
+        double minKnot = fit_knots.minCoeff();
+        double knotInterval = maxKnot - minKnot;
+        if (knotInterval < verySmallDouble)
+            throw numerical_error("knot input too close to same");
+        for (int i = 1; i < fit_knots.size(); i++)
+            if (fit_knots[i - 1] > fit_knots[i])
+                throw numerical_error("knot input not ascending");
+
+        b_knots.resize(fit_knots.size() + 6);
+        b_knots(Eigen::seq(3, 3 + fit_knots.size() - 1)) = fit_knots;
+        b_knots(Eigen::seq(0, 2)).setConstant(minKnot);
+        b_knots(Eigen::seq(3 + fit_knots.size(), Eigen::last)).setConstant(maxKnot);
+
+        if (!CubicSplineToBSplineBanded(fit_knots, fitPts, startTan, endTan, b_knots, b_points, periodic))
+            CubicSplineToBSplineDense(fit_knots, fitPts, startTan, endTan, b_knots, b_points, periodic);
+    }
+
 }
\ No newline at end of file
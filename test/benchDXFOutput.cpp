@@ -0,0 +1,112 @@
+
+#include "dxfWriter.h"
+#include <cassert>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace DwgSim
+{
+    //* counts and drops everything, so only the formatting is timed
+    class CountingBuf : public std::streambuf
+    {
+    public:
+        size_t count = 0;
+
+    protected:
+        std::streamsize xsputn(const char *, std::streamsize n) override
+        {
+            count += n;
+            return n;
+        }
+        int_type overflow(int_type c) override
+        {
+            count++;
+            return c;
+        }
+    };
+
+    struct BenchEntities
+    {
+        std::vector<double> lines; // 6 per line
+        std::vector<uint64_t> handles;
+    };
+
+    BenchEntities makeEntities(int64_t nLine)
+    {
+        BenchEntities ret;
+        std::mt19937_64 gen(42);
+        std::uniform_real_distribution<double> dist(-1e4, 1e4);
+        ret.lines.resize(nLine * 6);
+        ret.handles.resize(nLine);
+        for (auto &v : ret.lines)
+            v = dist(gen);
+        for (int64_t i = 0; i < nLine; i++)
+            ret.handles[i] = 0x200 + i * 3;
+        return ret;
+    }
+
+    //* the former ostream based writer
+    void writeOstream(std::ostream &o, const BenchEntities &ents)
+    {
+        o << std::setprecision(16);
+        for (size_t i = 0; i < ents.handles.size(); i++)
+        {
+            o << "  0\nLINE\n";
+            o << "  5\n"
+              << std::hex << std::uppercase << ents.handles[i] << std::dec << std::nouppercase << "\n";
+            o << "  100\nAcDbEntity\n";
+            o << "  8\n0\n";
+            o << "  100\nAcDbLine\n";
+            for (int j = 0; j < 6; j++)
+                o << "  " << (j < 3 ? 10 : 11) + 10 * (j % 3) << "\n"
+                  << ents.lines[i * 6 + j] << "\n";
+        }
+    }
+
+    void writeDxfWriter(std::ostream &o, const BenchEntities &ents)
+    {
+        DxfWriter w(o);
+        for (size_t i = 0; i < ents.handles.size(); i++)
+        {
+            w.str("  0\nLINE\n");
+            w.groupHandle(5, ents.handles[i]);
+            w.str("  100\nAcDbEntity\n");
+            w.str("  8\n0\n");
+            w.str("  100\nAcDbLine\n");
+            w.groupVector3(ents.lines.data() + i * 6, 10, 10);
+            w.groupVector3(ents.lines.data() + i * 6 + 3, 11, 10);
+        }
+    }
+
+    template <class F>
+    void bench(const char *name, const BenchEntities &ents, F &&write)
+    {
+        CountingBuf buf;
+        std::ostream o(&buf);
+        auto t0 = std::chrono::steady_clock::now();
+        write(o, ents);
+        auto t1 = std::chrono::steady_clock::now();
+        double sec = std::chrono::duration<double>(t1 - t0).count();
+        std::cout << std::setw(12) << name << ": "
+                  << buf.count / 1e6 << " MB in " << sec << " s, "
+                  << buf.count / 1e6 / sec << " MB/s" << std::endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int64_t nLine = 1000000;
+    if (argc >= 2)
+        nLine = std::stoll(argv[1]);
+
+    auto ents = DwgSim::makeEntities(nLine);
+    std::cout << "writing " << nLine << " LINE entities" << std::endl;
+    DwgSim::bench("ostream", ents, DwgSim::writeOstream);
+    DwgSim::bench("DxfWriter", ents, DwgSim::writeDxfWriter);
+    return 0;
+}
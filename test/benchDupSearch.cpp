@@ -0,0 +1,177 @@
+
+#include "lineDetect.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace DwgSim
+{
+    //* lines, about a quarter exact copies; all with z = 0 if planar
+    t_eigenPts<6> makeRawLines(int64_t nLine, bool planar = false)
+    {
+        std::mt19937_64 gen(42);
+        std::uniform_real_distribution<double> dist(-1e4, 1e4);
+        t_eigenPts<6> lines(nLine);
+        for (int64_t i = 0; i < nLine; i++)
+        {
+            if (i % 4 == 3)
+            {
+                lines[i] = lines[std::uniform_int_distribution<int64_t>(0, i - 1)(gen)];
+                continue;
+            }
+            for (int k = 0; k < 6; k++)
+                lines[i][k] = dist(gen);
+            if (i % 8 == 0) // axis aligned, shares its direction with many others
+                lines[i][1] = lines[i][4], lines[i][2] = lines[i][5] = 0;
+            if (planar)
+                lines[i][2] = lines[i][5] = 0;
+        }
+        return lines;
+    }
+
+    //* normalized line keys as linesDuplications builds them
+    t_eigenPts<6> makeLines(int64_t nLine)
+    {
+        auto lines = makeRawLines(nLine);
+        double maxBase;
+        auto linesInf = linesToInfLine(lines);
+        return getInfLineNormalized(linesInf, maxBase);
+    }
+
+    auto bench(const char *name, DupSearchBackend backend, t_eigenPts<6> &keys, bool floatCandidates = false)
+    {
+        DupSearchOptions opts;
+        opts.backend = backend;
+        opts.floatCandidates = floatCandidates;
+        auto t0 = std::chrono::steady_clock::now();
+        auto dups = getPtsDuplications<6>(keys, 1e-8, 1, opts);
+        auto t1 = std::chrono::steady_clock::now();
+        std::cout << std::setw(10) << name << ": " << dups.size() << " groups in "
+                  << std::chrono::duration<double>(t1 - t0).count() << " s" << std::endl;
+        return dups;
+    }
+
+    //* linesDuplications on planar lines, through the 2-D keys and forced through the 3-D ones
+    bool benchPlanar(int64_t nLine)
+    {
+        auto lines = makeRawLines(nLine, true);
+        auto t0 = std::chrono::steady_clock::now();
+        auto dups2 = linesDuplications(lines);
+        auto t1 = std::chrono::steady_clock::now();
+        auto dups3 = detail::LinesDuplications<3>(lines, 1e-8, 1e-5, 1, DupSearchOptions{}, nullptr);
+        auto t2 = std::chrono::steady_clock::now();
+        std::cout << std::setw(10) << "2-D keys" << ": " << std::get<0>(dups2).size() << " groups in "
+                  << std::chrono::duration<double>(t1 - t0).count() << " s" << std::endl;
+        std::cout << std::setw(10) << "3-D keys" << ": " << std::get<0>(dups3).size() << " groups in "
+                  << std::chrono::duration<double>(t2 - t1).count() << " s" << std::endl;
+        return dups2 == dups3;
+    }
+
+    //* closed and open polylines of 4 to 8 vertices, about a quarter copies, half of those reversed;
+    //* false if a copy is not grouped with its source
+    bool benchPolylines(int64_t nPoly)
+    {
+        std::mt19937_64 gen(7);
+        std::uniform_real_distribution<double> dist(-1e4, 1e4);
+        std::vector<std::vector<double>> polys(nPoly);
+        std::vector<char> closeds(nPoly);
+        std::vector<int64_t> srcOf(nPoly, -1);
+        PolylineGeomSet polySet;
+        for (int64_t i = 0; i < nPoly; i++)
+        {
+            int siz = 4 + int(i % 5);
+            auto &v = polys[i];
+            int64_t src = i - 5 * (1 + int64_t(i % 13));
+            if (i % 4 == 3 && src >= 0)
+            {
+                srcOf[i] = src;
+                closeds[i] = closeds[src];
+                v = polys[src];
+                if (i % 8 == 3) // reversed: vertices backwards, segment bulges backwards and negated
+                {
+                    std::vector<double> v1 = v;
+                    for (int ii = 0; ii < siz; ii++)
+                        for (int d = 0; d < 3; d++)
+                            v1[3 + 4 * ii + d] = v[3 + 4 * (siz - 1 - ii) + d];
+                    for (int ii = 0; ii < siz - 1; ii++)
+                        v1[6 + 4 * ii] = -v[6 + 4 * (siz - 2 - ii)];
+                    v1[6 + 4 * (siz - 1)] = closeds[i] ? -v[6 + 4 * (siz - 1)] : 0.0; // the closing segment
+                    v = v1;
+                }
+            }
+            else
+            {
+                closeds[i] = i % 3 == 0;
+                v.assign(siz * 4 + 3, 0.0);
+                v[2] = 1;
+                for (int ii = 0; ii < siz; ii++)
+                    v[3 + 4 * ii] = dist(gen), v[4 + 4 * ii] = dist(gen);
+                for (int ii = 0; ii < siz - (closeds[i] ? 0 : 1); ii++)
+                    v[6 + 4 * ii] = i % 2 ? 0.0 : std::round(dist(gen) / 5e3) / 4;
+            }
+            double *dst = polySet.appendPoly(i, siz, closeds[i]);
+            std::copy(v.begin(), v.end(), dst);
+        }
+        auto t0 = std::chrono::steady_clock::now();
+        auto dups = polySet.getDuplicates(1e-8);
+        auto t1 = std::chrono::steady_clock::now();
+        std::cout << std::setw(10) << "polylines" << ": " << dups.size() << " groups in "
+                  << std::chrono::duration<double>(t1 - t0).count() << " s" << std::endl;
+
+        std::vector<int64_t> groupOf(nPoly, -1);
+        for (int64_t g = 0; g < int64_t(dups.size()); g++)
+            for (auto i : dups[g])
+                groupOf[i] = g;
+        for (int64_t i = 0; i < nPoly; i++)
+            if (srcOf[i] >= 0 && (groupOf[i] < 0 || groupOf[i] != groupOf[srcOf[i]]))
+                return false;
+        return true;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int64_t nLine = 1000000;
+    if (argc >= 2)
+        nLine = std::stoll(argv[1]);
+
+    auto keys = DwgSim::makeLines(nLine);
+    std::cout << "searching duplicates of " << nLine << " lines" << std::endl;
+    auto dupsKD = DwgSim::bench("KD-tree", DwgSim::DupSearchBackend::KDTree, keys);
+    auto dupsGrid = DwgSim::bench("grid hash", DwgSim::DupSearchBackend::GridHash, keys);
+    if (dupsKD != dupsGrid)
+    {
+        std::cout << "backends differ" << std::endl;
+        return 1;
+    }
+    auto dupsKDFloat = DwgSim::bench("KD float", DwgSim::DupSearchBackend::KDTree, keys, true);
+    auto dupsGridFloat = DwgSim::bench("grid float", DwgSim::DupSearchBackend::GridHash, keys, true);
+    if (dupsKDFloat != dupsKD || dupsGridFloat != dupsKD)
+    {
+        std::cout << "float candidates differ" << std::endl;
+        return 1;
+    }
+
+    std::cout << "searching duplicates of " << nLine << " planar lines" << std::endl;
+    if (!DwgSim::benchPlanar(nLine))
+    {
+        std::cout << "2-D and 3-D keys differ" << std::endl;
+        return 1;
+    }
+
+    int64_t nPoly = 200000;
+    if (argc >= 3)
+        nPoly = std::stoll(argv[2]);
+    std::cout << "searching duplicates of " << nPoly << " polylines" << std::endl;
+    if (!DwgSim::benchPolylines(nPoly))
+    {
+        std::cout << "polyline copies not grouped" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -1,8 +1,15 @@
 
 #include "lineDetect.h"
+#include "onlineDupFilter.h"
 #include "csvUtil.h"
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstring>
 #include <fstream>
+#include <map>
+#include <random>
+#include <stdexcept>
 
 namespace DwgSim
 {
@@ -65,6 +72,942 @@ namespace DwgSim
         assert(retPrecise.size() == 1);
         assert(retInclude.size() == 3);
     }
+
+    //* the all pairs loops the sweeps in linesDuplications / arcsDuplications replace
+    auto linesDuplicationsAllPairs(t_eigenPts<6> &lines, double eps, double lEps)
+    {
+        double maxBase{1e-100};
+        auto linesInf = linesToInfLine(lines);
+        auto linesInfNorm = getInfLineNormalized(linesInf, maxBase);
+        auto infDup = getPtsDuplications<6>(linesInfNorm, eps);
+        std::vector<int64_t> inPreciseDups(lines.size(), -1);
+        std::vector<std::set<int64_t>> preciseDups;
+        std::vector<std::pair<int64_t, int64_t>> includeDups;
+        for (auto &s : infDup)
+            for (auto i : s)
+            {
+                Vec3 dir = linesInf[i](Seq012);
+                Vec3 base = linesInf[i](Seq345);
+                double Li = (lines[i](Seq012) - base).dot(dir);
+                double Ri = (lines[i](Seq345) - base).dot(dir);
+                if (Li > Ri)
+                    std::swap(Li, Ri);
+                for (auto j : s)
+                {
+                    if (i == j)
+                        continue;
+                    double Lj = (lines[j](Seq012) - base).dot(dir);
+                    double Rj = (lines[j](Seq345) - base).dot(dir);
+                    if (Lj > Rj)
+                        std::swap(Lj, Rj);
+                    if (std::abs(Li - Lj) < lEps && std::abs(Ri - Rj) < lEps)
+                    {
+                        if (inPreciseDups[i] == -1)
+                        {
+                            inPreciseDups[i] = preciseDups.size();
+                            preciseDups.emplace_back();
+                        }
+                        inPreciseDups[j] = inPreciseDups[i];
+                        preciseDups.at(inPreciseDups[i]).insert(i);
+                        preciseDups.at(inPreciseDups[i]).insert(j);
+                    }
+                    if (Li - lEps < Lj && Ri + lEps > Rj)
+                        includeDups.emplace_back(std::make_pair(i, j));
+                }
+            }
+        return std::make_tuple(preciseDups, includeDups);
+    }
+
+    auto arcsIncludeAllPairs(t_eigenPts<9> &arcs, double eps)
+    {
+        double maxPos{1e-100}, maxR{1e-100};
+        auto arcsReg = arcsRegulate(arcs, maxPos, maxR, eps);
+        auto circs = arcsToCircle(arcsReg);
+        std::vector<std::pair<int64_t, int64_t>> includeDups;
+        for (auto &s : getPtsDuplications<7>(circs, eps))
+            for (auto i : s)
+                for (auto j : s)
+                {
+                    if (j == i)
+                        continue;
+                    double t0 = arcsReg[i](7), t1 = arcsReg[i](8);
+                    double t0c = arcsReg[j](7), t1c = arcsReg[j](8);
+                    if (t0 <= t0c + eps && t1 >= t1c - eps)
+                        includeDups.push_back(std::make_pair(i, j));
+                    if (t0 == 0 && t1 == 2 * pi)
+                        includeDups.push_back(std::make_pair(i, j));
+                }
+        return includeDups;
+    }
+
+    void test4()
+    {
+        // dashed runs on a few carrier lines, with exact copies, overlaps and near misses
+        std::mt19937_64 gen(7);
+        std::uniform_real_distribution<double> uni(0, 1);
+        t_eigenPts<6> lineSet;
+        for (int carrier = 0; carrier < 4; carrier++)
+        {
+            Vec3 p0{1000 * uni(gen), 1000 * uni(gen), 0};
+            Vec3 d{uni(gen) - 0.5, uni(gen) - 0.5, 0};
+            d.normalize();
+            for (int k = 0; k < 400; k++)
+            {
+                double a = std::floor(200 * uni(gen)) * 0.5;
+                double b = a + std::floor(1 + 4 * uni(gen)) * 0.5;
+                if (k % 7 == 0)
+                    b = a + 1e-6; // within lEps of a
+                Eigen::Vector<double, 6> v;
+                v(Seq012) = p0 + a * d;
+                v(Seq345) = p0 + b * d;
+                if (k % 2)
+                    std::swap(v(0), v(3)), std::swap(v(1), v(4)), std::swap(v(2), v(5));
+                lineSet.push_back(v);
+            }
+        }
+        auto [precise, include] = linesDuplications(lineSet, 1e-8, 1e-5);
+        auto [preciseRef, includeRef] = linesDuplicationsAllPairs(lineSet, 1e-8, 1e-5);
+        std::cout << "lines precise " << precise.size() << " include " << include.size() << std::endl;
+        assert(precise == preciseRef);
+        assert(include == includeRef);
+
+        t_eigenPts<9> arcSet;
+        for (int k = 0; k < 600; k++)
+        {
+            double t0 = std::floor(12 * uni(gen)) * pi / 6;
+            double t1 = k % 5 == 0 ? t0 : t0 + std::floor(1 + 6 * uni(gen)) * pi / 6;
+            if (k % 11 == 0)
+                t0 = 0, t1 = 2 * pi; // circles
+            arcSet.push_back(Eigen::Vector<double, 9>{0, 0, 1, double(k % 3), 0, 0, 1.0 + k % 2, t0, std::fmod(t1, 2 * pi) + (k % 11 == 0 ? 2 * pi : 0)});
+        }
+        auto [arcPrecise, arcInclude] = arcsDuplications(arcSet, 1e-8);
+        auto arcIncludeRef = arcsIncludeAllPairs(arcSet, 1e-8);
+        std::cout << "arcs include " << arcInclude.size() << std::endl;
+        assert(arcInclude == arcIncludeRef);
+    }
+
+    void test5()
+    {
+        // grid hash backend against the KD-tree, including a dynamic size set
+        std::mt19937_64 gen(11);
+        std::uniform_real_distribution<double> uni(-1, 1);
+        t_eigenPts<9> pts, tests;
+        t_eigenPts<Eigen::Dynamic> ptsDyn;
+        for (int i = 0; i < 3000; i++)
+        {
+            Eigen::Vector<double, 9> v;
+            for (int k = 0; k < 9; k++)
+                v[k] = i % 5 == 4 ? pts[i / 2][k] + (k == 3 ? 5e-9 * uni(gen) : 0.0) : std::round(uni(gen) * 20) / 20;
+            pts.push_back(v);
+            if (i % 3 == 0)
+                tests.push_back(v);
+            ptsDyn.push_back(Eigen::VectorXd(v));
+        }
+        DupSearchOptions optsKD, optsGrid;
+        optsGrid.backend = DupSearchBackend::GridHash;
+        auto dupsKD = getPtsDuplications<9>(pts, 1e-8, 1, optsKD);
+        auto inKD = getPtsDuplicationsInPts<9>(pts, tests, 1e-8, 1, optsKD);
+        auto dupsDynKD = getPtsDuplications<Eigen::Dynamic>(ptsDyn, 1e-8, 1, optsKD);
+        auto dupsGrid = getPtsDuplications<9>(pts, 1e-8, 1, optsGrid);
+        auto inGrid = getPtsDuplicationsInPts<9>(pts, tests, 1e-8, 1, optsGrid);
+        auto dupsDynGrid = getPtsDuplications<Eigen::Dynamic>(ptsDyn, 1e-8, 1, optsGrid);
+        std::cout << "groups " << dupsKD.size() << " in pts " << inKD.size() << std::endl;
+        assert(dupsKD.size() > 0);
+        assert(dupsKD == dupsGrid);
+        assert(dupsDynKD == dupsDynGrid);
+        std::sort(inKD.begin(), inKD.end());
+        std::sort(inGrid.begin(), inGrid.end());
+        assert(inKD == inGrid);
+    }
+
+    //* seeded values for the randomized tests
+    struct TestRandom
+    {
+        std::mt19937_64 gen;
+        std::uniform_real_distribution<double> uni{-1, 1};
+
+        explicit TestRandom(uint64_t seed) : gen(seed) {}
+
+        //* uniform in [-1, 1)
+        double operator()() { return uni(gen); }
+    };
+
+    /**
+     * @brief builds n entries in order: entry i is copy(i, src) of src = i - 1 - i % spread if i % 3 and src >= 0,
+     * fresh(i) otherwise, so about two thirds are perturbed copies of nearby earlier ones
+     */
+    template <class Fresh, class Copy>
+    void buildWithCopies(int n, int spread, Fresh &&fresh, Copy &&copy)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            int src = i - 1 - i % spread;
+            if (i % 3 && src >= 0)
+                copy(i, src);
+            else
+                fresh(i);
+        }
+    }
+
+    //* f(opts) once per backend, with the other options at their defaults
+    template <class F>
+    void forEachBackend(F &&f)
+    {
+        for (auto backend : {DupSearchBackend::KDTree, DupSearchBackend::GridHash})
+        {
+            DupSearchOptions opts;
+            opts.backend = backend;
+            f(opts);
+        }
+    }
+
+    void test6()
+    {
+        // groups are connected components, the same for any thread count and backend
+        t_eigenPts<3> chain;
+        for (int i = 0; i < 50; i++)
+            chain.push_back(Eigen::Vector3d{0.6e-8 * i, 0, 0}), chain.push_back(Eigen::Vector3d{1.0 * i, 1, 0});
+        auto chainDups = getPtsDuplications<3>(chain, 1e-8, 4);
+        assert(chainDups.size() == 1 && chainDups[0].size() == 50 && *chainDups[0].begin() == 0);
+
+        TestRandom rnd(17);
+        t_eigenPts<6> lines;
+        buildWithCopies(
+            4000, 5,
+            [&](int i)
+            {
+                Eigen::Vector<double, 6> v;
+                for (int k = 0; k < 6; k++)
+                    v[k] = std::round(rnd() * 10) / 10;
+                lines.push_back(v);
+            },
+            [&](int i, int src)
+            {
+                Eigen::Vector<double, 6> v = lines[src];
+                for (int k = 0; k < 6; k++)
+                    v[k] += 3e-9 * rnd();
+                lines.push_back(v);
+            });
+        forEachBackend(
+            [&](const DupSearchOptions &opts)
+            {
+                auto [prec1, incl1] = linesDuplications(lines, 1e-8, 1e-5, 1, opts);
+                auto [prec4, incl4] = linesDuplications(lines, 1e-8, 1e-5, 4, opts);
+                auto in1 = getPtsDuplicationsInPts<6>(lines, lines, 1e-8, 1, opts);
+                auto in4 = getPtsDuplicationsInPts<6>(lines, lines, 1e-8, 4, opts);
+                std::cout << "groups " << prec1.size() << " include " << incl1.size() << std::endl;
+                assert(prec1.size() > 0);
+                assert(prec1 == prec4 && incl1 == incl4 && in1 == in4);
+            });
+    }
+
+    //* PolylineGeomSet::getDuplicates as it was on per-polyline VectorXd and a dynamic size KD-tree
+    auto polyDuplicatesReference(const std::vector<Eigen::VectorXd> &polys, double eps)
+    {
+        std::map<int, std::set<int64_t>> siz_to_idx;
+        for (int64_t i = 0; i < int64_t(polys.size()); i++)
+            siz_to_idx[int(polys[i].size() - 3) / 4].insert(i);
+        std::vector<std::set<int64_t>> ret;
+        for (auto &[siz, s] : siz_to_idx)
+        {
+            std::vector<Eigen::VectorXd> polyVecsCur;
+            std::vector<int64_t> localIdx;
+            double maxL{1e-100};
+            for (auto i : s)
+            {
+                polyVecsCur.push_back(polys[i]);
+                localIdx.push_back(i);
+                for (int ii = 0; ii < siz; ii++)
+                    maxL = std::max(maxL, polys[i](Eigen::seq(3 + 4 * ii, 5 + 4 * ii)).array().abs().maxCoeff());
+            }
+            for (auto &v : polyVecsCur)
+            {
+                for (int ii = 0; ii < siz; ii++)
+                    v(Eigen::seq(3 + 4 * ii, 5 + 4 * ii)) /= maxL;
+                v(v.size() - 1) = 0;
+                if (siz >= 2)
+                {
+                    int cmp01 = coordCompare(v(Eigen::seq(3, 5)), v(Eigen::seq(3 + 4 * (siz - 1), 5 + 4 * (siz - 1))), eps);
+                    bool invert = cmp01 > 0;
+                    if (cmp01 == 0)
+                    {
+                        int cmpm11 = coordCompare(v(Eigen::seq(7, 9)), v(Eigen::seq(3 + 4 * (siz - 2), 5 + 4 * (siz - 2))), eps);
+                        if (cmpm11 > 0 || (cmpm11 == 0 && v(6) < 0) || (cmpm11 == 0 && v(6 + 4 * (siz - 2)) < 0))
+                            invert = true;
+                    }
+                    if (invert)
+                    {
+                        Eigen::VectorXd v1 = v;
+                        for (int ii = 0; ii < siz; ii++)
+                            v1(Eigen::seq(3 + 4 * ii, 5 + 4 * ii)) = v(Eigen::seq(3 + 4 * (siz - 1 - ii), 5 + 4 * (siz - 1 - ii)));
+                        for (int ii = 0; ii < siz - 1; ii++)
+                            v1(6 + 4 * ii) = -v(6 + 4 * (siz - 2 - ii));
+                        v = v1;
+                    }
+                }
+            }
+            for (auto &ss : getPtsDuplications<Eigen::Dynamic>(polyVecsCur, eps))
+            {
+                ret.emplace_back();
+                for (auto ii : ss)
+                    ret.back().insert(localIdx[ii]);
+            }
+        }
+        return ret;
+    }
+
+    void test7()
+    {
+        // flat arena polyline set against the VectorXd version, with reversed and perturbed copies
+        std::mt19937_64 gen(23);
+        std::uniform_real_distribution<double> uni(-1, 1);
+        std::vector<Eigen::VectorXd> polys;
+        PolylineGeomSet polySet;
+        for (int i = 0; i < 3000; i++)
+        {
+            int siz = 1 + i % 6;
+            Eigen::VectorXd v;
+            int src = i - 6 * (1 + i % 11);
+            if (i % 4 == 3 && src >= 0)
+            {
+                v = polys[src];
+                if (i % 8 == 3) // reversed
+                {
+                    Eigen::VectorXd v1 = v;
+                    for (int ii = 0; ii < siz; ii++)
+                        v1(Eigen::seq(3 + 4 * ii, 5 + 4 * ii)) = v(Eigen::seq(3 + 4 * (siz - 1 - ii), 5 + 4 * (siz - 1 - ii)));
+                    for (int ii = 0; ii < siz - 1; ii++)
+                        v1(6 + 4 * ii) = -v(6 + 4 * (siz - 2 - ii));
+                    v = v1;
+                }
+                else
+                    v(3) += 2e-7 * uni(gen);
+            }
+            else
+            {
+                v.setZero(siz * 4 + 3);
+                v(2) = 1;
+                for (int k = 3; k < v.size(); k++)
+                    v(k) = (k - 3) % 4 == 2 ? 0.0 : std::round(uni(gen) * 4) * 25;
+                for (int ii = 0; ii < siz; ii++)
+                    v(6 + 4 * ii) = i % 3 ? 0.0 : std::round(uni(gen) * 4) / 4;
+            }
+            polys.push_back(v);
+            polySet.insertPoly(i, siz, v);
+        }
+        auto ref = polyDuplicatesReference(polys, 1e-8);
+        auto dups = polySet.getDuplicates(1e-8, 4);
+        std::cout << "polyline groups " << dups.size() << std::endl;
+        assert(dups.size() > 0);
+        assert(dups == ref);
+        assert(polySet.getDuplicates(1e-8) == ref);
+        bool rejected = false;
+        try
+        {
+            polySet.appendPoly(3000, 2);
+        }
+        catch (const std::logic_error &)
+        {
+            rejected = true;
+        }
+        assert(rejected);
+        assert(polySet.getDuplicates(1e-8) == ref);
+    }
+
+    void test8()
+    {
+        // exact copies are dropped with their payload, near copies and NaN keys are kept
+        EntityList list;
+        OnlineDupFilter filter;
+        int64_t nDropped = 0;
+        auto add = [&](EntityType type, std::vector<double> v)
+        {
+            auto &ent = list.push(type, uint64_t(list.size() + 1), 0);
+            if (type == EntityType::Line)
+            {
+                ent.rec = int64_t(list.lines.size() / EntityList::lineRecSize);
+                list.lines.insert(list.lines.end(), v.begin(), v.end());
+                list.lineExtrusions.insert(list.lineExtrusions.end(), {0., 0., 1.});
+            }
+            else if (type == EntityType::Polyline2D)
+            {
+                ent.rec = int64_t(list.polylines.size());
+                PolylineRecord poly;
+                poly.vertStart = int64_t(list.polyVerts.size() / 3);
+                poly.bulgeStart = int64_t(list.polyBulges.size());
+                poly.nVert = poly.nBulge = int64_t(v.size() / 4);
+                for (size_t iv = 0; iv < v.size() / 4; iv++)
+                {
+                    list.polyVerts.insert(list.polyVerts.end(), v.begin() + 4 * iv, v.begin() + 4 * iv + 3);
+                    list.polyBulges.push_back(v[4 * iv + 3]);
+                    list.polyVertHandles.push_back(0);
+                }
+                poly.extrusion = {0, 0, 1};
+                list.polylines.push_back(poly);
+            }
+            else
+            {
+                ent.rec = int64_t(list.arcs.size() / EntityList::arcRecSize);
+                list.arcs.insert(list.arcs.end(), v.begin(), v.end());
+            }
+            if (!filter.keepLast(list))
+                list.popBack(), nDropped++;
+        };
+        add(EntityType::Line, {0, 0, 0, 1, 0, 0});
+        add(EntityType::Polyline2D, {0, 0, 0, 0.5, 1, 0, 0, 0, 1, 1, 0, 0});
+        add(EntityType::Line, {0, 0, 0, 1, 0, 0});
+        add(EntityType::Line, {0, 0, 0, 1, 1e-12, 0});
+        add(EntityType::Circle, {0, 0, 1, 2, 2, 0, 1, 0, 2 * pi});
+        add(EntityType::Arc, {0, 0, 1, 2, 2, 0, 1, 0, 2 * pi});
+        add(EntityType::Polyline2D, {0, 0, 0, 0.5, 1, 0, 0, 0, 1, 1, 0, 0});
+        add(EntityType::Polyline2D, {0, 0, 0, -0.5, 1, 0, 0, 0, 1, 1, 0, 0});
+        add(EntityType::Line, {0, 0, 0, NAN, 0, 0});
+        add(EntityType::Line, {0, 0, 0, NAN, 0, 0});
+        add(EntityType::Line, {0, 0, 0, 1, 0, 0});
+        std::cout << "kept " << list.size() << " dropped " << nDropped << std::endl;
+        assert(nDropped == 4 && list.size() == 7);
+        assert(list.lines.size() == 4 * EntityList::lineRecSize && list.arcs.size() == EntityList::arcRecSize);
+        assert(list.polylines.size() == 2 && list.polyVerts.size() == 2 * 3 * 3);
+    }
+
+    //* linesToInfLine / getInfLineNormalized / arcsRegulate as they were, one Eigen vector at a time
+    auto linesToInfLineReference(t_eigenPts<6> &lines, double &maxBaseSiz)
+    {
+        t_eigenPts<6> ret = lines;
+        for (int64_t i = 0; i < (int64_t)lines.size(); i++)
+        {
+            Vec3 p0 = lines[i](Seq012);
+            Vec3 p1 = lines[i](Seq345);
+            double LRef = std::max(p0.norm(), p1.norm());
+            Vec3 dir = p1 - p0;
+            Vec3 base;
+            double dirNormSqr = dir.squaredNorm();
+            if (dir.norm() < LRef * 1e-10 || LRef == 0)
+            {
+                dir.setZero();
+                dir(0) = 1;
+                base = p0;
+            }
+            else
+            {
+                double alphaB = -p0.dot(dir) / (dirNormSqr + 1e-300);
+                base = (1 - alphaB) * p0 + alphaB * p1;
+            }
+            dir.normalize();
+            if (std::abs(dir(2)) > 1e-13)
+            {
+                if (dir(2) < 0)
+                    dir *= -1;
+            }
+            else if (std::abs(dir(0)) > 1e-13)
+            {
+                if (dir(0) < 0)
+                    dir *= -1;
+            }
+            else if (dir(1) < 0)
+                dir *= -1;
+            ret[i](Seq012) = dir;
+            ret[i](Seq345) = base;
+        }
+        maxBaseSiz = 1e-300;
+        for (auto &v : ret)
+            maxBaseSiz = std::max(maxBaseSiz, v(Seq345).norm());
+        return ret;
+    }
+
+    auto arcsRegulateReference(t_eigenPts<9> &arcs, double &maxPos, double &maxR, double eps)
+    {
+        t_eigenPts<9> ret = arcs;
+        maxPos = 1e-100;
+        maxR = 1e-100;
+        for (auto &v : ret)
+        {
+            if (v(8) < v(7))
+                v(8) += 2 * pi;
+            if (v(7) >= 2 * pi - eps)
+                v(8) -= 2 * pi, v(7) -= 2 * pi;
+            v(Seq012).normalize();
+            maxPos = std::max(maxPos, v(Seq345).norm());
+            maxR = std::max(maxR, v(6));
+        }
+        for (auto &v : ret)
+        {
+            v(Seq345) /= maxPos;
+            v(6) /= maxR;
+        }
+        return ret;
+    }
+
+    //* same bits, except that any two NaNs match: the sign of a NaN depends on the compiler's operand order;
+    //* with FMA the compiler may contract the reference, then only up to rounding
+    template <int dim>
+    bool bitEqual(const t_eigenPts<dim> &a, const t_eigenPts<dim> &b)
+    {
+        if (a.size() != b.size())
+            return false;
+        for (size_t i = 0; i < a.size(); i++)
+            for (int k = 0; k < dim; k++)
+            {
+                if ((std::isnan(a[i][k]) && std::isnan(b[i][k])) || !std::memcmp(&a[i][k], &b[i][k], sizeof(double)))
+                    continue;
+#ifdef __FMA__
+                if (std::abs(a[i][k] - b[i][k]) <= 1e-12 * (1 + std::abs(b[i][k])))
+                    continue;
+#endif
+                return false;
+            }
+        return true;
+    }
+
+    bool closeScalar(double a, double b)
+    {
+#ifdef __FMA__
+        return std::abs(a - b) <= 1e-12 * std::abs(b);
+#else
+        return a == b;
+#endif
+    }
+
+    void test9()
+    {
+        // batch kernels give the keys of the per-vector code bit for bit, degenerate and NaN rows included
+        std::mt19937_64 gen(29);
+        std::uniform_real_distribution<double> uni(-1, 1);
+        t_eigenPts<6> lines;
+        t_eigenPts<9> arcs;
+        for (int i = 0; i < 1003; i++)
+        {
+            Eigen::Vector<double, 6> l;
+            for (int k = 0; k < 6; k++)
+                l[k] = uni(gen) * std::pow(10.0, i % 7);
+            if (i % 5 == 1) // axis aligned, both signs
+                l[1] = l[4], l[2] = l[5] = 0;
+            if (i % 5 == 2) // vertical
+                l[0] = l[3], l[1] = l[4];
+            if (i % 11 == 3) // point
+                l(Seq345) = l(Seq012);
+            if (i % 13 == 4)
+                l.setZero();
+            if (i == 500)
+                l[4] = NAN;
+            lines.push_back(l);
+
+            Eigen::Vector<double, 9> a;
+            for (int k = 0; k < 7; k++)
+                a[k] = uni(gen) * 100;
+            a[6] = std::abs(a[6]);
+            a[7] = (uni(gen) + 1) * pi;
+            a[8] = i % 3 ? (uni(gen) + 1) * pi : a[7] + 2 * pi;
+            if (i % 17 == 5)
+                a[7] = 2 * pi - 1e-9, a[8] = 2 * pi + 1;
+            if (i % 19 == 6)
+                a(Seq012).setZero();
+            arcs.push_back(a);
+        }
+
+        double maxBaseRef, maxBase, maxBaseFused;
+        auto infRef = linesToInfLineReference(lines, maxBaseRef);
+        auto inf = linesToInfLine(lines);
+        auto infNorm = getInfLineNormalized(inf, maxBase);
+        t_eigenPts<6> infFused;
+        auto infNormFused = linesToInfLineNormalized(lines, infFused, maxBaseFused);
+        assert(bitEqual(inf, infRef) && bitEqual(infFused, infRef));
+        assert(closeScalar(maxBase, maxBaseRef) && closeScalar(maxBaseFused, maxBaseRef));
+        auto infNormRef = infRef;
+        for (auto &v : infNormRef)
+            v(Seq345) /= maxBaseRef;
+        assert(bitEqual(infNorm, infNormRef) && bitEqual(infNormFused, infNormRef));
+
+        double maxPosRef, maxRRef, maxPos, maxR;
+        auto regRef = arcsRegulateReference(arcs, maxPosRef, maxRRef, 1e-8);
+        auto reg = arcsRegulate(arcs, maxPos, maxR, 1e-8);
+        assert(closeScalar(maxPos, maxPosRef) && closeScalar(maxR, maxRRef));
+        assert(bitEqual(reg, regRef));
+        std::cout << "lines " << lines.size() << " arcs " << arcs.size() << " maxBase " << maxBase << std::endl;
+    }
+
+    void test10()
+    {
+        // planar sets go through the 2-D keys, with the results of the 3-D ones; copies are offset around eps
+        TestRandom rnd(31);
+        t_eigenPts<6> lines;
+        t_eigenPts<9> arcs;
+        auto push = [&](int i, Eigen::Vector<double, 6> l, const Eigen::Vector<double, 9> &a)
+        {
+            l[2] = l[5] = i % 4 ? 0.0 : -0.0;
+            lines.push_back(l), arcs.push_back(a);
+        };
+        buildWithCopies(
+            4000, 7,
+            [&](int i)
+            {
+                Eigen::Vector<double, 6> l;
+                Eigen::Vector<double, 9> a;
+                for (int k = 0; k < 6; k++)
+                    l[k] = std::round(rnd() * 4) * 25;
+                a << 0, 0, 1, std::round(rnd() * 4) * 25, std::round(rnd() * 4) * 25, 0,
+                    std::round(rnd() * 4 + 5) * 10, (rnd() + 1) * pi, i % 5 ? (rnd() + 1) * pi : 0;
+                if (i % 5 == 0)
+                    a[8] = 2 * pi;
+                push(i, l, a);
+            },
+            [&](int i, int src)
+            {
+                Eigen::Vector<double, 6> l = lines[src];
+                Eigen::Vector<double, 9> a = arcs[src];
+                l[i % 2 ? 0 : 4] += 1e-6 * (1 + 0.5 * rnd());
+                a[3 + i % 2] += 1e-6 * (1 + 0.5 * rnd());
+                a[6 + i % 3] += 1e-8 * (1 + 0.5 * rnd());
+                push(i, l, a);
+            });
+        t_eigenPts<6> linesTest(lines.begin(), lines.begin() + 1500);
+        t_eigenPts<9> arcsTest(arcs.begin(), arcs.begin() + 1500);
+        assert(detail::LinesArePlanar(lines) && detail::ArcsArePlanar(arcs));
+
+        forEachBackend(
+            [&](const DupSearchOptions &opts)
+            {
+                auto [lPrecise, lInclude] = linesDuplications(lines, 1e-8, 1e-5, 4, opts);
+                assert(std::tie(lPrecise, lInclude) == detail::LinesDuplications<3>(lines, 1e-8, 1e-5, 1, opts, nullptr));
+                assert(lineInLinesDuplications(lines, linesTest, 1e-8, 1e-5, 4, opts) ==
+                       detail::LineInLinesDuplications<3>(lines, linesTest, 1e-8, 1e-5, 1, opts, nullptr));
+                auto [aPrecise, aInclude] = arcsDuplications(arcs, 1e-8, 4, opts);
+                assert(std::tie(aPrecise, aInclude) == detail::ArcsDuplications<3>(arcs, 1e-8, 1, opts, nullptr));
+                assert(arcInArcsDuplications(arcs, arcsTest, 1e-8, 4, opts) ==
+                       detail::ArcInArcsDuplications<3>(arcs, arcsTest, 1e-8, 1, opts, nullptr));
+                std::cout << "line groups " << lPrecise.size() << " arc groups " << aPrecise.size() << std::endl;
+                assert(lPrecise.size() > 0 && aPrecise.size() > 0);
+            });
+
+        lines[7][5] = 1e-3, arcs[7][2] = -1;
+        assert(!detail::LinesArePlanar(lines) && !detail::ArcsArePlanar(arcs));
+    }
+
+    void test11()
+    {
+        // small sets compared pair by pair find what the KD-tree and the grid find
+        TestRandom rnd(37);
+        DupSearchCounters counters;
+        for (int n : {1, 3, 5, 8, 13, 40, 90})
+        {
+            t_eigenPts<7> pts, tests;
+            auto push = [&](int i, const Eigen::Vector<double, 7> &v)
+            {
+                pts.push_back(v);
+                if (i % 2)
+                    tests.push_back(v);
+            };
+            buildWithCopies(
+                n, 4,
+                [&](int i)
+                {
+                    Eigen::Vector<double, 7> v;
+                    for (int k = 0; k < 7; k++)
+                        v[k] = std::round(rnd() * 2) * 0.5;
+                    push(i, v);
+                },
+                [&](int i, int src)
+                {
+                    Eigen::Vector<double, 7> v = pts[src];
+                    v[i % 7] += 1e-8 * (1 + 0.5 * rnd());
+                    push(i, v);
+                });
+            forEachBackend(
+                [&](DupSearchOptions opts)
+                {
+                    opts.bruteForceMax = 0;
+                    auto groups = getPtsDuplications<7>(pts, 1e-8, 1, opts);
+                    auto pairs = getPtsDuplicationsInPts<7>(pts, tests, 1e-8, 1, opts);
+                    opts.bruteForceMax = 1000;
+                    assert(getPtsDuplications<7>(pts, 1e-8, 2, opts, &counters) == groups);
+                    assert(getPtsDuplicationsInPts<7>(pts, tests, 1e-8, 1, opts, &counters) == pairs);
+                });
+        }
+        std::cout << "brute force searches " << counters.bruteForce << std::endl;
+        assert(counters.bruteForce == 7 * 2 * 2);
+    }
+
+    void test12()
+    {
+        // tiled searches find what one search over all points finds
+        TestRandom rnd(41);
+        t_eigenPts<6> lines;
+        t_eigenPts<9> arcs;
+        auto push = [&](int i, Eigen::Vector<double, 6> l, Eigen::Vector<double, 9> a)
+        {
+            if (i == 100)
+                l[1] = NAN, a[4] = NAN;
+            lines.push_back(l), arcs.push_back(a);
+        };
+        buildWithCopies(
+            3000, 5,
+            [&](int i)
+            {
+                Eigen::Vector<double, 6> l;
+                Eigen::Vector<double, 9> a;
+                for (int k = 0; k < 6; k++)
+                    l[k] = i % 7 ? std::round(rnd() * 8) * 125 : rnd() * 1000;
+                a << 0, 0, 1, std::round(rnd() * 8) * 125, std::round(rnd() * 8) * 125, 0,
+                    std::round(rnd() * 4 + 5) * 10, (rnd() + 1) * pi, (rnd() + 1) * pi;
+                if (i % 4 == 0)
+                    a[2] = -1;
+                push(i, l, a);
+            },
+            [&](int i, int src)
+            {
+                Eigen::Vector<double, 6> l = lines[src];
+                Eigen::Vector<double, 9> a = arcs[src];
+                l[i % 6] += 1e-5 * (1 + 0.5 * rnd());
+                a[3 + i % 4] += 1e-5 * (1 + 0.5 * rnd());
+                push(i, l, a);
+            });
+        t_eigenPts<6> linesTest(lines.begin() + 500, lines.end());
+        t_eigenPts<9> arcsTest(arcs.begin() + 500, arcs.end());
+
+        forEachBackend(
+            [&](DupSearchOptions opts)
+            {
+                opts.tileMax = 0;
+                auto lineDups = linesDuplications(lines, 1e-8, 1e-5, 1, opts);
+                auto lineInDups = lineInLinesDuplications(lines, linesTest, 1e-8, 1e-5, 1, opts);
+                auto arcDups = arcsDuplications(arcs, 1e-8, 1, opts);
+                auto arcInDups = arcInArcsDuplications(arcs, arcsTest, 1e-8, 1, opts);
+                DupSearchCounters counters;
+                opts.tileMax = 100;
+                assert(linesDuplications(lines, 1e-8, 1e-5, 4, opts, &counters) == lineDups);
+                assert(lineInLinesDuplications(lines, linesTest, 1e-8, 1e-5, 4, opts, &counters) == lineInDups);
+                assert(arcsDuplications(arcs, 1e-8, 4, opts, &counters) == arcDups);
+                assert(arcInArcsDuplications(arcs, arcsTest, 1e-8, 4, opts, &counters) == arcInDups);
+                assert(counters.tiled == 6);
+                std::cout << "line groups " << std::get<0>(lineDups).size() << " arc groups " << std::get<0>(arcDups).size() << std::endl;
+                assert(std::get<0>(lineDups).size() > 0 && std::get<0>(arcDups).size() > 0);
+            });
+    }
+
+    void test13()
+    {
+        // keys sorted on disk in runs find what the in-memory searches find, planar or not
+        TestRandom rnd(43);
+        t_eigenPts<6> lines;
+        t_eigenPts<9> arcs;
+        auto push = [&](int i, Eigen::Vector<double, 6> l, Eigen::Vector<double, 9> a)
+        {
+            if (i == 50)
+                l[3] = NAN, a[3] = NAN;
+            lines.push_back(l), arcs.push_back(a);
+        };
+        buildWithCopies(
+            2000, 9,
+            [&](int i)
+            {
+                Eigen::Vector<double, 6> l;
+                Eigen::Vector<double, 9> a;
+                for (int k = 0; k < 6; k++)
+                    l[k] = std::round(rnd() * 8) * 125;
+                a << 0, 0, 1, std::round(rnd() * 8) * 125, std::round(rnd() * 8) * 125, 0,
+                    std::round(rnd() * 4 + 5) * 10, (rnd() + 1) * pi, i % 5 ? (rnd() + 1) * pi : 2 * pi;
+                if (i % 5 == 0)
+                    a[7] = 0;
+                push(i, l, a);
+            },
+            [&](int i, int src)
+            {
+                Eigen::Vector<double, 6> l = lines[src];
+                Eigen::Vector<double, 9> a = arcs[src];
+                l[i % 6] += 1e-5 * (1 + 0.5 * rnd());
+                a[3 + i % 6] += 1e-6 * (1 + 0.5 * rnd());
+                push(i, l, a);
+            });
+        t_eigenPts<6> linesPlanar = lines;
+        for (auto &l : linesPlanar)
+            l[2] = l[5] = 0;
+        t_eigenPts<9> arcsSpatial = arcs;
+        for (int i = 0; i < int(arcsSpatial.size()); i += 7)
+            arcsSpatial[i][1] = 0.5;
+
+        auto check = [&](t_eigenPts<6> &ls, t_eigenPts<9> &as)
+        {
+            t_eigenPts<6> lsTest(ls.begin() + 700, ls.end());
+            t_eigenPts<9> asTest(as.begin() + 700, as.end());
+            auto lineDups = linesDuplications(ls);
+            auto lineInDups = lineInLinesDuplications(ls, lsTest);
+            auto arcDups = arcsDuplications(as);
+            auto arcInDups = arcInArcsDuplications(as, asTest);
+            DupSearchOptions opts;
+            opts.externalBudget = 4096; // chunks of 64 keys, merges of 2 runs at a time
+            assert(linesDuplications(ls, 1e-8, 1e-5, 1, opts) == lineDups);
+            assert(lineInLinesDuplications(ls, lsTest, 1e-8, 1e-5, 1, opts) == lineInDups);
+            assert(arcsDuplications(as, 1e-8, 1, opts) == arcDups);
+            assert(arcInArcsDuplications(as, asTest, 1e-8, 1, opts) == arcInDups);
+            std::cout << "line groups " << std::get<0>(lineDups).size() << " arc groups " << std::get<0>(arcDups).size() << std::endl;
+            assert(std::get<0>(lineDups).size() > 0 && std::get<0>(arcDups).size() > 0);
+        };
+        check(lines, arcs);
+        check(linesPlanar, arcsSpatial);
+    }
+    void test14()
+    {
+        // float candidates checked in double find what the double searches find, pairs near eps included
+        TestRandom rnd(47);
+        t_eigenPts<6> pts, tests;
+        auto push = [&](int i, Eigen::Vector<double, 6> v)
+        {
+            if (i == 70)
+                v[2] = NAN;
+            pts.push_back(v);
+            if (i % 2)
+                tests.push_back(v);
+        };
+        buildWithCopies(
+            4000, 7,
+            [&](int i)
+            {
+                Eigen::Vector<double, 6> v;
+                for (int k = 0; k < 6; k++)
+                    v[k] = std::round(rnd() * 4) * 0.25 + (i % 11 ? 0 : rnd());
+                push(i, v);
+            },
+            [&](int i, int src)
+            {
+                Eigen::Vector<double, 6> v = pts[src];
+                v[i % 6] += 1e-6 * (1 + 0.02 * rnd()); // distances straddling eps
+                push(i, v);
+            });
+        t_eigenPts<6> ptsFar = pts;
+        for (auto &v : ptsFar)
+            v[0] += 1e6; // would need a float radius past 1024 eps
+
+        DupSearchCounters counters;
+        forEachBackend(
+            [&](DupSearchOptions opts)
+            {
+                auto groups = getPtsDuplications<6>(pts, 1e-6, 1, opts);
+                auto pairs = getPtsDuplicationsInPts<6>(pts, tests, 1e-6, 1, opts);
+                auto groupsFar = getPtsDuplications<6>(ptsFar, 1e-6, 1, opts);
+                opts.floatCandidates = true;
+                assert(getPtsDuplications<6>(pts, 1e-6, 2, opts, &counters) == groups);
+                assert(getPtsDuplicationsInPts<6>(pts, tests, 1e-6, 1, opts, &counters) == pairs);
+                assert(getPtsDuplications<6>(ptsFar, 1e-6, 1, opts, &counters) == groupsFar);
+                std::cout << "groups " << groups.size() << std::endl;
+                assert(groups.size() > 0);
+            });
+        std::cout << "searches with float candidates " << counters.floatCandidates << std::endl;
+        assert(counters.floatCandidates == 2 * 2);
+    }
+
+    void test15()
+    {
+        // ellipses equal up to the sign of the axis or the angle wrap, splines equal up to reversal,
+        // knot affine maps and weight scaling, are grouped
+        t_eigenPts<12> ellipses;
+        Eigen::Vector<double, 12> e;
+        e << 10, 20, 0, 3, 4, 0, 0, 0, 1, 0.5, 0.3, 1.2;
+        ellipses.push_back(e);
+        Eigen::Vector<double, 12> eFlip = e; // the same ellipse from the other end of the major axis
+        eFlip(Eigen::seq(3, 5)) *= -1;
+        eFlip[10] += pi, eFlip[11] += pi;
+        ellipses.push_back(eFlip);
+        Eigen::Vector<double, 12> eWrap = e; // the same angles one turn on
+        eWrap[10] += 2 * pi, eWrap[11] += 2 * pi;
+        ellipses.push_back(eWrap);
+        Eigen::Vector<double, 12> eOther = e; // a different arc
+        eOther[11] = 1.3;
+        ellipses.push_back(eOther);
+        Eigen::Vector<double, 12> eFull = e, eFullShift = e;
+        eFull[10] = 0, eFull[11] = 2 * pi;
+        eFullShift(Eigen::seq(3, 5)) *= -1;
+        eFullShift[10] = 1, eFullShift[11] = 1 + 2 * pi;
+        ellipses.push_back(eFull), ellipses.push_back(eFullShift);
+        auto ellipseDups = ellipsesDuplications(ellipses);
+        assert(ellipseDups.size() == 2);
+        assert(ellipseDups[0] == std::set<int64_t>({0, 1, 2}));
+        assert(ellipseDups[1] == std::set<int64_t>({4, 5}));
+
+        SplineGeomSet splineSet;
+        auto addSpline = [&](int64_t idx, const std::vector<double> &ctrl, const std::vector<double> &knots)
+        {
+            int64_t nCtrl = int64_t(ctrl.size() / 4);
+            double *v = splineSet.appendSpline(idx, 3, false, nCtrl, int64_t(knots.size()));
+            std::copy(ctrl.begin(), ctrl.end(), v);
+            std::copy(knots.begin(), knots.end(), v + 4 * nCtrl);
+        };
+        std::vector<double> ctrl{0, 0, 0, 1, 1, 2, 0, 2, 3, 2, 0, 1, 4, 0, 0, 1, 5, 1, 0, 1};
+        std::vector<double> knots{0, 0, 0, 0, 0.3, 1, 1, 1, 1};
+        addSpline(0, ctrl, knots);
+        std::vector<double> ctrlRev(ctrl.size()), knotsRev(knots.size()), knotsScaled(knots.size());
+        for (int64_t i = 0; i < 5; i++)
+            for (int d = 0; d < 4; d++)
+                ctrlRev[4 * i + d] = ctrl[4 * (4 - i) + d];
+        for (size_t i = 0; i < knots.size(); i++)
+            knotsRev[i] = 1 - knots[knots.size() - 1 - i], knotsScaled[i] = 2 + 5 * knots[i];
+        addSpline(1, ctrlRev, knotsRev);
+        addSpline(2, ctrl, knotsScaled);
+        std::vector<double> ctrlWeighted = ctrl;
+        for (int64_t i = 0; i < 5; i++)
+            ctrlWeighted[4 * i + 3] *= 3;
+        addSpline(3, ctrlWeighted, knots);
+        std::vector<double> knotsOther = knots; // a different parametrization
+        knotsOther[4] = 0.6;
+        addSpline(4, ctrl, knotsOther);
+        addSpline(5, std::vector<double>(ctrl.begin(), ctrl.end() - 4), {0, 0, 0, 0, 1, 1, 1, 1}); // other shape
+        auto splineDups = splineSet.getDuplicates(1e-8, 2);
+        assert(splineDups.size() == 1);
+        assert(splineDups[0] == std::set<int64_t>({0, 1, 2, 3}));
+        assert(splineSet.getDuplicates(1e-8) == splineDups);
+        bool rejected = false;
+        try
+        {
+            splineSet.appendSpline(6, 3, false, 4, 8);
+        }
+        catch (const std::logic_error &)
+        {
+            rejected = true;
+        }
+        assert(rejected);
+        std::cout << "ellipse groups " << ellipseDups.size() << " spline groups " << splineDups.size() << std::endl;
+    }
+
+    void test16()
+    {
+        // LWPOLYLINE keys keep the elevation and the closed flag, closed ones get their closing segment
+        auto lwPolyline = [](double elevation)
+        {
+            return std::vector<double>{0, 0, elevation, 10, 0, elevation, 10, 5, elevation};
+        };
+        std::vector<double> bulges{0, 0.5, 0};
+        Vec3 extrusion{0, 0, 1};
+
+        PolylineGeomSet polySet;
+        t_eigenPts<6> linesPoly, linesPolyElevated, linesPolyClosed;
+        t_eigenPts<9> arcsPoly;
+        auto v0 = lwPolyline(0), v3 = lwPolyline(3);
+        appendPolylineKeys(polySet, linesPoly, arcsPoly, 0, v0.data(), 3, bulges.data(), 3, false, extrusion);
+        appendPolylineKeys(polySet, linesPolyElevated, arcsPoly, 1, v3.data(), 3, bulges.data(), 3, false, extrusion);
+        appendPolylineKeys(polySet, linesPolyClosed, arcsPoly, 2, v0.data(), 3, bulges.data(), 3, true, extrusion);
+        appendPolylineKeys(polySet, linesPoly, arcsPoly, 3, v0.data(), 3, bulges.data(), 3, false, extrusion);
+        appendPolylineKeys(polySet, linesPolyClosed, arcsPoly, 4, v0.data(), 3, bulges.data(), 3, true, extrusion);
+        auto polyDups = polySet.getDuplicates(1e-8);
+        assert(polyDups.size() == 2);
+        assert(polyDups[0] == std::set<int64_t>({0, 3}));
+        assert(polyDups[1] == std::set<int64_t>({2, 4}));
+        assert(linesPoly.size() == 2 && linesPolyElevated.size() == 1 && linesPolyClosed.size() == 4);
+        assert(arcsPoly.size() == 5);
+
+        // LINEs at z = 0 on the first segment and on the closing one
+        t_eigenPts<6> lines(2);
+        lines[0] << 0, 0, 0, 10, 0, 0;
+        lines[1] << 10, 5, 0, 0, 0, 0;
+        auto covers = [&](t_eigenPts<6> &segs, int64_t j)
+        {
+            auto pairs = std::get<0>(lineInLinesDuplications(segs, lines));
+            return std::any_of(pairs.begin(), pairs.end(), [&](auto &p)
+                               { return p.second == j; });
+        };
+        assert(covers(linesPoly, 0) && !covers(linesPoly, 1));
+        assert(!covers(linesPolyElevated, 0) && !covers(linesPolyElevated, 1));
+        assert(covers(linesPolyClosed, 0) && covers(linesPolyClosed, 1));
+        std::cout << "polyline groups " << polyDups.size() << std::endl;
+    }
 }
 
 int main(int argc, char *argv[])
@@ -75,5 +1018,31 @@ int main(int argc, char *argv[])
     DwgSim::test2();
     std::cout << "Test3: " << std::endl;
     DwgSim::test3();
+    std::cout << "Test4: " << std::endl;
+    DwgSim::test4();
+    std::cout << "Test5: " << std::endl;
+    DwgSim::test5();
+    std::cout << "Test6: " << std::endl;
+    DwgSim::test6();
+    std::cout << "Test7: " << std::endl;
+    DwgSim::test7();
+    std::cout << "Test8: " << std::endl;
+    DwgSim::test8();
+    std::cout << "Test9: " << std::endl;
+    DwgSim::test9();
+    std::cout << "Test10: " << std::endl;
+    DwgSim::test10();
+    std::cout << "Test11: " << std::endl;
+    DwgSim::test11();
+    std::cout << "Test12: " << std::endl;
+    DwgSim::test12();
+    std::cout << "Test13: " << std::endl;
+    DwgSim::test13();
+    std::cout << "Test14: " << std::endl;
+    DwgSim::test14();
+    std::cout << "Test15: " << std::endl;
+    DwgSim::test15();
+    std::cout << "Test16: " << std::endl;
+    DwgSim::test16();
     return 0;
 }
\ No newline at end of file
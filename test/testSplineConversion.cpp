@@ -1,7 +1,9 @@
 
 #include "splineUtil.h"
+#include "splineFitCache.h"
 #include "csvUtil.h"
 #include <cassert>
+#include <cstdio>
 #include <fstream>
 
 namespace DwgSim
@@ -199,6 +201,171 @@ namespace DwgSim
         // std::cout << "=====" << std::endl;
         // std::cout << pts << std::endl;
     }
+
+    void test6()
+    {
+        // banded solve against the dense one, open and closed
+        int n = 300;
+        Mat3X pts;
+        pts.resize(3, n);
+        for (int i = 0; i < n; i++)
+        {
+            double th = 2 * pi * i / (n - 1);
+            pts(Eigen::all, i) = Vec3{std::cos(th) * (100 + 7 * std::sin(13 * th)),
+                                      std::sin(th) * (80 + 5 * std::cos(7 * th)),
+                                      3 * std::sin(th)};
+        }
+        VecX knots;
+        knots.resize(n);
+        knots(0) = 0;
+        for (int i = 1; i < n; i++)
+            knots(i) = knots(i - 1) + (pts(Eigen::all, i) - pts(Eigen::all, i - 1)).norm();
+
+        for (int periodic = 0; periodic < 2; periodic++)
+            for (auto tan : {Vec3{0, 0, 0}, Vec3{0, 1, 0}})
+            {
+                VecX b_knots;
+                Mat3X b_pts, b_pts_ans;
+                DwgSim::CubicSplineToBSpline(knots, pts, tan, tan, b_knots, b_pts, periodic);
+                assert(DwgSim::CubicSplineToBSplineBanded(knots, pts, tan, tan, b_knots, b_pts_ans, periodic));
+                DwgSim::CubicSplineToBSplineDense(knots, pts, tan, tan, b_knots, b_pts_ans, periodic);
+                double err = (b_pts_ans - b_pts).norm() / b_pts_ans.norm();
+                assert(err < 1e-10);
+                std::cout << "Test Error: " << err << std::endl;
+            }
+    }
+
+    void test7()
+    {
+        // local bases against the dense matrices, uniform and not
+        auto localToDense = [](const BSplineLocalBases &lb, const MatX &vals)
+        {
+            MatX ret;
+            ret.setZero(lb.nBases, vals.cols());
+            for (int64_t j = 0; j < vals.cols(); j++)
+                for (int r = 0; r <= lb.p; r++)
+                    ret(lb.basis(j, r), j) += vals(r, j);
+            return ret;
+        };
+        auto relErr = [](const MatX &a, const MatX &b)
+        { return (a - b).norm() / (b.norm() + verySmallDouble); };
+
+        for (int p : {2, 3, 5})
+            for (int uniform = 0; uniform < 2; uniform++)
+            {
+                int nSpan = 12;
+                VecX inner;
+                inner.resize(nSpan + 1);
+                for (int i = 0; i <= nSpan; i++)
+                    inner[i] = uniform ? 2.0 * i : 2.0 * i + 0.7 * std::sin(3.0 * i);
+                // samples inside spans, and at the knots for degrees where the second derivative is continuous
+                VecX samps;
+                samps.resize(p >= 3 ? 2 * nSpan + 1 : nSpan);
+                for (int i = 0; i < nSpan; i++)
+                    samps[p >= 3 ? 2 * i + 1 : i] = 0.3 * inner[i] + 0.7 * inner[i + 1];
+                if (p >= 3)
+                    for (int i = 0; i <= nSpan; i++)
+                        samps[2 * i] = inner[i];
+
+                VecX knots;
+                knots.resize(inner.size() + 2 * p);
+                knots(Eigen::seq(0, p - 1)).setConstant(inner[0]);
+                knots(Eigen::seq(p, p + nSpan)) = inner;
+                knots(Eigen::seq(p + nSpan + 1, Eigen::last)).setConstant(inner[nSpan]);
+
+                MatX bases, dBases, ddBases;
+                BSplineLocalBases lb;
+                BSplineBases(p, knots, samps, bases, dBases, ddBases);
+                BSplineBasesLocal(p, knots, samps, lb);
+                double err = std::max({relErr(localToDense(lb, lb.N), bases),
+                                       relErr(localToDense(lb, lb.dN), dBases),
+                                       relErr(localToDense(lb, lb.ddN), ddBases)});
+                assert(err < 1e-12);
+                std::cout << "Test Error: " << err << std::endl;
+            }
+    }
+
+    void test8()
+    {
+        // periodic to clamped by knot insertion, the same curve, rational and not
+        for (int p : {1, 2, 3, 5})
+            for (int rational = 0; rational < 2; rational++)
+            {
+                int n = 11;
+                VecX knots;
+                knots.resize(n + 1);
+                for (int i = 0; i <= n; i++)
+                    knots[i] = 1.5 * i + 0.4 * std::sin(2.0 * i);
+                MatX pts;
+                pts.resize(4, n);
+                for (int i = 0; i < n; i++)
+                {
+                    double theta = 2 * pi * i / n;
+                    pts(Eigen::all, i) << std::cos(theta), std::sin(theta) * 2, 0.1 * i, rational ? 1.0 + 0.5 * std::cos(3.0 * i) : 1.0;
+                }
+                pts.topRows(3).array().rowwise() *= pts.row(3).array(); // homogeneous
+
+                VecX b_knots;
+                MatX b_pts;
+                PeriodicSplineToOpenSpline(p, knots, pts, b_knots, b_pts);
+                assert(b_pts.cols() == n + p);
+                assert(b_knots.size() == n + 2 * p + 1);
+                assert(b_knots[0] == knots[0] && b_knots[p] == knots[0]);
+                assert(b_knots[n + p] == knots[n] && b_knots[n + 2 * p] == knots[n]);
+
+                VecX samps = VecX::LinSpaced(97, knots[0], knots[n] - 1e-9);
+                MatX bases, dBases, ddBases;
+                BSplineBasesPeriodic(p, knots, samps, bases, dBases, ddBases);
+                MatX curveP = pts * bases;
+                BSplineBases(p, b_knots, samps, bases, dBases, ddBases);
+                MatX curveO = b_pts * bases;
+                curveP.topRows(3).array().rowwise() /= curveP.row(3).array();
+                curveO.topRows(3).array().rowwise() /= curveO.row(3).array();
+                double err = (curveP.topRows(3) - curveO.topRows(3)).norm() / curveP.topRows(3).norm();
+                std::cout << "Test Error: " << err << std::endl;
+                assert(err < 1e-12);
+            }
+    }
+
+    void test9()
+    {
+        // fit cache: shifted copies share a key, entries survive a save and load
+        auto makeInput = [](double shift)
+        {
+            SplineFitInput in;
+            int n = 20;
+            Mat3X pts;
+            pts.resize(3, n);
+            for (int i = 0; i < n; i++)
+                pts(Eigen::all, i) << 0.25 * i + shift, std::sin(0.5 * i), 0.0;
+            in.origin = pts(Eigen::all, 0);
+            in.fit_pts = pts.colwise() - in.origin;
+            in.knots = VecX::LinSpaced(n, 0.0, 1.0);
+            return in;
+        };
+        SplineFitCache cache;
+        auto in0 = makeInput(0.0);
+        auto in1 = makeInput(1024.0); // exact shift
+        assert(in0.key(0) == in1.key(0));
+        assert(in0.key(0) != in0.key(1));
+
+        auto &res = cache[in0.key(0)];
+        CubicSplineToBSpline(in0.knots, in0.fit_pts, in0.start_tan, in0.end_tan, res.b_knots, res.b_pts, in0.closed);
+        assert(cache.find(in1.key(0)) == &res);
+
+        std::string path = "testSplineFitCache.bin";
+        cache.Save(path);
+        SplineFitCache loaded;
+        assert(loaded.Load(path));
+        assert(loaded.size() == 1);
+        auto found = loaded.find(in1.key(0));
+        assert(found);
+        assert(found->b_knots == res.b_knots && found->b_pts == res.b_pts);
+        std::remove(path.c_str());
+        assert(!loaded.Load(path)); // missing, nothing added
+        assert(loaded.size() == 1);
+        std::cout << "Test Cache: " << loaded.size() << " entry" << std::endl;
+    }
 }
 
 int main(int argc, char *argv[])
@@ -216,5 +383,13 @@ int main(int argc, char *argv[])
     DwgSim::test4(); // free-tan
     std::cout << "Test 5: free-free 100 pts" << std::endl;
     DwgSim::test5();
+    std::cout << "Test 6: banded against dense, 300 pts" << std::endl;
+    DwgSim::test6();
+    std::cout << "Test 7: local bases against dense" << std::endl;
+    DwgSim::test7();
+    std::cout << "Test 8: periodic to clamped by knot insertion" << std::endl;
+    DwgSim::test8();
+    std::cout << "Test 9: spline fit cache" << std::endl;
+    DwgSim::test9();
     return 0;
 }
\ No newline at end of file